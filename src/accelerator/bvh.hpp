@@ -0,0 +1,1081 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "../coroutine/interleave.hpp"
+#include "../coroutine/task.hpp"
+#include "../geometry/bound.hpp"
+#include "../geometry/polymorphic.hpp"
+#include "../geometry/precision.hpp"
+#include "../memory/huge_pages.hpp"
+#include "../ray/query.hpp"
+#include "../ray/section.hpp"
+
+namespace Accelerator
+{
+
+	// Bounding volume hierarchy, built with a binned surface area heuristic (SAH)
+	// On Fast Construction of SAH-based Bounding Volume Hierarchies, Wald, 2007
+	// Bounds and traversal are in geometry precision, see geometry/precision.hpp
+	//
+	// A lazy hierarchy only builds the top levels up front. Deeper nodes are left as unsplit leaves,
+	// and are split (a few levels at a time) by the first ray that reaches them. Splitting is thread safe.
+	//
+	// A full hierarchy may also use spatial splits, which split an object between both children (SBVH).
+	// This reduces the overlap of nodes for long thin triangles, e.g. walls, at the cost of duplicated references.
+	// Spatial Splits in Bounding Volume Hierarchies, Stich et al., 2009
+	//
+	// Objects with a one sided material are culled when the ray hits their back side, as the hit can only end the path.
+	// Each node keeps a cone of the normals below it, so whole subtrees facing away from the ray are skipped.
+	// This does not change the result for closed objects, where a ray can not reach a back side first. Rays that leave a
+	// surface do not hit it again, see Geometry::surface_error, so culling only changes paths that pass between
+	// surfaces, e.g. the Cornell box light hangs 0.01 below the ceiling, a ray grazing the ceiling now passes through
+	// the back of the light instead of ending there. See check_culling.
+	class BVH final
+	{
+
+	public:
+
+		// Largest number of rays in a packet
+		static constexpr std::uint32_t max_packet = 64;
+
+		// Shape of the hierarchy
+		struct Statistics
+		{
+			std::uint32_t n_node{ 0 };
+			std::uint32_t n_leaf{ 0 };
+			// Objects in leaves, larger than the number of objects if spatial splits are used
+			std::uint32_t n_reference{ 0 };
+			// Sum of the surface area of overlapping children, relative to the root
+			Geometry::Scalar overlap{ 0 };
+			// Expected cost of a random ray, with node and object test cost of one (1)
+			Geometry::Scalar sah_cost{ 0 };
+		};
+
+		// Work done by a single closest hit query
+		struct Traversal
+		{
+			std::uint32_t n_node{ 0 };
+			std::uint32_t n_test{ 0 };
+		};
+
+	private:
+
+		static constexpr std::uint32_t n_bin = 12;
+		static constexpr std::uint32_t max_leaf = 4;
+
+		// Number of levels built at once, in a lazy hierarchy
+		static constexpr std::uint32_t lazy_depth = 6;
+
+		// Spatial splits are only tried if the children of the best object split overlap by more than this, relative to the root
+		static constexpr Geometry::Scalar spatial_alpha = 1e-5f;
+		// Spatial splits can make deep trees, keep room on the traversal stacks
+		static constexpr std::uint32_t max_spatial_depth = 48;
+
+		// Children are stored as pairs, the right child is the node after the left child
+		struct Node
+		{
+			Geometry::Bound bound;
+			// Leaf: first primitive, interior: left child
+			std::uint32_t offset{ 0 };
+			// Number of primitives, zero for an interior node
+			std::uint32_t count{ 0 };
+			// Split axis, for front to back traversal
+			std::uint8_t axis{ 0 };
+			// Leaf that is not split yet, published with release, so read it before the other members
+			std::atomic<bool> f_lazy{ false };
+			// All objects below face away from rays with direction dot cone_axis larger than cone_cull
+			Geometry::Vector cone_axis{ 0, 0, 0 };
+			Geometry::Scalar cone_cull{ 2 };
+		};
+
+		// Build data for one primitive
+		struct Reference
+		{
+			Geometry::Bound bound;
+			Geometry::Vector centroid;
+			Geometry::Polymorphic const* object;
+			// Zero (0) if two sided
+			Geometry::Vector facing;
+		};
+
+		// Best binned split of a node, by object centroids or by a plane
+		struct Split
+		{
+			Geometry::Scalar cost{ std::numeric_limits<Geometry::Scalar>::max() };
+			std::uint8_t axis{ 0 };
+			// Objects in bins up to and including this go to the left child
+			std::uint32_t bin{ 0 };
+			bool f_valid{ false };
+			// Object split only, bounds of the children
+			Geometry::Bound left;
+			Geometry::Bound right;
+			// Spatial split only, references in both children
+			std::uint32_t n_duplicate{ 0 };
+		};
+
+		// A hierarchy has at most 2n-1 nodes, so storage is allocated once and never moves
+		// With spatial splits, n is the largest number of references the memory budget allows
+		Memory::Array<Node> node;
+		std::uint32_t n_node{ 0 };
+
+		// Spatial splits only, references that can still be duplicated, and the surface area of the root
+		std::uint32_t n_budget{ 0 };
+		Geometry::Scalar root_area{ 0 };
+
+		// Primitives in leaf order, owned by the scene
+		std::vector<Geometry::Polymorphic const*> primitive;
+		// Front side normal of each primitive, zero (0) if it is not culled
+		std::vector<Geometry::Vector> facing;
+
+		// Lazy hierarchy only, kept to split the remaining leaves
+		bool const f_lazy{ false };
+		std::vector<Reference> reference;
+		mutable std::mutex lock_split;
+
+	public:
+
+		BVH() = delete;
+		BVH( BVH const& ) = delete;
+		BVH& operator = ( BVH const& ) = delete;
+
+		BVH(
+			std::vector< std::shared_ptr<Geometry::Polymorphic> > const& geometry,
+			// Per object, true if the material is one sided, empty if none are
+			std::vector<bool> const& one_sided = {},
+			bool const f_lazy = false,
+			// Memory budget of spatial splits, as extra references relative to the number of objects
+			// Zero (0) for object splits only. Not used by a lazy hierarchy.
+			std::float_t const spatial_budget = 0.f
+		)
+			: f_lazy( f_lazy )
+		{
+			reference.reserve( geometry.size() );
+			for ( std::size_t i{ 0 }; i < geometry.size(); ++i )
+			{
+				Geometry::Bound const bound = geometry[i]->bound();
+				bool const f_cull = i < one_sided.size() && one_sided[i];
+				reference.emplace_back( Reference{ bound, bound.centroid(), geometry[i].get(), f_cull ? geometry[i]->facing() : Geometry::Vector( 0, 0, 0 ) } );
+			}
+
+			if ( reference.empty() )
+				return;
+
+			if ( !f_lazy && spatial_budget > 0.f )
+			{
+				n_budget = static_cast<std::uint32_t>( spatial_budget * reference.size() );
+				node = Memory::make_array<Node>( 2 * ( reference.size() + n_budget ) );
+				primitive.reserve( reference.size() + n_budget );
+				facing.reserve( reference.size() + n_budget );
+				n_node = 1;
+				build_spatial( 0, std::move( reference ), 0 );
+				return;
+			}
+
+			node = Memory::make_array<Node>( 2 * reference.size() );
+			primitive.resize( reference.size(), nullptr );
+			facing.resize( reference.size() );
+			n_node = 1;
+			build( 0, 0, static_cast<std::uint32_t>( reference.size() ), 0 );
+
+			// Build data is no longer needed
+			if ( !f_lazy )
+				std::vector<Reference>().swap( reference );
+		};
+
+		// Object by primitive id, as returned by the intersect methods
+		Geometry::Polymorphic const* object(
+			std::uint32_t const id
+		) const
+		{
+			return primitive[id];
+		};
+
+		// Closest object within ]0;distance[
+		// Returns distance and primitive id, id is UINT32_MAX if nothing is hit
+		std::tuple<Geometry::Scalar, std::uint32_t> intersect(
+			Ray::Section const& ray,
+			Geometry::Scalar distance = std::numeric_limits<Geometry::Scalar>::max()
+		) const
+		{
+			std::uint32_t id = UINT32_MAX;
+			if ( node )
+				intersect_subtree( Ray::Query( ray ), 0, distance, id );
+			return { distance, id };
+		};
+
+		// Returns true if there are any objects within ]0;distance[
+		bool occluded(
+			Ray::Section const& ray,
+			std::double_t const max_distance
+		) const
+		{
+			if ( !node )
+				return false;
+
+			Ray::Query const query( ray );
+			Geometry::Scalar const distance = static_cast<Geometry::Scalar>( max_distance );
+			std::uint32_t stack[64];
+			std::uint32_t n_stack{ 0 };
+			stack[n_stack++] = 0;
+			while ( n_stack > 0 )
+			{
+				std::uint32_t const index = stack[--n_stack];
+				Node const& current = visit( index );
+				if ( culled( current, query ) || !hit_bound( current.bound, query, distance ) )
+					continue;
+				if ( current.count > 0 )
+				{
+					for ( std::uint32_t i{ current.offset }; i < current.offset + current.count; ++i )
+					{
+						if ( back_facing( i, query ) )
+							continue;
+						Geometry::Scalar const d = primitive[i]->intersect( query );
+						if ( d > 0 && d < distance )
+							return true;
+					}
+					continue;
+				}
+				stack[n_stack++] = current.offset + 1;
+				stack[n_stack++] = current.offset;
+			}
+			return false;
+		};
+
+		// Closest object for each ray of a batch of independent rays, with up to n_flight traversals interleaved
+		// Each traversal prefetches the node it visits next, and yields to the others while it loads
+		// Calls result( i, distance, id ) for every ray i, id is UINT32_MAX if nothing is hit
+		template<typename Result>
+		void intersect_interleaved(
+			std::span<Ray::Section const> const rays,
+			Result const& result,
+			std::uint32_t const n_flight
+		) const
+		{
+			if ( !node )
+			{
+				for ( std::uint32_t i{ 0 }; i < rays.size(); ++i )
+					result( i, std::numeric_limits<Geometry::Scalar>::max(), UINT32_MAX );
+				return;
+			}
+			Coroutine::Interleave( static_cast<std::uint32_t>( rays.size() ), n_flight,
+				[&]( std::uint32_t const i ) { return intersect_task( Ray::Query( rays[i] ), i, result ); } );
+		};
+
+		// Batched occluded(), calls result( i ) if ray i has an object within ]0;max_distance[i][
+		// Traversals are interleaved as for intersect_interleaved
+		template<typename Result>
+		void occluded_interleaved(
+			std::span<Ray::Section const> const rays,
+			std::span<std::double_t const> const max_distance,
+			Result const& result,
+			std::uint32_t const n_flight
+		) const
+		{
+			if ( !node )
+				return;
+			Coroutine::Interleave( static_cast<std::uint32_t>( rays.size() ), n_flight,
+				[&]( std::uint32_t const i ) { return occluded_task( Ray::Query( rays[i] ), static_cast<Geometry::Scalar>( max_distance[i] ), i, result ); } );
+		};
+
+		// Node and object tests of a closest hit query, for statistics
+		Traversal traversal(
+			Ray::Section const& ray
+		) const
+		{
+			Traversal count;
+			Geometry::Scalar distance = std::numeric_limits<Geometry::Scalar>::max();
+			std::uint32_t id = UINT32_MAX;
+			if ( node )
+				intersect_subtree<true>( Ray::Query( ray ), 0, distance, id, &count );
+			return count;
+		};
+
+		// Shape of the hierarchy, lazy leaves are counted as leaves
+		Statistics statistics() const
+		{
+			Statistics result;
+			if ( !node )
+				return result;
+			Geometry::Scalar const area = node[0].bound.surface_area();
+			if ( !( area > 0 ) )
+				return result;
+			for ( std::uint32_t index{ 0 }; index < n_node; ++index )
+			{
+				Node const& current = node[index];
+				Geometry::Scalar const relative = current.bound.surface_area() / area;
+				++result.n_node;
+				if ( current.count > 0 )
+				{
+					++result.n_leaf;
+					result.n_reference += current.count;
+					result.sah_cost += relative * current.count;
+					continue;
+				}
+				result.sah_cost += relative;
+				result.overlap += node[current.offset].bound.overlap( node[current.offset + 1].bound ).surface_area() / area;
+			}
+			return result;
+		};
+
+		// Closest object for a packet of up to max_packet coherent rays, e.g. neighbouring camera rays
+		// distance and id are in/out, initialise to the furthest distance and UINT32_MAX
+		// Large Ray Packets for Real-time Whitted Ray Tracing, Overbeck et al., 2008
+		void intersect_packet(
+			std::span<Ray::Section const> const rays,
+			std::span<Geometry::Scalar> const distance,
+			std::span<std::uint32_t> const id
+		) const
+		{
+			std::uint32_t const n_ray = static_cast<std::uint32_t>( rays.size() );
+			if ( !node || n_ray == 0 )
+				return;
+
+			Ray::Query query[max_packet];
+			for ( std::uint32_t i{ 0 }; i < n_ray; ++i )
+				query[i] = Ray::Query( rays[i] );
+
+			// Interval bounds of the packet, only valid if all directions have the same sign per axis
+			bool f_coherent{ true };
+			Geometry::Bound origin_bound;
+			Geometry::Bound inv_bound;
+			for ( std::uint32_t i{ 0 }; i < n_ray; ++i )
+			{
+				for ( std::uint8_t a{ 0 }; a < 3; ++a )
+					f_coherent &= ( query[i].negative[a] == query[0].negative[a] );
+				origin_bound.grow( query[i].origin );
+				inv_bound.grow( query[i].inv_direction );
+			}
+
+			// Diverged packet, trace as single rays
+			if ( !f_coherent )
+			{
+				for ( std::uint32_t i{ 0 }; i < n_ray; ++i )
+					intersect_subtree( query[i], 0, distance[i], id[i] );
+				return;
+			}
+
+			std::uint64_t const all = n_ray == 64 ? ~0ull : ( 1ull << n_ray ) - 1;
+
+			struct Entry
+			{
+				std::uint32_t index;
+				std::uint64_t active;
+			};
+			Entry stack[64];
+			std::uint32_t n_stack{ 0 };
+			stack[n_stack++] = { 0, all };
+
+			while ( n_stack > 0 )
+			{
+				auto const [index, active] = stack[--n_stack];
+				Node const& current = visit( index );
+
+				// Cull whole subtree, if no ray in the packet can reach the box
+				if ( !hit_interval( current.bound, origin_bound, inv_bound ) )
+					continue;
+
+				std::uint64_t hit{ 0 };
+				for ( std::uint64_t bits = active; bits; bits &= bits - 1 )
+				{
+					std::uint32_t const i = std::countr_zero( bits );
+					if ( !culled( current, query[i] ) && hit_bound( current.bound, query[i], distance[i] ) )
+						hit |= 1ull << i;
+				}
+				if ( !hit )
+					continue;
+
+				// A single ray left in the packet, finish the subtree without packet overhead
+				if ( std::has_single_bit( hit ) )
+				{
+					std::uint32_t const i = std::countr_zero( hit );
+					intersect_subtree( query[i], index, distance[i], id[i] );
+					continue;
+				}
+
+				if ( current.count > 0 )
+				{
+					for ( std::uint32_t p{ current.offset }; p < current.offset + current.count; ++p )
+						for ( std::uint64_t bits = hit; bits; bits &= bits - 1 )
+						{
+							std::uint32_t const i = std::countr_zero( bits );
+							if ( back_facing( p, query[i] ) )
+								continue;
+							Geometry::Scalar const d = primitive[p]->intersect( query[i] );
+							if ( d > 0 && d < distance[i] )
+							{
+								distance[i] = d;
+								id[i] = p;
+							}
+						}
+					continue;
+				}
+
+				// Front to back, using the shared direction signs of the packet
+				if ( query[0].negative[current.axis] )
+				{
+					stack[n_stack++] = { current.offset, hit };
+					stack[n_stack++] = { current.offset + 1, hit };
+				}
+				else
+				{
+					stack[n_stack++] = { current.offset + 1, hit };
+					stack[n_stack++] = { current.offset, hit };
+				}
+			}
+		};
+
+	private:
+
+		// True if the ray can only hit back sides below the node
+		static bool culled(
+			Node const& current,
+			Ray::Query const& query
+		)
+		{
+			return current.cone_axis.dot( query.direction ) > current.cone_cull;
+		};
+
+		// Strictly back facing, grazing hits are kept, the material rejects those the same way as before
+		bool back_facing(
+			std::uint32_t const id,
+			Ray::Query const& query
+		) const
+		{
+			return facing[id].dot( query.direction ) > 0;
+		};
+
+		// Normal cone of the objects of a node, left as never culled if any object is two sided
+		// or the normals spread over more than a hemisphere
+		static void make_cone(
+			Node& current,
+			std::span<Reference const> const references
+		)
+		{
+			current.cone_axis = Geometry::Vector( 0, 0, 0 );
+			current.cone_cull = 2;
+			Geometry::Vector sum( 0, 0, 0 );
+			for ( Reference const& value : references )
+			{
+				if ( value.facing.dot( value.facing ) == 0 )
+					return;
+				sum = sum + value.facing;
+			}
+			Geometry::Scalar const length = std::sqrt( sum.dot( sum ) );
+			if ( !( length > 0 ) )
+				return;
+			Geometry::Vector const axis = sum / length;
+			Geometry::Scalar cos_spread{ 1 };
+			for ( Reference const& value : references )
+				cos_spread = std::min( cos_spread, axis.dot( value.facing ) );
+			if ( !( cos_spread > 0 ) )
+				return;
+			// A ray faces away from every normal in the cone, if the angle to the axis is below 90 degrees minus the spread
+			current.cone_axis = axis;
+			current.cone_cull = std::sqrt( std::max<Geometry::Scalar>( 0, 1 - cos_spread * cos_spread ) ) + Geometry::gamma( 8 );
+		};
+
+		// Slab test, NaN (ray origin on a slab plane, parallel to it) does not reject the box
+		// The far distance is scaled up, so rounding can not reject a box that is hit
+		static bool hit_bound(
+			Geometry::Bound const& bound,
+			Ray::Query const& query,
+			Geometry::Scalar const distance
+		)
+		{
+			Geometry::Scalar t_near{ 0 };
+			Geometry::Scalar t_far{ distance };
+			for ( std::uint8_t a{ 0 }; a < 3; ++a )
+			{
+				Geometry::Scalar t0 = ( bound.min[a] - query.origin[a] ) * query.inv_direction[a];
+				Geometry::Scalar t1 = ( bound.max[a] - query.origin[a] ) * query.inv_direction[a];
+				if ( query.negative[a] )
+					std::swap( t0, t1 );
+				t1 *= Geometry::robust_scale;
+				t_near = t0 > t_near ? t0 : t_near;
+				t_far = t1 < t_far ? t1 : t_far;
+			}
+			return t_near <= t_far;
+		};
+
+		// Interval arithmetic slab test for a whole packet, conservative
+		// Returns false only if no ray with origin and inverse direction within the intervals can hit the box
+		static bool hit_interval(
+			Geometry::Bound const& bound,
+			Geometry::Bound const& origin,
+			Geometry::Bound const& inv_direction
+		)
+		{
+			Geometry::Scalar t_near{ 0 };
+			Geometry::Scalar t_far{ std::numeric_limits<Geometry::Scalar>::max() };
+			for ( std::uint8_t a{ 0 }; a < 3; ++a )
+			{
+				Geometry::Scalar const i0 = inv_direction.min[a];
+				Geometry::Scalar const i1 = inv_direction.max[a];
+				// Plane distances as intervals
+				Geometry::Scalar const lo_min = bound.min[a] - origin.max[a];
+				Geometry::Scalar const hi_min = bound.min[a] - origin.min[a];
+				Geometry::Scalar const lo_max = bound.max[a] - origin.max[a];
+				Geometry::Scalar const hi_max = bound.max[a] - origin.min[a];
+				Geometry::Scalar const t0_lo = std::min( { lo_min * i0, lo_min * i1, hi_min * i0, hi_min * i1 } );
+				Geometry::Scalar const t0_hi = std::max( { lo_min * i0, lo_min * i1, hi_min * i0, hi_min * i1 } );
+				Geometry::Scalar const t1_lo = std::min( { lo_max * i0, lo_max * i1, hi_max * i0, hi_max * i1 } );
+				Geometry::Scalar const t1_hi = std::max( { lo_max * i0, lo_max * i1, hi_max * i0, hi_max * i1 } );
+				// Entry is the smaller of the two plane distances, exit the larger
+				Geometry::Scalar const enter = std::min( t0_lo, t1_lo );
+				Geometry::Scalar const leave = std::max( t0_hi, t1_hi ) * Geometry::robust_scale;
+				t_near = enter > t_near ? enter : t_near;
+				t_far = leave < t_far ? leave : t_far;
+			}
+			return t_near <= t_far;
+		};
+
+		// Counting is only compiled in for statistics
+		template<bool f_count = false>
+		void intersect_subtree(
+			Ray::Query const& query,
+			std::uint32_t const root,
+			Geometry::Scalar& distance,
+			std::uint32_t& id,
+			Traversal* count = nullptr
+		) const
+		{
+			std::uint32_t stack[64];
+			std::uint32_t n_stack{ 0 };
+			stack[n_stack++] = root;
+			while ( n_stack > 0 )
+			{
+				Node const& current = visit( stack[--n_stack] );
+				if constexpr ( f_count )
+					++count->n_node;
+				if ( culled( current, query ) || !hit_bound( current.bound, query, distance ) )
+					continue;
+				if ( current.count > 0 )
+				{
+					if constexpr ( f_count )
+						count->n_test += current.count;
+					for ( std::uint32_t i{ current.offset }; i < current.offset + current.count; ++i )
+					{
+						if ( back_facing( i, query ) )
+							continue;
+						Geometry::Scalar const d = primitive[i]->intersect( query );
+						if ( d > 0 && d < distance )
+						{
+							distance = d;
+							id = i;
+						}
+					}
+					continue;
+				}
+				// Push far child first
+				if ( query.negative[current.axis] )
+				{
+					stack[n_stack++] = current.offset;
+					stack[n_stack++] = current.offset + 1;
+				}
+				else
+				{
+					stack[n_stack++] = current.offset + 1;
+					stack[n_stack++] = current.offset;
+				}
+			}
+		};
+
+		// Coroutine version of intersect_subtree from the root, calls result( i, distance, id ) when done
+		// The query is copied into the coroutine frame, as the frame outlives the caller
+		template<typename Result>
+		Coroutine::Task intersect_task(
+			Ray::Query const query,
+			std::uint32_t const i,
+			Result const& result
+		) const
+		{
+			Geometry::Scalar distance = std::numeric_limits<Geometry::Scalar>::max();
+			std::uint32_t id = UINT32_MAX;
+			std::uint32_t stack[64];
+			std::uint32_t n_stack{ 0 };
+			stack[n_stack++] = 0;
+			while ( n_stack > 0 )
+			{
+				std::uint32_t const index = stack[--n_stack];
+				// A node may straddle two cache lines
+				__builtin_prefetch( reinterpret_cast<char const*>( &node[index] ) + sizeof( Node ) - 1 );
+				co_await Coroutine::Prefetch{ &node[index] };
+				Node const& current = visit( index );
+				if ( culled( current, query ) || !hit_bound( current.bound, query, distance ) )
+					continue;
+				if ( current.count > 0 )
+				{
+					// Objects are allocated apart from the hierarchy, fetch them all before testing
+					for ( std::uint32_t p{ current.offset }; p < current.offset + current.count; ++p )
+						__builtin_prefetch( primitive[p] );
+					co_await Coroutine::Prefetch{ &facing[current.offset] };
+					for ( std::uint32_t p{ current.offset }; p < current.offset + current.count; ++p )
+					{
+						if ( back_facing( p, query ) )
+							continue;
+						Geometry::Scalar const d = primitive[p]->intersect( query );
+						if ( d > 0 && d < distance )
+						{
+							distance = d;
+							id = p;
+						}
+					}
+					continue;
+				}
+				// Push far child first
+				if ( query.negative[current.axis] )
+				{
+					stack[n_stack++] = current.offset;
+					stack[n_stack++] = current.offset + 1;
+				}
+				else
+				{
+					stack[n_stack++] = current.offset + 1;
+					stack[n_stack++] = current.offset;
+				}
+			}
+			result( i, distance, id );
+		};
+
+		// Coroutine version of occluded, calls result( i ) if the ray is occluded
+		template<typename Result>
+		Coroutine::Task occluded_task(
+			Ray::Query const query,
+			Geometry::Scalar const distance,
+			std::uint32_t const i,
+			Result const& result
+		) const
+		{
+			std::uint32_t stack[64];
+			std::uint32_t n_stack{ 0 };
+			stack[n_stack++] = 0;
+			while ( n_stack > 0 )
+			{
+				std::uint32_t const index = stack[--n_stack];
+				// A node may straddle two cache lines
+				__builtin_prefetch( reinterpret_cast<char const*>( &node[index] ) + sizeof( Node ) - 1 );
+				co_await Coroutine::Prefetch{ &node[index] };
+				Node const& current = visit( index );
+				if ( culled( current, query ) || !hit_bound( current.bound, query, distance ) )
+					continue;
+				if ( current.count > 0 )
+				{
+					// Objects are allocated apart from the hierarchy, fetch them all before testing
+					for ( std::uint32_t p{ current.offset }; p < current.offset + current.count; ++p )
+						__builtin_prefetch( primitive[p] );
+					co_await Coroutine::Prefetch{ &facing[current.offset] };
+					for ( std::uint32_t p{ current.offset }; p < current.offset + current.count; ++p )
+					{
+						if ( back_facing( p, query ) )
+							continue;
+						Geometry::Scalar const d = primitive[p]->intersect( query );
+						if ( d > 0 && d < distance )
+						{
+							result( i );
+							co_return;
+						}
+					}
+					continue;
+				}
+				stack[n_stack++] = current.offset + 1;
+				stack[n_stack++] = current.offset;
+			}
+		};
+
+		// Node by index, splits the node first if it is a lazy leaf
+		Node const& visit(
+			std::uint32_t const index
+		) const
+		{
+			Node const& current = node[index];
+			if ( current.f_lazy.load( std::memory_order_acquire ) )
+				split( index );
+			return current;
+		};
+
+		void split(
+			std::uint32_t const index
+		) const
+		{
+			std::lock_guard<std::mutex> lock( lock_split );
+			// Another thread may have split it, while waiting for the lock
+			if ( !node[index].f_lazy.load( std::memory_order_relaxed ) )
+				return;
+			// Splitting a lazy leaf does not change the result of any query
+			BVH* self = const_cast<BVH*>( this );
+			self->build( index, node[index].offset, node[index].offset + node[index].count, 0 );
+		};
+
+		// Leaf, or lazy leaf, of range [first;last[
+		void make_leaf(
+			std::uint32_t const index,
+			std::uint32_t const first,
+			std::uint32_t const last,
+			bool const f_unsplit
+		)
+		{
+			node[index].offset = first;
+			node[index].count = last - first;
+			if ( !f_unsplit )
+				for ( std::uint32_t i{ first }; i < last; ++i )
+				{
+					primitive[i] = reference[i].object;
+					facing[i] = reference[i].facing;
+				}
+			// Publish the node, after all its data is written
+			node[index].f_lazy.store( f_unsplit, std::memory_order_release );
+		};
+
+		// Recursive build of range [first;last[ into an allocated node
+		// In a lazy hierarchy, nodes at depth lazy_depth are left unsplit
+		void build(
+			std::uint32_t const index,
+			std::uint32_t const first,
+			std::uint32_t const last,
+			std::uint32_t const depth
+		)
+		{
+			Geometry::Bound bound;
+			Geometry::Bound centroid_bound;
+			for ( std::uint32_t i{ first }; i < last; ++i )
+			{
+				bound.grow( reference[i].bound );
+				centroid_bound.grow( reference[i].centroid );
+			}
+			node[index].bound = bound;
+
+			std::uint32_t const count = last - first;
+			make_cone( node[index], std::span<Reference const>( reference.data() + first, count ) );
+			if ( count <= 1 )
+			{
+				make_leaf( index, first, last, false );
+				return;
+			}
+
+			if ( f_lazy && depth >= lazy_depth && count > max_leaf )
+			{
+				make_leaf( index, first, last, true );
+				return;
+			}
+
+			Split const split = object_split( std::span<Reference const>( reference.data() + first, count ), bound, centroid_bound );
+
+			// Traversal cost relative to intersection cost is one (1)
+			Geometry::Scalar const leaf_cost = static_cast<Geometry::Scalar>( count ) * bound.surface_area();
+			if ( ( count <= max_leaf ) && ( !split.f_valid || ( split.cost + bound.surface_area() >= leaf_cost ) ) )
+			{
+				make_leaf( index, first, last, false );
+				return;
+			}
+
+			std::uint32_t middle{ first };
+			if ( split.f_valid )
+			{
+				auto const it = std::partition( reference.begin() + first, reference.begin() + last,
+					[&]( Reference const& value ) { return object_bin( value, split.axis, centroid_bound ) <= split.bin; } );
+				middle = static_cast<std::uint32_t>( it - reference.begin() );
+			}
+			// Degenerate (e.g. equal centroids), split in the middle
+			if ( middle == first || middle == last )
+				middle = first + count / 2;
+
+			std::uint32_t const child = n_node;
+			n_node += 2;
+			build( child, first, middle, depth + 1 );
+			build( child + 1, middle, last, depth + 1 );
+
+			node[index].axis = split.axis;
+			node[index].offset = child;
+			node[index].count = 0;
+			node[index].f_lazy.store( false, std::memory_order_release );
+		};
+
+		static std::uint32_t object_bin(
+			Reference const& value,
+			std::uint8_t const axis,
+			Geometry::Bound const& centroid_bound
+		)
+		{
+			Geometry::Scalar const scale = static_cast<Geometry::Scalar>( n_bin ) / centroid_bound.extent()[axis];
+			return std::min<std::uint32_t>( n_bin - 1, static_cast<std::uint32_t>( ( value.centroid[axis] - centroid_bound.min[axis] ) * scale ) );
+		};
+
+		// Bin of a position, for spatial splits of a node
+		static std::uint32_t spatial_bin(
+			Geometry::Scalar const position,
+			std::uint8_t const axis,
+			Geometry::Bound const& bound
+		)
+		{
+			Geometry::Scalar const scale = static_cast<Geometry::Scalar>( n_bin ) / bound.extent()[axis];
+			Geometry::Scalar const b = ( position - bound.min[axis] ) * scale;
+			return b > 0 ? std::min<std::uint32_t>( n_bin - 1, static_cast<std::uint32_t>( b ) ) : 0;
+		};
+
+		// Split plane after a bin, for spatial splits of a node
+		static Geometry::Scalar spatial_plane(
+			std::uint32_t const bin,
+			std::uint8_t const axis,
+			Geometry::Bound const& bound
+		)
+		{
+			return bound.min[axis] + bound.extent()[axis] * static_cast<Geometry::Scalar>( bin + 1 ) / static_cast<Geometry::Scalar>( n_bin );
+		};
+
+		// Find best split over all axes, using binned centroids
+		// Only splits cheaper than a leaf are valid
+		static Split object_split(
+			std::span<Reference const> const references,
+			Geometry::Bound const& bound,
+			Geometry::Bound const& centroid_bound
+		)
+		{
+			Split best;
+			best.cost = static_cast<Geometry::Scalar>( references.size() ) * bound.surface_area();
+
+			Geometry::Vector const extent = centroid_bound.extent();
+			for ( std::uint8_t a{ 0 }; a < 3; ++a )
+			{
+				if ( extent[a] <= 0 )
+					continue;
+
+				Geometry::Bound bin_bound[n_bin];
+				std::uint32_t bin_count[n_bin] = {};
+				for ( Reference const& value : references )
+				{
+					std::uint32_t const b = object_bin( value, a, centroid_bound );
+					bin_bound[b].grow( value.bound );
+					++bin_count[b];
+				}
+
+				// Sweep from the right, then evaluate cost from the left
+				Geometry::Bound right_bound[n_bin];
+				std::uint32_t right_count[n_bin];
+				Geometry::Bound sweep;
+				std::uint32_t n_sweep{ 0 };
+				for ( std::uint32_t b{ n_bin - 1 }; b > 0; --b )
+				{
+					sweep.grow( bin_bound[b] );
+					n_sweep += bin_count[b];
+					right_bound[b] = sweep;
+					right_count[b] = n_sweep;
+				}
+
+				sweep = Geometry::Bound();
+				n_sweep = 0;
+				for ( std::uint32_t b{ 0 }; b < n_bin - 1; ++b )
+				{
+					sweep.grow( bin_bound[b] );
+					n_sweep += bin_count[b];
+					if ( n_sweep == 0 || right_count[b + 1] == 0 )
+						continue;
+					Geometry::Scalar const cost = n_sweep * sweep.surface_area() + right_count[b + 1] * right_bound[b + 1].surface_area();
+					if ( cost < best.cost )
+					{
+						best.cost = cost;
+						best.axis = a;
+						best.bin = b;
+						best.f_valid = true;
+						best.left = sweep;
+						best.right = right_bound[b + 1];
+					}
+				}
+			}
+			return best;
+		};
+
+		// Find best spatial split over all axes, with bins over the node bounds
+		// References are clipped to each bin they overlap, splits that duplicate more than max_duplicate are not valid
+		static Split spatial_split(
+			std::span<Reference const> const references,
+			Geometry::Bound const& bound,
+			std::uint32_t const max_duplicate
+		)
+		{
+			Split best;
+			std::uint32_t const count = static_cast<std::uint32_t>( references.size() );
+
+			Geometry::Vector const extent = bound.extent();
+			for ( std::uint8_t a{ 0 }; a < 3; ++a )
+			{
+				if ( extent[a] <= 0 )
+					continue;
+
+				Geometry::Bound bin_bound[n_bin];
+				std::uint32_t n_enter[n_bin] = {};
+				std::uint32_t n_exit[n_bin] = {};
+				for ( Reference const& value : references )
+				{
+					std::uint32_t const first = spatial_bin( value.bound.min[a], a, bound );
+					std::uint32_t const last = spatial_bin( value.bound.max[a], a, bound );
+					++n_enter[first];
+					++n_exit[last];
+					if ( first == last )
+					{
+						bin_bound[first].grow( value.bound );
+						continue;
+					}
+					for ( std::uint32_t b{ first }; b <= last; ++b )
+					{
+						Geometry::Bound slab = value.bound;
+						if ( b > first )
+							slab.min[a] = spatial_plane( b - 1, a, bound );
+						if ( b < last )
+							slab.max[a] = spatial_plane( b, a, bound );
+						bin_bound[b].grow( value.object->clip( slab ) );
+					}
+				}
+
+				Geometry::Scalar right_area[n_bin];
+				std::uint32_t right_count[n_bin];
+				Geometry::Bound sweep;
+				std::uint32_t n_sweep{ 0 };
+				for ( std::uint32_t b{ n_bin - 1 }; b > 0; --b )
+				{
+					sweep.grow( bin_bound[b] );
+					n_sweep += n_exit[b];
+					right_area[b] = sweep.surface_area();
+					right_count[b] = n_sweep;
+				}
+
+				sweep = Geometry::Bound();
+				n_sweep = 0;
+				for ( std::uint32_t b{ 0 }; b < n_bin - 1; ++b )
+				{
+					sweep.grow( bin_bound[b] );
+					n_sweep += n_enter[b];
+					if ( n_sweep == 0 || right_count[b + 1] == 0 )
+						continue;
+					std::uint32_t const n_duplicate = n_sweep + right_count[b + 1] - count;
+					if ( n_duplicate > max_duplicate )
+						continue;
+					Geometry::Scalar const cost = n_sweep * sweep.surface_area() + right_count[b + 1] * right_area[b + 1];
+					if ( cost < best.cost )
+					{
+						best.cost = cost;
+						best.axis = a;
+						best.bin = b;
+						best.f_valid = true;
+						best.n_duplicate = n_duplicate;
+					}
+				}
+			}
+			return best;
+		};
+
+		// Recursive build with spatial splits, the references of a node are split (and duplicated) between its children
+		// Leaves are appended to the primitives
+		void build_spatial(
+			std::uint32_t const index,
+			std::vector<Reference> references,
+			std::uint32_t const depth
+		)
+		{
+			Geometry::Bound bound;
+			Geometry::Bound centroid_bound;
+			for ( Reference const& value : references )
+			{
+				bound.grow( value.bound );
+				centroid_bound.grow( value.centroid );
+			}
+			node[index].bound = bound;
+			make_cone( node[index], references );
+			if ( depth == 0 )
+				root_area = bound.surface_area();
+
+			std::uint32_t const count = static_cast<std::uint32_t>( references.size() );
+			Split const object = object_split( references, bound, centroid_bound );
+
+			// Spatial splits only help if the children of the object split overlap
+			Split spatial;
+			if ( count > 1 && depth < max_spatial_depth && n_budget > 0 )
+			{
+				Geometry::Scalar const overlap = object.f_valid ? object.left.overlap( object.right ).surface_area() : bound.surface_area();
+				if ( overlap > spatial_alpha * root_area )
+					spatial = spatial_split( references, bound, n_budget );
+			}
+			bool const f_spatial = spatial.f_valid && ( !object.f_valid || spatial.cost < object.cost );
+			Split const& split = f_spatial ? spatial : object;
+
+			Geometry::Scalar const leaf_cost = static_cast<Geometry::Scalar>( count ) * bound.surface_area();
+			if ( ( count <= 1 ) || ( ( count <= max_leaf ) && ( !split.f_valid || ( split.cost + bound.surface_area() >= leaf_cost ) ) ) )
+			{
+				node[index].offset = static_cast<std::uint32_t>( primitive.size() );
+				node[index].count = count;
+				for ( Reference const& value : references )
+				{
+					primitive.emplace_back( value.object );
+					facing.emplace_back( value.facing );
+				}
+				return;
+			}
+
+			std::vector<Reference> left;
+			std::vector<Reference> right;
+			if ( f_spatial )
+			{
+				Geometry::Scalar const plane = spatial_plane( split.bin, split.axis, bound );
+				for ( Reference const& value : references )
+				{
+					if ( spatial_bin( value.bound.max[split.axis], split.axis, bound ) <= split.bin )
+						left.emplace_back( value );
+					else if ( spatial_bin( value.bound.min[split.axis], split.axis, bound ) > split.bin )
+						right.emplace_back( value );
+					else
+					{
+						// Straddles the plane, the parts may be empty if the object only overlaps the corner of its bounds
+						Geometry::Bound slab = value.bound;
+						slab.max[split.axis] = plane;
+						Geometry::Bound const left_bound = value.object->clip( slab );
+						slab = value.bound;
+						slab.min[split.axis] = plane;
+						Geometry::Bound const right_bound = value.object->clip( slab );
+						if ( !left_bound.empty() )
+							left.emplace_back( Reference{ left_bound, left_bound.centroid(), value.object, value.facing } );
+						if ( !right_bound.empty() )
+							right.emplace_back( Reference{ right_bound, right_bound.centroid(), value.object, value.facing } );
+						if ( left_bound.empty() && right_bound.empty() )
+							left.emplace_back( value );
+					}
+				}
+				std::uint32_t const n_duplicate = static_cast<std::uint32_t>( left.size() + right.size() ) - count;
+				n_budget -= std::min( n_budget, n_duplicate );
+			}
+			else if ( split.f_valid )
+			{
+				for ( Reference const& value : references )
+					( object_bin( value, split.axis, centroid_bound ) <= split.bin ? left : right ).emplace_back( value );
+			}
+
+			// Degenerate (e.g. equal centroids), split in the middle
+			if ( left.empty() || right.empty() )
+			{
+				left.assign( references.begin(), references.begin() + count / 2 );
+				right.assign( references.begin() + count / 2, references.end() );
+			}
+			std::vector<Reference>().swap( references );
+
+			std::uint32_t const child = n_node;
+			n_node += 2;
+			build_spatial( child, std::move( left ), depth + 1 );
+			build_spatial( child + 1, std::move( right ), depth + 1 );
+
+			node[index].axis = split.axis;
+			node[index].offset = child;
+			node[index].count = 0;
+		};
+
+	};
+
+};
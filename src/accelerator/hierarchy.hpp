@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../accelerator/bvh.hpp"
+#include "../geometry/polymorphic.hpp"
+
+namespace Accelerator
+{
+
+	// Scene hierarchy, owned by the scene
+	// If lazy, rendering starts on a lazily built BVH, while a full BVH is built on a background thread.
+	// The full BVH replaces the lazy one at the first update() after it is done.
+	// Spatial splits are only used by the full BVH.
+	class Hierarchy final
+	{
+
+	private:
+
+		std::unique_ptr<Accelerator::BVH> active;
+
+		// Background build
+		std::unique_ptr<Accelerator::BVH> refined;
+		std::thread worker;
+		std::atomic<bool> f_refined{ false };
+
+	public:
+
+		Hierarchy() = delete;
+		Hierarchy( Hierarchy const& ) = delete;
+		Hierarchy& operator = ( Hierarchy const& ) = delete;
+
+		Hierarchy(
+			std::vector< std::shared_ptr<Geometry::Polymorphic> > const& geometry,
+			std::vector<bool> const& one_sided,
+			bool const f_lazy,
+			std::float_t const spatial_budget = 0.f
+		)
+		{
+			active = std::make_unique<Accelerator::BVH>( geometry, one_sided, f_lazy, spatial_budget );
+			if ( f_lazy )
+				worker = std::thread( [this, geometry, one_sided, spatial_budget]()
+					{
+						refined = std::make_unique<Accelerator::BVH>( geometry, one_sided, false, spatial_budget );
+						f_refined.store( true, std::memory_order_release );
+					} );
+		};
+
+		~Hierarchy()
+		{
+			if ( worker.joinable() )
+				worker.join();
+		};
+
+		Accelerator::BVH const& get() const { return *active; };
+
+		// Swap in the full hierarchy, if the background build is done. Returns true if swapped.
+		// Not thread safe, only call while no rays are traced (e.g. between render passes)
+		bool update()
+		{
+			if ( !f_refined.load( std::memory_order_acquire ) )
+				return false;
+			worker.join();
+			active = std::move( refined );
+			f_refined.store( false, std::memory_order_relaxed );
+			return true;
+		};
+
+	};
+
+};
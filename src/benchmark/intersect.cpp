@@ -0,0 +1,214 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Ray/scene intersection throughput, for the triangle kernel selected at compile time
+// Build with and without -DTRIANGLE_TRANSFORM (see Makefile, target benchmark) to compare kernels
+// Each is measured for a hierarchy with object splits only, and with spatial splits
+// Interleaved traversal is measured on a scene of random triangles, larger than the cache
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../accelerator/bvh.hpp"
+#include "../geometry/polymorphic.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+#include "../ray/section.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/scene.hpp"
+
+// Rays per second for closest hit and occlusion queries, and a checksum to compare kernels
+void Measure(
+	std::string const& name,
+	Render::Scene const& scene,
+	std::vector<Ray::Section> const& rays
+)
+{
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	std::double_t checksum{ 0. };
+	std::uint32_t n_hit{ 0 };
+	for ( Ray::Section const& ray : rays )
+	{
+		Ray::Hit const hit = scene.intersect( ray );
+		if ( hit )
+		{
+			checksum += hit.distance;
+			++n_hit;
+		}
+	}
+	std::chrono::steady_clock::time_point stop_time = std::chrono::steady_clock::now();
+	std::double_t const intersect_time = std::chrono::duration<std::double_t>( stop_time - start_time ).count();
+
+	start_time = std::chrono::steady_clock::now();
+	std::uint32_t n_occluded{ 0 };
+	for ( Ray::Section const& ray : rays )
+		n_occluded += scene.occluded( ray, 1000. ) ? 1 : 0;
+	stop_time = std::chrono::steady_clock::now();
+	std::double_t const occluded_time = std::chrono::duration<std::double_t>( stop_time - start_time ).count();
+
+	std::cout << name << ": "
+		<< rays.size() / intersect_time * 1e-6 << " M rays/s intersect, "
+		<< rays.size() / occluded_time * 1e-6 << " M rays/s occluded, "
+		<< n_hit << " hits, " << n_occluded << " occluded, checksum " << checksum << std::endl;
+};
+
+// Shape of the hierarchy, and average work per closest hit query
+void Statistics(
+	std::string const& name,
+	Render::Scene const& scene,
+	std::vector<Ray::Section> const& camera_rays,
+	std::vector<Ray::Section> const& random_rays
+)
+{
+	Accelerator::BVH::Statistics const shape = scene.bvh().statistics();
+	std::cout << name << ": "
+		<< shape.n_node << " nodes, " << shape.n_leaf << " leaves, "
+		<< shape.n_reference << " references, overlap " << shape.overlap
+		<< ", SAH cost " << shape.sah_cost << std::endl;
+
+	for ( std::vector<Ray::Section> const* rays : { &camera_rays, &random_rays } )
+	{
+		std::uint64_t n_node{ 0 };
+		std::uint64_t n_test{ 0 };
+		for ( Ray::Section const& ray : *rays )
+		{
+			Accelerator::BVH::Traversal const count = scene.bvh().traversal( ray );
+			n_node += count.n_node;
+			n_test += count.n_test;
+		}
+		std::cout << "  " << ( rays == &camera_rays ? "Camera" : "Random" ) << " rays: "
+			<< static_cast<std::double_t>( n_node ) / rays->size() << " nodes/ray, "
+			<< static_cast<std::double_t>( n_test ) / rays->size() << " triangle tests/ray" << std::endl;
+	}
+};
+
+// Closest hit rays per second of a hierarchy, one query at a time and with interleaved queries
+void Interleaved(
+	Accelerator::BVH const& bvh,
+	std::vector<Ray::Section> const& rays
+)
+{
+	std::double_t reference{ 0. };
+	for ( std::uint32_t n_flight : { 1u, 8u, 16u, 32u } )
+	{
+		std::chrono::steady_clock::time_point const start_time = std::chrono::steady_clock::now();
+		std::double_t checksum{ 0. };
+		if ( n_flight == 1 )
+		{
+			for ( Ray::Section const& ray : rays )
+			{
+				auto const [distance, id] = bvh.intersect( ray );
+				if ( id != UINT32_MAX )
+					checksum += distance;
+			}
+			reference = checksum;
+		}
+		else
+			bvh.intersect_interleaved( rays,
+				[&checksum]( std::uint32_t const i, Geometry::Scalar const distance, std::uint32_t const id ) { if ( id != UINT32_MAX ) checksum += distance; },
+				n_flight );
+		std::chrono::steady_clock::time_point const stop_time = std::chrono::steady_clock::now();
+		std::double_t const time = std::chrono::duration<std::double_t>( stop_time - start_time ).count();
+		std::cout << "  " << n_flight << " in flight: " << rays.size() / time * 1e-6 << " M rays/s"
+			<< ( checksum == reference ? "" : ", checksum differs" ) << std::endl;
+	}
+};
+
+int main( int argc, char* argv[] )
+{
+	Render::Config const config = Render::Config{
+		.image_width = 400,
+		.image_height = 400,
+		.max_samples = 8,
+		.max_path_length = 5
+	}.validate();
+
+	// Same view as the renderer
+	Render::Camera const camera(
+		Double3( -278, -800, 273 ),
+		Double3( -278, 0, 273 ),
+		50.,
+		config
+	);
+
+	Render::Scene const scene;
+	Render::Scene const scene_spatial( false, 0.5f );
+
+#ifdef TRIANGLE_TRANSFORM
+	std::cout << "Kernel: Baldwin-Weber transform" << std::endl;
+#else
+	std::cout << "Kernel: Woop watertight" << std::endl;
+#endif
+	std::cout << "Triangle size: " << sizeof( Render::Scene::Triangle ) << " bytes, "
+		<< scene.geometry_count() << " triangles, "
+		<< sizeof( Render::Scene::Triangle ) * scene.geometry_count() << " bytes" << std::endl;
+
+	Random::Mersenne prng( 42 );
+
+	// Camera rays
+	std::vector<Ray::Section> camera_rays;
+	camera_rays.reserve( config.image_width * config.image_height * config.max_samples );
+	for ( std::uint16_t sample{ 0 }; sample < config.max_samples; ++sample )
+		for ( std::uint16_t y{ 0 }; y < config.image_height; ++y )
+			for ( std::uint16_t x{ 0 }; x < config.image_width; ++x )
+				camera_rays.emplace_back( camera.generate_ray( x, y, prng ) );
+
+	// Incoherent rays, from inside the box in uniform random directions
+	std::vector<Ray::Section> random_rays;
+	random_rays.reserve( camera_rays.size() );
+	while ( random_rays.size() < camera_rays.size() )
+	{
+		Double3 const origin( -556. * prng.get_float(), 559.2 * prng.get_float(), 548.8 * prng.get_float() );
+		Double3 const direction( prng.get_float() - .5f, prng.get_float() - .5f, prng.get_float() - .5f );
+		std::double_t const length = direction.magnitude();
+		if ( length > 0.5 || length < 0.01 )
+			continue;
+		random_rays.emplace_back( origin, direction / length );
+	}
+
+	Statistics( "Object splits", scene, camera_rays, random_rays );
+	Statistics( "Spatial splits", scene_spatial, camera_rays, random_rays );
+
+	Measure( "Camera rays, object splits", scene, camera_rays );
+	Measure( "Random rays, object splits", scene, random_rays );
+	Measure( "Camera rays, spatial splits", scene_spatial, camera_rays );
+	Measure( "Random rays, spatial splits", scene_spatial, random_rays );
+
+	// Random triangles in the box, the hierarchy and triangles are about 100 MB
+	{
+		std::uint32_t const n_triangle{ 500000 };
+		std::vector< std::shared_ptr<Geometry::Polymorphic> > geometry;
+		geometry.reserve( n_triangle );
+		for ( std::uint32_t i{ 0 }; i < n_triangle; ++i )
+		{
+			Double3 const a( -556. * prng.get_float(), 559.2 * prng.get_float(), 548.8 * prng.get_float() );
+			Double3 const b = a + Double3( prng.get_float() - .5f, prng.get_float() - .5f, prng.get_float() - .5f ) * 20.;
+			Double3 const c = a + Double3( prng.get_float() - .5f, prng.get_float() - .5f, prng.get_float() - .5f ) * 20.;
+			geometry.emplace_back( std::make_shared<Render::Scene::Triangle>( a, b, c, 0 ) );
+		}
+		Accelerator::BVH const bvh( geometry );
+		std::cout << "Random triangles, " << n_triangle << ", random rays:" << std::endl;
+		// A quarter of the rays, the traversals are long in this scene
+		std::vector<Ray::Section> const rays( random_rays.begin(), random_rays.begin() + random_rays.size() / 4 );
+		Interleaved( bvh, rays );
+	}
+
+	return EXIT_SUCCESS;
+};
@@ -0,0 +1,150 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+// Throughput of the math core, for the kernels the integrator spends its time in
+// Build with and without -DMATH_SIMD -mavx2 -mfma (see Makefile, target benchmark) to compare
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../bxdf/shading_correction.hpp"
+#include "../colour/colour.hpp"
+#include "../integrator/vertex.hpp"
+#include "../mathematics/double3.hpp"
+#include "../mathematics/orthogonal.hpp"
+#include "../random/mersenne.hpp"
+#include "../ray/intersection.hpp"
+
+// Number of elements per kernel, and passes over them
+constexpr std::uint32_t n_element{ 4096 };
+constexpr std::uint32_t n_pass{ 2000 };
+
+// Nano seconds per element, and the checksum to compare builds
+template<typename Kernel>
+void Measure(
+	std::string const& name,
+	Kernel const& kernel
+)
+{
+	std::chrono::steady_clock::time_point const start_time = std::chrono::steady_clock::now();
+	std::double_t checksum{ 0. };
+	for ( std::uint32_t pass{ 0 }; pass < n_pass; ++pass )
+		checksum += kernel();
+	std::chrono::steady_clock::time_point const stop_time = std::chrono::steady_clock::now();
+	std::double_t const time = std::chrono::duration<std::double_t>( stop_time - start_time ).count();
+
+	std::cout << name << ": "
+		<< time * 1e9 / ( static_cast<std::double_t>( n_element ) * n_pass ) << " ns/element, checksum "
+		<< checksum / n_pass << std::endl;
+};
+
+int main( int argc, char* argv[] )
+{
+#ifdef MATH_SIMD
+	std::cout << "Math core: SIMD" << std::endl;
+#else
+	std::cout << "Math core: scalar" << std::endl;
+#endif
+	std::cout << "Double3 size: " << sizeof( Double3 ) << " bytes, Colour size: " << sizeof( Colour ) << " bytes, "
+		<< "Vertex size: " << sizeof( Integrator::Vertex ) << " bytes" << std::endl;
+
+	Random::Mersenne prng( 42 );
+
+	// Points in the Cornell box, and unit normals
+	std::vector<Double3> point;
+	std::vector<Double3> normal;
+	std::vector<Colour> colour;
+	std::vector<Integrator::Vertex> vertex;
+	std::vector<Ray::Intersection> idata;
+	while ( point.size() < n_element )
+	{
+		Double3 const direction( prng.get_float() - .5f, prng.get_float() - .5f, prng.get_float() - .5f );
+		std::double_t const length = direction.magnitude();
+		if ( length > 0.5 || length < 0.01 )
+			continue;
+		point.emplace_back( -556. * prng.get_float(), 559.2 * prng.get_float(), 548.8 * prng.get_float() );
+		normal.emplace_back( direction / length );
+		colour.emplace_back( prng.get_float(), prng.get_float(), prng.get_float() );
+
+		Ray::Intersection value;
+		value.point = point.back();
+		value.orthogonal = Orthogonal( normal.back() );
+		value.normal_shading = normal.back();
+		value.normal_geometry = normal.back();
+		value.from_direction = Double3( -normal.back().y, normal.back().x, normal.back().z );
+		idata.emplace_back( value );
+		vertex.emplace_back( value, colour.back(), 1.f, 1.f, false, false );
+	}
+
+	// Connection direction between neighbouring points
+	Measure( "Normalise", [&]()
+		{
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+				sum += ( point[i] - point[( i + 1 ) % n_element] ).normalise().dot( normal[i] );
+			return sum;
+		} );
+
+	Measure( "Cross", [&]()
+		{
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+				sum += normal[i].cross( normal[( i + 1 ) % n_element] ).dot( normal[( i + 2 ) % n_element] );
+			return sum;
+		} );
+
+	// Material evaluations transform both directions into the shading frame, and samples back
+	Measure( "Orthogonal to_local and to_world", [&]()
+		{
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+			{
+				Orthogonal const& frame = idata[i].orthogonal;
+				sum += frame.to_world( frame.to_local( normal[( i + 1 ) % n_element] ) ).dot( normal[i] );
+			}
+			return sum;
+		} );
+
+	Measure( "Gprime", [&]()
+		{
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+				sum += Integrator::Gprime( vertex[i], vertex[( i + 1 ) % n_element] );
+			return sum;
+		} );
+
+	Measure( "ShadingCorrection", [&]()
+		{
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+				sum += BxDF::ShadingCorrection( normal[( i + 1 ) % n_element], idata[i].from_direction, idata[i], BxDF::TraceMode::Importance );
+			return sum;
+		} );
+
+	// Throughput update of a path, and accumulation into a pixel
+	Measure( "Colour throughput", [&]()
+		{
+			Colour accumulate;
+			for ( std::uint32_t i{ 0 }; i < n_element; ++i )
+				accumulate += colour[i] * colour[( i + 1 ) % n_element] * 0.5f;
+			return static_cast<std::double_t>( accumulate.r + accumulate.g + accumulate.b );
+		} );
+
+	return EXIT_SUCCESS;
+};
@@ -78,6 +78,16 @@ namespace BxDF
 			return id;
 		};
 
+		bool one_sided() const override
+		{
+			return true;
+		};
+
+		Colour albedo() const override
+		{
+			return Colour::White;
+		};
+
 	};
 
 };
@@ -22,7 +22,7 @@ namespace BxDF
 
 	private:
 
-		Colour const albedo;
+		Colour const reflectance;
 
 	public:
 
@@ -31,7 +31,7 @@ namespace BxDF
 		Lambert(
 			Colour const& albedo
 		)
-			: albedo( albedo )
+			: reflectance( albedo )
 		{};
 
 		std::tuple<Colour, Double3, BxDF::Event, std::float_t, std::float_t> sample(
@@ -45,7 +45,7 @@ namespace BxDF
 				return { Colour::Black, Double3::Zero, BxDF::Event::None, 0.f, 0.f };
 			Double3 const sample_direction = Sample::HemiSphere( prng ); // Local space
 			Double3 const evaluate_direction = idata.orthogonal.to_world( sample_direction );
-			return { albedo * inv_pi, evaluate_direction, BxDF::Event::Diffuse, sample_direction.z * inv_pi, sample_direction.z };
+			return { reflectance * inv_pi, evaluate_direction, BxDF::Event::Diffuse, sample_direction.z * inv_pi, sample_direction.z };
 		};
 
 		std::tuple<Colour, std::float_t, std::float_t> evaluate(
@@ -59,7 +59,7 @@ namespace BxDF
 			std::double_t const from_cos_theta = from_direction.dot( idata.orthogonal.normal() );
 			if ( ( cos_theta < EPSILON_COS_THETA ) || ( from_cos_theta < EPSILON_COS_THETA ) )
 				return std::tuple( Colour::Black, 0.f, 0.f );
-			return std::tuple( albedo * inv_pi, cos_theta * inv_pi, cos_theta );
+			return std::tuple( reflectance * inv_pi, cos_theta * inv_pi, cos_theta );
 		};
 
 		Colour factor(
@@ -73,7 +73,7 @@ namespace BxDF
 			std::double_t const from_cos_theta = from_direction.dot( idata.orthogonal.normal() );
 			if ( ( cos_theta < EPSILON_COS_THETA ) || ( from_cos_theta < EPSILON_COS_THETA ) )
 				return Colour::Black;
-			return albedo * inv_pi;
+			return reflectance * inv_pi;
 		};
 
 		std::float_t pdf(
@@ -94,6 +94,16 @@ namespace BxDF
 			return UINT32_MAX;
 		};
 
+		bool one_sided() const override
+		{
+			return true;
+		};
+
+		Colour albedo() const override
+		{
+			return reflectance;
+		};
+
 	};
 
 };
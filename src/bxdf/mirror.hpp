@@ -78,6 +78,16 @@ namespace BxDF
 			return UINT32_MAX;
 		};
 
+		bool one_sided() const override
+		{
+			return true;
+		};
+
+		Colour albedo() const override
+		{
+			return reflectance;
+		};
+
 	};
 
 };
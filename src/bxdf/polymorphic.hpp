@@ -69,6 +69,13 @@ namespace BxDF
 		// Used for emission materials
 		virtual std::uint32_t emitter_id() const = 0;
 
+		// True if the back side (from_direction dot normal below zero) never scatters or emits
+		// The scene hierarchy then skips back facing hits of objects with this material
+		virtual bool one_sided() const = 0;
+
+		// Share of the light reflected towards any direction, white for emitters, guides the denoiser
+		virtual Colour albedo() const = 0;
+
 	};
 
 };
@@ -0,0 +1,114 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Russian roulette of the weight window keeps a sub path with a probability that tracks its expected contribution
+// For ratios of expected to target contribution below the window, see Integrator::ADRRS::window, the share of
+// survivors must follow the ratio down to the floor of the survival probability, ADRRS::min_survival. Roulette and
+// splitting must keep the expected throughput, i.e. the continuations times their factor average to one (1).
+// Then the BDPT image is rendered without and with ADRRS, which roulettes and splits the sub paths, and connects the
+// branches of a split, see Integrator::BDPT::trace_splits. The means must agree. The camera looks down below the
+// light, as in check_light_samples, the pixels on the edge of the light would hide any difference in their noise.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../check/render.hpp"
+#include "../integrator/adrrs.hpp"
+#include "../integrator/bdpt.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/scene.hpp"
+#include "../render/sensor.hpp"
+
+int main( int argc, char* argv[] )
+{
+	Random::Mersenne prng( 1 );
+	std::uint32_t const n_trial{ 1000000 };
+	bool f_passed{ true };
+	for ( std::float_t const ratio : { 0.01f, 0.03f, 0.05f, 0.07f, 0.09f, 0.5f, 3.f } )
+	{
+		std::uint32_t n_survive{ 0 };
+		std::double_t throughput{ 0. };
+		for ( std::uint32_t i{ 0 }; i < n_trial; ++i )
+		{
+			auto const [n, factor] = Integrator::ADRRS::window( ratio, 1.f, Integrator::ADRRS::max_split, prng );
+			n_survive += n > 0 ? 1 : 0;
+			throughput += n * factor;
+		}
+		std::double_t const survive = static_cast<std::double_t>( n_survive ) / n_trial;
+		throughput /= n_trial;
+		std::cout << "Ratio " << ratio << ": " << survive << " survive, mean throughput " << throughput << std::endl;
+		// Roulette only below the window, survival is the ratio there, floored at min_survival
+		std::double_t const expected = ratio < 2.f / 21.f ? std::max<std::double_t>( Integrator::ADRRS::min_survival, ratio ) : 1.;
+		if ( std::abs( survive - expected ) > 5. * std::sqrt( expected * ( 1. - expected ) / n_trial ) + 1e-6 )
+		{
+			std::cout << "FAILED: survival does not track the ratio, expected " << expected << std::endl;
+			f_passed = false;
+		}
+		if ( std::abs( throughput - 1. ) > 5. * std::sqrt( ( 1. - expected ) / expected / n_trial ) + 1e-6 )
+		{
+			std::cout << "FAILED: the window changes the expected throughput" << std::endl;
+			f_passed = false;
+		}
+	}
+
+	Render::Config const config = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 256, .max_path_length = 5 }.validate();
+	Render::Config const config_adrrs = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 256, .max_path_length = 5,
+		.adrrs_samples = 4 }.validate();
+	Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 50 ), 50., config );
+	Render::Scene const scene( false, 0.f );
+
+	// Prepass, into a sensor of its own and with a seed of its own, as in main.cpp
+	Integrator::ADRRS adrrs( scene.bound(), config.image_width, config.image_height );
+	Render::Config prepass_config( config_adrrs );
+	prepass_config.max_samples = config_adrrs.adrrs_samples;
+	Render::Sensor prepass_sensor( prepass_config );
+	Render::Context const prepass_context{ prepass_config, camera, scene };
+	{
+		Integrator::BDPT prepass( prepass_context, prepass_sensor, nullptr, &adrrs );
+		for ( std::uint16_t y{ 0 }; y < config.image_height; y += Integrator::BDPT::tile_size )
+			for ( std::uint16_t x{ 0 }; x < config.image_width; x += Integrator::BDPT::tile_size )
+				prepass.process_tile( x, y,
+					std::min<int>( Integrator::BDPT::tile_size, config.image_width - x ),
+					std::min<int>( Integrator::BDPT::tile_size, config.image_height - y ),
+					0, 1 );
+	}
+	adrrs.build( prepass_sensor );
+
+	std::vector<std::double_t> const reference = Check::render<Integrator::BDPT>( Render::Context{ config, camera, scene }, Integrator::BDPT::tile_size );
+	std::vector<std::double_t> const image = Check::render<Integrator::BDPT>( Render::Context{ config_adrrs, camera, scene }, Integrator::BDPT::tile_size,
+		nullptr, &adrrs );
+	Check::Comparison const result = Check::compare( reference, image );
+	std::cout << "Mean " << result.mean_a << " BDPT, " << result.mean_b << " with ADRRS, difference "
+		<< result.difference << " +- " << result.standard_error << std::endl;
+	if ( !result.agree() )
+	{
+		std::cout << "FAILED: roulette and splitting change the brightness" << std::endl;
+		f_passed = false;
+	}
+
+	if ( !f_passed )
+		return EXIT_FAILURE;
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+};
@@ -0,0 +1,65 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// The emitter samples of the next event estimation change the noise, not the brightness
+// The BDPT image is rendered with two (2) and four (4) light samples, and compared with the image of one (1). The
+// multi-sample MIS weights only sum to one (1) if they count the samples of each strategy, see Integrator::BDPT.
+// The camera looks down, below the light. The pixels on the edge of the light, half emitter and half ceiling, hold
+// almost all the noise of the full view, and they do not depend on the light samples.
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../check/render.hpp"
+#include "../integrator/bdpt.hpp"
+#include "../mathematics/double3.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/scene.hpp"
+
+int main( int argc, char* argv[] )
+{
+	Render::Scene const scene( false, 0.f );
+	std::vector<std::double_t> reference;
+	bool f_passed{ true };
+	for ( std::uint8_t const light_samples : { 1, 2, 4 } )
+	{
+		Render::Config const config = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 256, .max_path_length = 5,
+			.light_samples = light_samples }.validate();
+		Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 50 ), 50., config );
+		std::vector<std::double_t> const image = Check::render<Integrator::BDPT>( Render::Context{ config, camera, scene }, Integrator::BDPT::tile_size );
+		if ( reference.empty() )
+		{
+			reference = image;
+			continue;
+		}
+		Check::Comparison const result = Check::compare( reference, image );
+		std::cout << "Mean " << result.mean_a << " with 1, " << result.mean_b << " with " << static_cast<int>( light_samples )
+			<< " light samples, difference " << result.difference << " +- " << result.standard_error << std::endl;
+		if ( !result.agree() )
+		{
+			std::cout << "FAILED: the light samples change the brightness" << std::endl;
+			f_passed = false;
+		}
+	}
+	if ( !f_passed )
+		return EXIT_FAILURE;
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+};
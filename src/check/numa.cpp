@@ -0,0 +1,93 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Setup of the per NUMA node copies of the scene, see Render::Topology
+// Threads are placed on a two node machine of four cores each. Fewer threads than cores must reach both nodes when
+// spread. The emission guide is learned on one copy of the scene and copied to another, the copy must render the same
+// image as the learned one, in a fraction of the time it takes to learn.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../check/render.hpp"
+#include "../integrator/bdpt.hpp"
+#include "../mathematics/double3.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/scene.hpp"
+#include "../render/topology.hpp"
+
+int main( int argc, char* argv[] )
+{
+	bool f_passed{ true };
+
+	Render::Topology const topology( { { 0, 1, 2, 3 }, { 4, 5, 6, 7 } } );
+	std::uint32_t const n_thread{ 4 };
+	for ( Render::Topology::Placement const placement : { Render::Topology::Placement::Compact, Render::Topology::Placement::Spread } )
+	{
+		std::vector<std::uint32_t> node_threads( topology.node_count(), 0 );
+		std::cout << ( placement == Render::Topology::Placement::Spread ? "Spread:" : "Compact:" );
+		for ( std::uint32_t thread{ 0 }; thread < n_thread; ++thread )
+		{
+			++node_threads[topology.thread_node( thread, placement )];
+			std::cout << " " << thread << "->core " << topology.thread_cpu( thread, placement ) << "/node " << topology.thread_node( thread, placement );
+		}
+		std::cout << std::endl;
+		if ( placement == Render::Topology::Placement::Spread && ( node_threads[0] != 2 || node_threads[1] != 2 ) )
+		{
+			std::cout << "FAILED: spread placement leaves a node unused" << std::endl;
+			f_passed = false;
+		}
+	}
+
+	Render::Config const config = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 4, .max_path_length = 5,
+		.emission_guide_paths = 200000 }.validate();
+	Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 273 ), 50., config );
+	Render::Scene scene_learned( false, 0.f );
+	Render::Scene scene_copied( false, 0.f );
+	std::chrono::steady_clock::time_point const learn_start = std::chrono::steady_clock::now();
+	scene_learned.learn_emission( camera, config );
+	std::chrono::steady_clock::duration const learn_time = std::chrono::steady_clock::now() - learn_start;
+	std::chrono::steady_clock::time_point const copy_start = std::chrono::steady_clock::now();
+	scene_copied.copy_emission( scene_learned );
+	std::chrono::steady_clock::duration const copy_time = std::chrono::steady_clock::now() - copy_start;
+	std::cout << "Emission guide learned in " << std::chrono::duration_cast<std::chrono::microseconds>( learn_time ).count()
+		<< " micro seconds, copied in " << std::chrono::duration_cast<std::chrono::microseconds>( copy_time ).count() << " micro seconds" << std::endl;
+
+	std::vector<std::double_t> const learned = Check::render<Integrator::BDPT>( Render::Context{ config, camera, scene_learned }, Integrator::BDPT::tile_size );
+	std::vector<std::double_t> const copied = Check::render<Integrator::BDPT>( Render::Context{ config, camera, scene_copied }, Integrator::BDPT::tile_size );
+	Check::Comparison const result = Check::compare( learned, copied );
+	std::cout << "Mean " << result.mean_a << " learned, " << result.mean_b << " copied, " << 100. * result.share_differ << "% of pixels differ" << std::endl;
+	if ( result.share_differ > 0. )
+	{
+		std::cout << "FAILED: the copied emission guide renders another image" << std::endl;
+		f_passed = false;
+	}
+	if ( copy_time * 10 > learn_time )
+	{
+		std::cout << "FAILED: copying the emission guide is not faster than learning it" << std::endl;
+		f_passed = false;
+	}
+
+	if ( !f_passed )
+		return EXIT_FAILURE;
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+};
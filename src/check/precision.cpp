@@ -0,0 +1,80 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Single and double precision geometry render the same image
+// Built twice (see Makefile, target check), the single precision build writes its image to the file of the first
+// argument, and the double precision build (-DGEOMETRY_DOUBLE) compares its own image with it.
+// Both use the same random sequences, so they differ only where a path takes another turn due to rounding.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "../check/render.hpp"
+#include "../integrator/bdpt.hpp"
+#include "../mathematics/double3.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/scene.hpp"
+
+int main( int argc, char* argv[] )
+{
+	if ( argc < 2 )
+	{
+		std::cout << "Usage: " << argv[0] << " <image file>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Render::Config const config = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 16, .max_path_length = 5 }.validate();
+	Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 273 ), 50., config );
+	Render::Scene const scene;
+	Render::Context const context{ config, camera, scene };
+	std::vector<std::double_t> const image = Check::render<Integrator::BDPT>( context, Integrator::BDPT::tile_size );
+
+#ifndef GEOMETRY_DOUBLE
+	std::ofstream file( argv[1], std::ios::binary );
+	file.write( reinterpret_cast<char const*>( image.data() ), image.size() * sizeof( std::double_t ) );
+	if ( !file )
+	{
+		std::cout << "Could not write " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Single precision image written, mean " << Check::compare( image, image ).mean_a << std::endl;
+	return EXIT_SUCCESS;
+#else
+	std::vector<std::double_t> reference( image.size() );
+	std::ifstream file( argv[1], std::ios::binary );
+	file.read( reinterpret_cast<char*>( reference.data() ), reference.size() * sizeof( std::double_t ) );
+	if ( !file )
+	{
+		std::cout << "Could not read the single precision image " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	Check::Comparison const result = Check::compare( reference, image );
+	std::cout << "Mean " << result.mean_a << " single, " << result.mean_b << " double precision, difference "
+		<< result.difference << " +- " << result.standard_error << ", " << 100. * result.share_differ << "% of pixels differ" << std::endl;
+	if ( !result.agree() )
+	{
+		std::cout << "FAILED: single and double precision images differ" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+#endif
+};
@@ -0,0 +1,104 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Rays leaving a surface, offset by its error (see Geometry::surface_error), do not hit it again, and shadow rays
+// between two points that see each other are not occluded
+// Points are first hits of camera rays, each leaves in a cosine weighted direction, or a grazing one with a cosine
+// of 0.1 down to 0.0001. The point it hits is seen from the point it left, so the shadow ray between them must be
+// unoccluded. Only in that direction, as the back faces of one sided objects are skipped, e.g. a ray grazing the
+// ceiling passes through the back of the light below it. As back faces are skipped, the triangles at both ends are
+// also tested on their own, both sides.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "../geometry/polymorphic.hpp"
+#include "../mathematics/constant.hpp"
+#include "../mathematics/double3.hpp"
+#include "../mathematics/orthogonal.hpp"
+#include "../random/mersenne.hpp"
+#include "../ray/hit.hpp"
+#include "../ray/intersection.hpp"
+#include "../ray/query.hpp"
+#include "../ray/section.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/scene.hpp"
+
+int main( int argc, char* argv[] )
+{
+	Render::Config const config = Render::Config{ .image_width = 400, .image_height = 400 }.validate();
+	Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 273 ), 50., config );
+	Render::Scene const scene;
+	Random::Mersenne prng( 1 );
+
+	std::uint32_t constexpr n_ray{ 1000000 };
+	std::uint32_t n_pair{ 0 };
+	std::uint32_t n_self{ 0 };
+	std::uint32_t n_occluded{ 0 };
+	std::double_t max_error{ 0. };
+	for ( std::uint32_t i{ 0 }; i < n_ray; ++i )
+	{
+		Ray::Section const primary = camera.generate_ray(
+			static_cast<std::uint16_t>( prng.get_integer() % config.image_width ),
+			static_cast<std::uint16_t>( prng.get_integer() % config.image_height ), prng );
+		Ray::Hit const hit_a = scene.intersect( primary );
+		if ( !hit_a )
+			continue;
+		Ray::Intersection const a = scene.shade( primary, hit_a );
+		Geometry::Polymorphic const& triangle_a = *scene.bvh().object( hit_a.id );
+		max_error = std::max( max_error, a.error );
+
+		// Half of the directions are grazing
+		std::double_t const cos_theta = ( i % 2 == 0 )
+			? std::sqrt( prng.get_float() )
+			: std::pow( 10., -1. - 3. * prng.get_float() );
+		std::double_t const sin_theta = std::sqrt( std::max( 0., 1. - cos_theta * cos_theta ) );
+		std::double_t const phi = two_pi * prng.get_float();
+		Double3 const direction = Orthogonal( a.normal_geometry ).to_world( Double3( sin_theta * std::cos( phi ), sin_theta * std::sin( phi ), cos_theta ) );
+
+		Ray::Section const leave( a.point, direction, a.normal_geometry, a.error );
+		if ( triangle_a.intersect( Ray::Query( leave ) ) > 0 )
+			++n_self;
+		Ray::Hit const hit_b = scene.intersect( leave );
+		if ( !hit_b )
+			continue;
+		++n_pair;
+		Ray::Intersection const b = scene.shade( leave, hit_b );
+		Geometry::Polymorphic const& triangle_b = *scene.bvh().object( hit_b.id );
+
+		auto const [shadow_ray, distance] = Ray::connect( a.point, a.normal_geometry, a.error, b.point, b.normal_geometry, b.error );
+		Ray::Query const shadow_query( shadow_ray );
+		if ( triangle_a.intersect( shadow_query ) > 0 )
+			++n_self;
+		Geometry::Scalar const distance_b = triangle_b.intersect( shadow_query );
+		if ( scene.occluded( shadow_ray, distance ) || ( ( distance_b > 0 ) && ( distance_b < distance ) ) )
+			++n_occluded;
+	}
+
+	std::cout << n_pair << " point pairs, largest surface error " << max_error << ", " << n_self << " self intersections, "
+		<< n_occluded << " occluded shadow rays" << std::endl;
+	if ( ( n_self > 0 ) || ( n_occluded > 0 ) )
+	{
+		std::cout << "FAILED: rays hit the surface they leave, or are occluded by the surface they connect to" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+};
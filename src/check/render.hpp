@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../colour/colour.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/sensor.hpp"
+
+// Helpers of the check programs, see Makefile, target check
+namespace Check
+{
+
+	// Image of an integrator of type Technique, as the mean of the red, green and blue channel of each pixel
+	// All passes of the config are rendered, the integrator is constructed from the context, its sensor, and argument
+	template<typename Technique, typename... Argument>
+	std::vector<std::double_t> render(
+		Render::Context const& context,
+		std::uint16_t const tile_size,
+		Argument... argument
+	)
+	{
+		Render::Config const& config = context.config;
+		int const n_tile_x = ( config.image_width + tile_size - 1 ) / tile_size;
+		int const n_tile_y = ( config.image_height + tile_size - 1 ) / tile_size;
+		Render::Sensor sensor( config );
+#pragma omp parallel
+		{
+			Technique integrator( context, sensor, argument... );
+			for ( std::uint16_t pass{ 0 }; pass < config.passes; ++pass )
+			{
+#pragma omp for schedule( dynamic )
+				for ( int tile = 0; tile < n_tile_x * n_tile_y; ++tile )
+				{
+					int const x = ( tile % n_tile_x ) * tile_size;
+					int const y = ( tile / n_tile_x ) * tile_size;
+					integrator.process_tile( x, y,
+						std::min<int>( tile_size, config.image_width - x ),
+						std::min<int>( tile_size, config.image_height - y ),
+						pass );
+				}
+			}
+		}
+
+		std::vector<std::double_t> image( static_cast<std::size_t>( config.image_width ) * config.image_height );
+		for ( std::uint16_t y{ 0 }; y < config.image_height; ++y )
+			for ( std::uint16_t x{ 0 }; x < config.image_width; ++x )
+			{
+				Colour const colour = sensor.get_colour( x, y );
+				image[x + y * static_cast<std::size_t>( config.image_width )] = ( colour.r + colour.g + colour.b ) / 3.;
+			}
+		return image;
+	};
+
+	// Difference of the means of two images of the same size, and its standard error, estimated from the pixel
+	// differences. Images of independent or of shared random sequences can be compared.
+	struct Comparison
+	{
+		std::double_t mean_a{ 0. };
+		std::double_t mean_b{ 0. };
+		std::double_t difference{ 0. }; // mean_b - mean_a
+		std::double_t standard_error{ 0. };
+		std::double_t share_differ{ 0. }; // Share of pixels that are not equal
+
+		// Means agree within z standard errors, and a relative tolerance for the bias of sample counts that are finite
+		bool agree(
+			std::double_t const z = 4.,
+			std::double_t const relative = 0.
+		) const
+		{
+			return std::abs( difference ) <= z * standard_error + relative * std::abs( mean_a );
+		};
+	};
+
+	inline Comparison compare(
+		std::vector<std::double_t> const& a,
+		std::vector<std::double_t> const& b
+	)
+	{
+		Comparison result;
+		std::size_t const n = std::min( a.size(), b.size() );
+		if ( n < 2 )
+			return result;
+		std::double_t sum2{ 0. };
+		std::size_t n_differ{ 0 };
+		for ( std::size_t i{ 0 }; i < n; ++i )
+		{
+			result.mean_a += a[i];
+			result.mean_b += b[i];
+			std::double_t const delta = b[i] - a[i];
+			result.difference += delta;
+			sum2 += delta * delta;
+			if ( a[i] != b[i] )
+				++n_differ;
+		}
+		result.mean_a /= n;
+		result.mean_b /= n;
+		result.difference /= n;
+		std::double_t const variance = std::max( 0., ( sum2 / n - result.difference * result.difference ) * n / ( n - 1 ) );
+		result.standard_error = std::sqrt( variance / n );
+		result.share_differ = static_cast<std::double_t>( n_differ ) / n;
+		return result;
+	};
+
+};
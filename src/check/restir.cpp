@@ -0,0 +1,54 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
+
+// Reservoir resampling of the first camera path vertex (ReSTIR) changes the noise, not the brightness
+// The BDPT image is rendered with the next event estimation, and with reservoirs that reuse their alike neighbours,
+// see Integrator::BDPT::resample_tile. The means must agree.
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../check/render.hpp"
+#include "../integrator/bdpt.hpp"
+#include "../mathematics/double3.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/scene.hpp"
+
+int main( int argc, char* argv[] )
+{
+	Render::Config const config = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 64, .max_path_length = 5 }.validate();
+	Render::Config const config_restir = Render::Config{ .image_width = 100, .image_height = 100, .max_samples = 64, .max_path_length = 5,
+		.restir_candidates = 8 }.validate();
+	Render::Camera const camera( Double3( -278, -800, 273 ), Double3( -278, 0, 273 ), 50., config );
+	Render::Scene const scene( false, 0.f );
+	std::vector<std::double_t> const reference = Check::render<Integrator::BDPT>( Render::Context{ config, camera, scene }, Integrator::BDPT::tile_size );
+	std::vector<std::double_t> const restir = Check::render<Integrator::BDPT>( Render::Context{ config_restir, camera, scene }, Integrator::BDPT::tile_size );
+
+	Check::Comparison const result = Check::compare( reference, restir );
+	std::cout << "Mean " << result.mean_a << " next event estimation, " << result.mean_b << " ReSTIR, difference "
+		<< result.difference << " +- " << result.standard_error << std::endl;
+	if ( !result.agree() )
+	{
+		std::cout << "FAILED: reservoir resampling changes the brightness" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Passed" << std::endl;
+	return EXIT_SUCCESS;
+};
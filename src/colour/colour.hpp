@@ -5,17 +5,40 @@
 #include <sstream>
 
 #include "../epsilon.hpp"
+#include "../mathematics/simd.hpp"
 
-struct Colour
+// With MATH_SIMD, stored as four aligned floats, see mathematics/simd.hpp
+struct alignas( SIMD::colour_alignment ) Colour
 {
 	std::float_t r{ 0.f };
 	std::float_t g{ 0.f };
 	std::float_t b{ 0.f };
+#ifdef MATH_SIMD
+private:
+	std::float_t padding{ 0.f };
+public:
+
+	explicit Colour( __m128 const value ) { _mm_store_ps( &r, value ); };
+
+	__m128 load() const { return _mm_load_ps( &r ); };
+#endif
 
 	Colour() {};
 
 	Colour( std::float_t const r, std::float_t const g, std::float_t const b ) : r( r ), g( g ), b( b ) {};
 
+#ifdef MATH_SIMD
+	Colour operator + ( Colour const& value ) const { return Colour( _mm_add_ps( load(), value.load() ) ); };
+
+	Colour operator * ( Colour const& value ) const { return Colour( _mm_mul_ps( load(), value.load() ) ); };
+	Colour operator * ( std::float_t const value ) const { return Colour( _mm_mul_ps( load(), _mm_set1_ps( value ) ) ); };
+
+	// The padding lane is divided by one, so it stays zero for a zero divisor
+	Colour operator / ( std::float_t const value ) const { return Colour( _mm_div_ps( load(), _mm_set_ps( 1.f, value, value, value ) ) ); };
+
+	Colour& operator += ( Colour const& value ) { _mm_store_ps( &r, _mm_add_ps( load(), value.load() ) ); return *this; };
+	Colour& operator *= ( Colour const& value ) { _mm_store_ps( &r, _mm_mul_ps( load(), value.load() ) ); return *this; };
+#else
 	Colour operator + ( Colour const& value ) const { return Colour( r + value.r, g + value.g, b + value.b ); };
 
 	Colour operator * ( Colour const& value ) const { return Colour( r * value.r, g * value.g, b * value.b ); };
@@ -23,9 +46,9 @@ struct Colour
 
 	Colour operator / ( std::float_t const value ) const { return Colour( r / value, g / value, b / value ); };
 
-	Colour operator = ( Colour const& value ) { r = value.r; g = value.g; b = value.b; return *this; };
-	Colour operator += ( Colour const& value ) { r += value.r; g += value.g, b += value.b; return *this; };
-	Colour operator *= ( Colour const& value ) { r *= value.r; g *= value.g, b *= value.b; return *this; };
+	Colour& operator += ( Colour const& value ) { r += value.r; g += value.g; b += value.b; return *this; };
+	Colour& operator *= ( Colour const& value ) { r *= value.r; g *= value.g; b *= value.b; return *this; };
+#endif
 
 	// Find largest component, and check that against black
 	bool is_black() const { return std::max({ r, g, b }) < EPSILON_BLACK; };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdint>
+
+#include "../coroutine/task.hpp"
+
+namespace Coroutine
+{
+
+	// Most coroutines in flight, more do not hide more latency than the memory system can have outstanding
+	constexpr std::uint32_t max_flight = 32;
+
+	// Run n_task tasks, created by make( i ), with up to n_flight in flight, resumed round robin
+	// Each task runs until its next suspension (e.g. a Coroutine::Prefetch), then the next one is resumed
+	template<typename Make>
+	void Interleave(
+		std::uint32_t const n_task,
+		std::uint32_t const n_flight,
+		Make const& make
+	)
+	{
+		std::coroutine_handle<> slot[max_flight];
+		std::uint32_t const n_slot = std::clamp<std::uint32_t>( n_flight, 1, max_flight );
+		std::uint32_t n_active{ 0 };
+		std::uint32_t next{ 0 };
+		for ( ; n_active < n_slot && next < n_task; ++n_active )
+			slot[n_active] = make( next++ ).release();
+
+		while ( n_active > 0 )
+		{
+			for ( std::uint32_t s{ 0 }; s < n_active; )
+			{
+				slot[s].resume();
+				if ( !slot[s].done() )
+				{
+					++s;
+					continue;
+				}
+				slot[s].destroy();
+				// Refill the slot, or close the gap with the last active one
+				if ( next < n_task )
+					slot[s] = make( next++ ).release();
+				else
+					slot[s] = slot[--n_active];
+			}
+		}
+	};
+
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace Coroutine
+{
+
+	// Recycles coroutine frames of one thread, a scene query would otherwise allocate a frame per ray
+	class FramePool final
+	{
+
+	private:
+
+		// Large enough for a hierarchy traversal, with its stack
+		static constexpr std::size_t block_size = 1024;
+
+		struct Block
+		{
+			Block* next;
+		};
+
+		Block* free{ nullptr };
+
+		FramePool() {};
+
+		~FramePool()
+		{
+			while ( free )
+			{
+				Block* const block = free;
+				free = block->next;
+				::operator delete( block );
+			}
+		};
+
+		static FramePool& local()
+		{
+			thread_local FramePool pool;
+			return pool;
+		};
+
+	public:
+
+		static void* allocate(
+			std::size_t const size
+		)
+		{
+			if ( size > block_size )
+				return ::operator new( size );
+			FramePool& pool = local();
+			if ( !pool.free )
+				return ::operator new( block_size );
+			Block* const block = pool.free;
+			pool.free = block->next;
+			return block;
+		};
+
+		static void release(
+			void* const pointer,
+			std::size_t const size
+		)
+		{
+			if ( size > block_size )
+			{
+				::operator delete( pointer );
+				return;
+			}
+			FramePool& pool = local();
+			pool.free = new ( pointer ) Block{ pool.free };
+		};
+
+	};
+
+	// Resumable work without a return value, results are written through references given to the coroutine
+	// Starts suspended, and is resumed by a scheduler until done, see Coroutine::Interleave
+	class Task final
+	{
+
+	public:
+
+		struct promise_type
+		{
+			Task get_return_object() { return Task( std::coroutine_handle<promise_type>::from_promise( *this ) ); };
+
+			std::suspend_always initial_suspend() noexcept { return {}; };
+			// Kept suspended when done, so the scheduler can test and destroy it
+			std::suspend_always final_suspend() noexcept { return {}; };
+
+			void return_void() {};
+
+			void unhandled_exception() { std::terminate(); };
+
+			static void* operator new( std::size_t const size ) { return FramePool::allocate( size ); };
+			static void operator delete( void* const pointer, std::size_t const size ) { FramePool::release( pointer, size ); };
+		};
+
+	private:
+
+		std::coroutine_handle<promise_type> handle{ nullptr };
+
+		explicit Task( std::coroutine_handle<promise_type> const handle ) : handle( handle ) {};
+
+	public:
+
+		Task( Task const& ) = delete;
+		Task& operator = ( Task const& ) = delete;
+
+		Task( Task&& value ) noexcept : handle( std::exchange( value.handle, nullptr ) ) {};
+
+		~Task()
+		{
+			if ( handle )
+				handle.destroy();
+		};
+
+		// Hand the coroutine over to a scheduler, which then destroys it
+		std::coroutine_handle<> release() { return std::exchange( handle, nullptr ); };
+
+	};
+
+	// Request a cache line, and let the other coroutines run while it is loaded
+	// Interleaving with Coroutines, Psaropoulos et al., 2017
+	struct Prefetch
+	{
+		void const* address;
+
+		bool await_ready() const noexcept
+		{
+			__builtin_prefetch( address );
+			return false;
+		};
+
+		void await_suspend( std::coroutine_handle<> ) const noexcept {};
+
+		void await_resume() const noexcept {};
+	};
+
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "../mathematics/constant.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+
+namespace Emitter
+{
+
+	// Learned direction distribution of an emitter, to steer light sub paths towards what the camera sees
+	// A histogram over the unit square of cosine weighted hemisphere sampling ( see Sample::HemiSphere ),
+	// so the learned density is a factor on cos_theta / pi, and cosine sampling until it is built.
+	// Importance Driven Construction of Photon Maps, Peter and Pietrek, 1998
+	class Guide final
+	{
+
+	private:
+
+		// Bins along phi, and along cos_theta^2
+		static constexpr std::uint32_t n_phi{ 16 };
+		static constexpr std::uint32_t n_z{ 8 };
+		static constexpr std::uint32_t n_bin{ n_phi * n_z };
+
+		// Fraction of cosine sampling kept, so no direction has zero probability
+		static constexpr std::float_t defensive{ 0.2f };
+
+		// Importance recorded per bin, while learning
+		std::vector<std::float_t> importance;
+		// Density relative to cosine sampling, and the cumulative distribution over bins
+		std::vector<std::float_t> density;
+		std::vector<std::float_t> cdf;
+
+		static std::uint32_t bin(
+			Double3 const& local_direction
+		)
+		{
+			std::double_t phi = std::atan2( local_direction.y, local_direction.x ) * inv_2pi;
+			if ( phi < 0. )
+				phi += 1.;
+			std::uint32_t const i_phi = std::min( n_phi - 1, static_cast<std::uint32_t>( phi * n_phi ) );
+			std::uint32_t const i_z = std::min( n_z - 1, static_cast<std::uint32_t>( local_direction.z * local_direction.z * n_z ) );
+			return i_z * n_phi + i_phi;
+		};
+
+	public:
+
+		Guide() : importance( n_bin, 0.f ) {};
+
+		// True once built from recorded importance
+		bool is_valid() const { return !cdf.empty(); };
+
+		// Importance arriving along a direction leaving the emitter, in its local space ( z is the normal )
+		void record(
+			Double3 const& local_direction,
+			std::float_t const value
+		)
+		{
+			if ( local_direction.z <= 0. || !( value > 0.f ) )
+				return;
+			importance[bin( local_direction )] += value;
+		};
+
+		// Build the distribution from the recorded importance, without any it stays cosine sampling
+		void build()
+		{
+			std::double_t total{ 0. };
+			for ( std::float_t const value : importance )
+				total += value;
+			if ( !( total > 0. ) )
+				return;
+
+			density.resize( n_bin );
+			cdf.resize( n_bin );
+			std::double_t sum{ 0. };
+			for ( std::uint32_t i{ 0 }; i < n_bin; ++i )
+			{
+				density[i] = static_cast<std::float_t>( ( 1. - defensive ) * importance[i] * n_bin / total + defensive );
+				sum += density[i];
+				cdf[i] = static_cast<std::float_t>( sum );
+			}
+			for ( std::float_t& value : cdf )
+				value /= static_cast<std::float_t>( sum );
+			cdf.back() = 1.f;
+		};
+
+		// Returns a direction in local space, and its pdf_W
+		std::tuple<Double3, std::float_t> sample(
+			Random::Mersenne& prng
+		) const
+		{
+			std::float_t u_phi = prng.get_float();
+			std::float_t u_z = prng.get_float();
+			std::float_t pdf_factor{ 1.f };
+			if ( is_valid() )
+			{
+				std::uint32_t const i = static_cast<std::uint32_t>( std::upper_bound( cdf.begin(), cdf.end(), prng.get_float() ) - cdf.begin() );
+				std::uint32_t const selected = std::min( n_bin - 1, i );
+				u_phi = ( static_cast<std::float_t>( selected % n_phi ) + u_phi ) / n_phi;
+				u_z = ( static_cast<std::float_t>( selected / n_phi ) + u_z ) / n_z;
+				pdf_factor = density[selected];
+			}
+			// Sample::HemiSphere, from the two numbers
+			std::float_t const theta = two_pi * u_phi;
+			std::float_t const radius = std::sqrt( 1.f - u_z );
+			std::float_t const cos_theta = std::sqrt( u_z );
+			return { Double3( std::cos( theta ) * radius, std::sin( theta ) * radius, cos_theta ), pdf_factor * cos_theta * inv_pi };
+		};
+
+		// pdf_W of a direction in local space
+		std::float_t pdf(
+			Double3 const& local_direction
+		) const
+		{
+			if ( local_direction.z <= 0. )
+				return 0.f;
+			std::float_t const pdf_cosine = static_cast<std::float_t>( local_direction.z ) * inv_pi;
+			return is_valid() ? density[bin( local_direction )] * pdf_cosine : pdf_cosine;
+		};
+
+	};
+
+};
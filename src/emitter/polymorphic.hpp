@@ -3,6 +3,7 @@
 #include <tuple>
 
 #include "../colour/colour.hpp"
+#include "../emitter/guide.hpp"
 #include "../mathematics/double3.hpp"
 #include "../random/mersenne.hpp"
 
@@ -55,11 +56,32 @@ namespace Emitter
 			Double3 const& eval_direction // Direction is away from emitter/eval point
 		) const = 0;
 
+		// Learned emission, see Emitter::Guide
+		// Record importance arriving along a direction away from the emitter, then build the distribution from it
+		// Only called before rendering, emitters are read only while rays are traced
+		virtual void record(
+			Double3 const& eval_direction, // Direction is away from emitter
+			std::float_t const importance
+		) = 0;
+
+		virtual void build_guide() = 0;
+
+		// The learned distribution, so a copy of the scene can take it instead of learning it again
+		virtual Emitter::Guide const& get_guide() const = 0;
+
+		virtual void set_guide(
+			Emitter::Guide const& value
+		) = 0;
+
 		virtual Emitter::Type type() const = 0;
 
 		// True for emitters than can not be intersected (point/directional)
 		virtual bool is_dirac() const = 0;
 
+		// Distance along the emitter normal, within which the geometry of the emitter lies, see Geometry::surface_error
+		// Zero (0) for emitters that can not be intersected
+		virtual std::double_t surface_error() const = 0;
+
 	};
 
 };
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <tuple>
 
 #include "../emitter/polymorphic.hpp"
 
 #include "../colour/colour.hpp"
+#include "../emitter/guide.hpp"
+#include "../geometry/precision.hpp"
 #include "../mathematics/double3.hpp"
 #include "../mathematics/orthogonal.hpp"
 #include "../random/mersenne.hpp"
-#include "../sample/hemisphere.hpp"
 #include "../sample/triangle.hpp"
 
 namespace Emitter
@@ -31,6 +34,12 @@ namespace Emitter
 
 		std::float_t pdf_area;
 
+		// Distance along the normal, within which the triangle lies in geometry precision
+		std::double_t error;
+
+		// Direction distribution, cosine weighted until learned
+		Emitter::Guide guide;
+
 	public:
 
 		Triangle() = delete;
@@ -47,6 +56,10 @@ namespace Emitter
 			normal = ( cross_product ).normalise();
 			local_space = Orthogonal( normal );
 			pdf_area = 1. / ( .5 * ( cross_product ).magnitude() );
+			std::double_t extent{ 0. };
+			for ( std::uint8_t axis{ 0 }; axis < 3; ++axis )
+				extent = std::max( { extent, std::abs( a[axis] ), std::abs( b[axis] ), std::abs( c[axis] ) } );
+			error = Geometry::surface_error( extent, normal );
 		};
 
 		std::tuple <Colour, Double3, Double3, Double3, std::float_t, std::float_t, std::float_t> emit(
@@ -55,9 +68,9 @@ namespace Emitter
 		{
 			auto const [u, v] = Sample::Triangle( prng );
 			Double3 const point = position + edge1 * u + edge2 * v;
-			Double3 const local_sample = Sample::HemiSphere( prng );
+			auto const [local_sample, pdf_W] = guide.sample( prng );
 			Double3 const direction = local_space.to_world( local_sample );
-			return { energy, point, direction, normal, local_sample.z * inv_pi, pdf_area, local_sample.z };
+			return { energy, point, direction, normal, pdf_W, pdf_area, local_sample.z };
 		};
 
 		Colour radiance(
@@ -77,7 +90,7 @@ namespace Emitter
 			std::float_t const cos_theta = normal.dot( eval_direction );
 			if ( cos_theta < EPSILON_COS_THETA )
 				return { 0.f, 0.f, 0.f };
-			return { inv_2pi, pdf_area, cos_theta };
+			return { guide.pdf( local_space.to_local( eval_direction ) ), pdf_area, cos_theta };
 		};
 
 		std::float_t pdf_W(
@@ -87,7 +100,7 @@ namespace Emitter
 			std::float_t const cos_theta = normal.dot( eval_direction );
 			if ( cos_theta < EPSILON_COS_THETA )
 				return 0.f;
-			return cos_theta * inv_pi;
+			return guide.pdf( local_space.to_local( eval_direction ) );
 		};
 
 		std::float_t pdf_A(
@@ -97,10 +110,34 @@ namespace Emitter
 			return pdf_area;
 		};
 
+		void record(
+			Double3 const& eval_direction,
+			std::float_t const importance
+		) override
+		{
+			guide.record( local_space.to_local( eval_direction ), importance );
+		};
+
+		void build_guide() override
+		{
+			guide.build();
+		};
+
+		Emitter::Guide const& get_guide() const override { return guide; };
+
+		void set_guide(
+			Emitter::Guide const& value
+		) override
+		{
+			guide = value;
+		};
+
 		Emitter::Type type() const override { return Emitter::Type::Area; };
 
 		bool is_dirac() const override { return false; };
 
+		std::double_t surface_error() const override { return error; };
+
 	};
 
 };
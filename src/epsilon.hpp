@@ -1,10 +1,10 @@
 #pragma once
 
-// Small offset to ray, to avoid self intersection of geometry
-#define EPSILON_RAY 0.00001
+// Rays leaving a surface are not offset by a constant, but by the rounding error of the surface in geometry
+// precision, see Geometry::surface_error and Ray::connect
 
-// Smallest occlusion distance to evaluate, due to numeric precision
-// Should be at least twice as big as EPSILON_RAY
+// Smallest distance between two points to evaluate, due to numeric precision
+// Between two surface points it is raised to the sum of their surface errors, see Ray::min_distance
 #define EPSILON_DISTANCE 0.00005
 
 // Smallest "valid" cos theta, due to numeric precision
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "../geometry/precision.hpp"
+
+namespace Geometry
+{
+
+	// Axis aligned bounding box, in geometry precision
+	struct Bound
+	{
+
+		// An empty box, growing it with any point makes it valid
+		Geometry::Vector min{ std::numeric_limits<Geometry::Scalar>::max(), std::numeric_limits<Geometry::Scalar>::max(), std::numeric_limits<Geometry::Scalar>::max() };
+		Geometry::Vector max{ std::numeric_limits<Geometry::Scalar>::lowest(), std::numeric_limits<Geometry::Scalar>::lowest(), std::numeric_limits<Geometry::Scalar>::lowest() };
+
+		Bound() {};
+
+		Bound( Geometry::Vector const& min, Geometry::Vector const& max ) : min( min ), max( max ) {};
+
+		void grow( Geometry::Vector const& point )
+		{
+			min = Geometry::Vector( std::min( min.x, point.x ), std::min( min.y, point.y ), std::min( min.z, point.z ) );
+			max = Geometry::Vector( std::max( max.x, point.x ), std::max( max.y, point.y ), std::max( max.z, point.z ) );
+		};
+
+		// Growing with an empty box does nothing
+		void grow( Bound const& value )
+		{
+			if ( value.empty() )
+				return;
+			grow( value.min );
+			grow( value.max );
+		};
+
+		// Common part of two boxes, may be empty
+		Bound overlap( Bound const& value ) const
+		{
+			return Bound(
+				Geometry::Vector( std::max( min.x, value.min.x ), std::max( min.y, value.min.y ), std::max( min.z, value.min.z ) ),
+				Geometry::Vector( std::min( max.x, value.max.x ), std::min( max.y, value.max.y ), std::min( max.z, value.max.z ) )
+			);
+		};
+
+		bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; };
+
+		Geometry::Vector centroid() const { return ( min + max ) * Geometry::Scalar( 0.5 ); };
+
+		Geometry::Vector extent() const { return max - min; };
+
+		// Returns zero for an empty box
+		Geometry::Scalar surface_area() const
+		{
+			if ( empty() )
+				return 0;
+			Geometry::Vector const e = extent();
+			return 2 * ( e.x * e.y + e.y * e.z + e.z * e.x );
+		};
+
+	};
+
+};
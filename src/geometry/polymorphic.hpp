@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstdint>
+
+#include "../geometry/bound.hpp"
+#include "../geometry/precision.hpp"
 #include "../ray/intersection.hpp"
+#include "../ray/query.hpp"
 #include "../ray/section.hpp"
 
 namespace Geometry
@@ -12,8 +17,8 @@ namespace Geometry
 	public:
 
 		// Returns positive distance, if object is intersected by ray
-		virtual std::double_t intersect(
-			Ray::Section const& ray
+		virtual Geometry::Scalar intersect(
+			Ray::Query const& ray
 		) const = 0;
 
 		// Fill in intersection data (should only be used on final object)
@@ -22,6 +27,27 @@ namespace Geometry
 			std::double_t const distance
 		) const = 0;
 
+		// Axis aligned bounds, used to build the scene hierarchy
+		virtual Geometry::Bound bound() const = 0;
+
+		virtual std::uint32_t material() const = 0;
+
+		// Unit normal of the front side, for back face culling of one sided materials
+		// Zero (0) if the object has no single front side, e.g. is not planar
+		virtual Geometry::Vector facing() const
+		{
+			return Geometry::Vector( 0, 0, 0 );
+		};
+
+		// Bounds of the part of the object inside box, used for spatial splits of the scene hierarchy
+		// May be empty. The default is conservative, objects that can be clipped should override it.
+		virtual Geometry::Bound clip(
+			Geometry::Bound const& box
+		) const
+		{
+			return bound().overlap( box );
+		};
+
 	};
 
 };
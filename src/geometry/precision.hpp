@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+#include "../mathematics/double3.hpp"
+#include "../mathematics/float3.hpp"
+
+// Geometry and hierarchy traversal use single precision by default
+// Compile with -DGEOMETRY_DOUBLE to use double precision
+namespace Geometry
+{
+
+#ifdef GEOMETRY_DOUBLE
+	using Scalar = std::double_t;
+	using Vector = Double3;
+#else
+	using Scalar = std::float_t;
+	using Vector = Float3;
+#endif
+
+	// Bound on relative rounding error of n floating point operations, pbrt 3.9.1
+	constexpr Scalar gamma( int const n )
+	{
+		return ( n * std::numeric_limits<Scalar>::epsilon() * Scalar( 0.5 ) ) / ( 1 - n * std::numeric_limits<Scalar>::epsilon() * Scalar( 0.5 ) );
+	};
+
+	// Scale for the far distance of a ray/box test, so rounding can never miss a box the ray does hit
+	// Robust BVH Ray Traversal, Ize, 2013
+	constexpr Scalar robust_scale = 1 + 2 * gamma( 3 );
+
+	// Distance along a unit normal, within which a surface lies in geometry precision, around a point on it
+	// extent is the largest magnitude of a coordinate of the corners of the surface. The corners, the point (as a path
+	// vertex), and the origin of a ray leaving it (as a ray query) are each rounded to geometry precision, and a
+	// rounding moves a coordinate by at most gamma( 1 ) of extent. The point itself is projected on the plane of the
+	// rounded corners in double precision, see Geometry::Triangle::post_intersect, which adds a few double epsilons.
+	// pbrt 6.8.6
+	// Shadow rays also stop short of their far surface by it, see Ray::connect, check_ray_offset measures that it
+	// covers the rounding of the hit distance there.
+	inline std::double_t surface_error(
+		std::double_t const extent,
+		Double3 const& normal
+	)
+	{
+		return ( gamma( 4 ) * ( std::abs( normal.x ) + std::abs( normal.y ) + std::abs( normal.z ) )
+			+ 8. * std::numeric_limits<std::double_t>::epsilon() ) * extent;
+	};
+
+};
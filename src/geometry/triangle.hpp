@@ -1,13 +1,19 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <limits>
 
 #include "../geometry/polymorphic.hpp"
 
 #include "../epsilon.hpp"
+#include "../geometry/bound.hpp"
+#include "../geometry/precision.hpp"
 #include "../mathematics/double3.hpp"
 #include "../mathematics/orthogonal.hpp"
 #include "../ray/intersection.hpp"
+#include "../ray/query.hpp"
 #include "../ray/section.hpp"
 
 namespace Geometry
@@ -18,12 +24,13 @@ namespace Geometry
 
 	private:
 
-		Double3 position; // a
-		Double3 edge1; // b-a
-		Double3 edge2; // c-a
-		Double3 normal; // edge1 cross edge2
+		// Corners a, b, c in geometry precision
+		Geometry::Vector vertex[3];
 
-		Orthogonal orthogonal;
+		Double3 normal; // edge1 cross edge2, of the corners in geometry precision
+
+		// Distance along the normal, within which the triangle lies, see Geometry::surface_error
+		std::double_t error;
 
 		std::uint32_t material_id;
 
@@ -37,48 +44,79 @@ namespace Geometry
 			Double3 const& c,
 			std::uint32_t const material_id
 		) :
-			position( a ), edge1( b - a ), edge2( c - a ), material_id( material_id )
+			vertex{ Geometry::Vector( a ), Geometry::Vector( b ), Geometry::Vector( c ) }, material_id( material_id )
 		{
-			normal = ( edge1.cross( edge2 ) ).normalise();
-			orthogonal = Orthogonal( normal );
+			Double3 const corner[3] = { Double3( vertex[0] ), Double3( vertex[1] ), Double3( vertex[2] ) };
+			normal = ( ( corner[1] - corner[0] ).cross( corner[2] - corner[0] ) ).normalise();
+			std::double_t extent{ 0. };
+			for ( std::uint8_t axis{ 0 }; axis < 3; ++axis )
+				extent = std::max( { extent, std::abs( corner[0][axis] ), std::abs( corner[1][axis] ), std::abs( corner[2][axis] ) } );
+			error = Geometry::surface_error( extent, normal );
 		};
 
-		std::double_t intersect(
-			Ray::Section const& ray
+		Geometry::Scalar intersect(
+			Ray::Query const& ray
 		) const override
 		{
-			// M�ller-Trumbore intersection algorithm
-			// Fast, minimum storage ray/triangle intersection, 1997
+			// Watertight Ray/Triangle Intersection, Woop et al., 2013
+			// Edge tests are done in a sheared ray space, so a ray can not pass between two triangles sharing an edge.
+			// No epsilon is needed for parallel rays, they give a zero determinant.
 
 			// The return of different negative numbers is simply for debuging
 
-			// Calculating determinant
-			Double3 const p = ray.direction.cross( edge2 );
-			std::double_t const d = edge1.dot( p );
-
-			// If determinant is near zero, ray lies in plane of triangle
-			if ( std::abs( d ) < 0.000001 ) // TODO
-				return -1.0;
-
-			std::double_t const inv_d = 1.0 / d;
-
-			Double3 const diff = ray.origin - position;
-
-			// Calculate u parameter and test bound
-			std::double_t const u = diff.dot( p ) * inv_d;
-			if ( ( u < 0. ) || ( u > 1. ) )
-				return -2.0;
-
-			// Calculate v parameter and test bound
-			Double3 const q = diff.cross( edge1 );
-			std::double_t const v = ray.direction.dot( q ) * inv_d;
-			if ( ( v < 0. ) || ( u + v > 1. ) )
-				return -3.0;
-
-			std::double_t const t = q.dot( edge2 ) * inv_d;
-
-			if ( t < 0.000001 ) // TODO
-				return -4.0;
+			// Vertices relative to ray origin
+			Geometry::Vector const a = vertex[0] - ray.origin;
+			Geometry::Vector const b = vertex[1] - ray.origin;
+			Geometry::Vector const c = vertex[2] - ray.origin;
+
+			// Shear and scale vertices
+			Geometry::Scalar const ax = a[ray.kx] - ray.sx * a[ray.kz];
+			Geometry::Scalar const ay = a[ray.ky] - ray.sy * a[ray.kz];
+			Geometry::Scalar const bx = b[ray.kx] - ray.sx * b[ray.kz];
+			Geometry::Scalar const by = b[ray.ky] - ray.sy * b[ray.kz];
+			Geometry::Scalar const cx = c[ray.kx] - ray.sx * c[ray.kz];
+			Geometry::Scalar const cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+			// Scaled barycentric coordinates
+			Geometry::Scalar u = cx * by - cy * bx;
+			Geometry::Scalar v = ax * cy - ay * cx;
+			Geometry::Scalar w = bx * ay - by * ax;
+
+			// Fall back to double precision, if the ray passes exactly through an edge
+			if ( u == 0 || v == 0 || w == 0 )
+			{
+				u = static_cast<Geometry::Scalar>( static_cast<std::double_t>( cx ) * by - static_cast<std::double_t>( cy ) * bx );
+				v = static_cast<Geometry::Scalar>( static_cast<std::double_t>( ax ) * cy - static_cast<std::double_t>( ay ) * cx );
+				w = static_cast<Geometry::Scalar>( static_cast<std::double_t>( bx ) * ay - static_cast<std::double_t>( by ) * ax );
+			}
+
+			// Edge tests, both windings are accepted
+			if ( ( u < 0 || v < 0 || w < 0 ) && ( u > 0 || v > 0 || w > 0 ) )
+				return -2;
+
+			// Ray lies in plane of triangle
+			Geometry::Scalar const d = u + v + w;
+			if ( d == 0 )
+				return -1;
+
+			// Scaled hit distance
+			Geometry::Scalar const az = ray.sz * a[ray.kz];
+			Geometry::Scalar const bz = ray.sz * b[ray.kz];
+			Geometry::Scalar const cz = ray.sz * c[ray.kz];
+			Geometry::Scalar const t = ( u * az + v * bz + w * cz ) / d;
+
+			// Conservative bound on the rounding of t, so a ray leaving the triangle can not hit it again, pbrt 6.8.4
+			Geometry::Scalar const max_z = std::max( { std::abs( az ), std::abs( bz ), std::abs( cz ) } );
+			Geometry::Scalar const max_x = std::max( { std::abs( ax ), std::abs( bx ), std::abs( cx ) } );
+			Geometry::Scalar const max_y = std::max( { std::abs( ay ), std::abs( by ), std::abs( cy ) } );
+			Geometry::Scalar const max_e = std::max( { std::abs( u ), std::abs( v ), std::abs( w ) } );
+			Geometry::Scalar const delta_x = Geometry::gamma( 5 ) * ( max_x + max_z );
+			Geometry::Scalar const delta_y = Geometry::gamma( 5 ) * ( max_y + max_z );
+			Geometry::Scalar const delta_z = Geometry::gamma( 3 ) * max_z;
+			Geometry::Scalar const delta_e = 2 * ( Geometry::gamma( 2 ) * max_x * max_y + delta_y * max_x + delta_x * max_y );
+			Geometry::Scalar const delta_t = 3 * ( Geometry::gamma( 3 ) * max_e * max_z + delta_e * max_z + delta_z * max_e ) / std::abs( d );
+			if ( t <= delta_t )
+				return -4;
 
 			return t;
 		};
@@ -89,8 +127,12 @@ namespace Geometry
 		) const override
 		{
 			Ray::Intersection idata;
-			idata.point = ray.origin + ray.direction * distance;
-			idata.orthogonal = orthogonal;
+			// Projected on the plane of the corners, as the distance carries the rounding of the geometry precision test
+			Double3 const point = ray.origin + ray.direction * distance;
+			idata.point = point - normal * normal.dot( point - Double3( vertex[0] ) );
+			idata.error = error;
+			// The shading frame is built here, only for hits that are shaded
+			idata.orthogonal = Orthogonal( normal );
 			idata.material_id = material_id;
 			idata.from_direction = -ray.direction;
 			idata.normal_shading = normal;
@@ -99,6 +141,83 @@ namespace Geometry
 			return idata;
 		};
 
+		std::uint32_t material() const override
+		{
+			return material_id;
+		};
+
+		Geometry::Vector facing() const override
+		{
+			return Geometry::Vector( normal );
+		};
+
+		Geometry::Bound bound() const override
+		{
+			Geometry::Bound box;
+			box.grow( vertex[0] );
+			box.grow( vertex[1] );
+			box.grow( vertex[2] );
+			return box;
+		};
+
+		Geometry::Bound clip(
+			Geometry::Bound const& box
+		) const override
+		{
+			// Sutherland-Hodgman, clip the triangle against each plane of the box, in double precision
+			// Reentrant Polygon Clipping, Sutherland and Hodgman, 1974
+			Double3 polygon[9] = { Double3( vertex[0] ), Double3( vertex[1] ), Double3( vertex[2] ) };
+			std::uint8_t n_polygon{ 3 };
+			for ( std::uint8_t plane{ 0 }; plane < 6; ++plane )
+			{
+				std::uint8_t const axis = plane % 3;
+				bool const f_max = plane >= 3;
+				std::double_t const position = f_max ? box.max[axis] : box.min[axis];
+
+				Double3 clipped[9];
+				std::uint8_t n_clipped{ 0 };
+				for ( std::uint8_t i{ 0 }; i < n_polygon; ++i )
+				{
+					Double3 const& current = polygon[i];
+					Double3 const& next = polygon[( i + 1 ) % n_polygon];
+					bool const f_current = f_max ? current[axis] <= position : current[axis] >= position;
+					bool const f_next = f_max ? next[axis] <= position : next[axis] >= position;
+					if ( f_current )
+						clipped[n_clipped++] = current;
+					if ( f_current != f_next )
+					{
+						Double3 point = current + ( next - current ) * ( ( position - current[axis] ) / ( next[axis] - current[axis] ) );
+						point[axis] = position;
+						clipped[n_clipped++] = point;
+					}
+				}
+
+				if ( n_clipped == 0 )
+					return Geometry::Bound();
+				for ( std::uint8_t i{ 0 }; i < n_clipped; ++i )
+					polygon[i] = clipped[i];
+				n_polygon = n_clipped;
+			}
+
+			// Round outwards to geometry precision, so the bounds contain the clipped triangle
+			Geometry::Bound result;
+			for ( std::uint8_t i{ 0 }; i < n_polygon; ++i )
+			{
+				Geometry::Vector low( polygon[i] );
+				Geometry::Vector high( polygon[i] );
+				for ( std::uint8_t a{ 0 }; a < 3; ++a )
+				{
+					if ( low[a] > polygon[i][a] )
+						low[a] = std::nextafter( low[a], std::numeric_limits<Geometry::Scalar>::lowest() );
+					if ( high[a] < polygon[i][a] )
+						high[a] = std::nextafter( high[a], std::numeric_limits<Geometry::Scalar>::max() );
+				}
+				result.grow( low );
+				result.grow( high );
+			}
+			return result.overlap( box );
+		};
+
 	};
 
 };
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "../geometry/polymorphic.hpp"
+
+#include "../epsilon.hpp"
+#include "../geometry/bound.hpp"
+#include "../geometry/precision.hpp"
+#include "../mathematics/double3.hpp"
+#include "../mathematics/orthogonal.hpp"
+#include "../ray/intersection.hpp"
+#include "../ray/query.hpp"
+#include "../ray/section.hpp"
+
+namespace Geometry
+{
+
+	// Triangle stored as an affine transform, from world space to a space where it is the unit triangle
+	// ( 0, 0 ), ( 1, 0 ), ( 0, 1 ) in the z=0 plane. The intersection is then a few dot products.
+	// Fast Ray-Triangle Intersections by Coordinate Transformation, Baldwin and Weber, 2016
+	// Note: unlike Geometry::Triangle, the test is not watertight
+	class TriangleTransform final : public Geometry::Polymorphic
+	{
+
+	private:
+
+		// Rows of a 3x4 matrix, x and y are barycentric coordinates of b and c, z is the scaled plane distance
+		// Row k of the transform is ( transform[4k], transform[4k+1], transform[4k+2] ), offset transform[4k+3]
+		Geometry::Scalar transform[12];
+
+		// Bounds are kept, as the corners can not be recovered exactly from the transform
+		Geometry::Bound box;
+
+		Double3 normal; // edge1 cross edge2
+		Double3 corner; // a in geometry precision
+
+		// Distance along the normal, within which the triangle lies, see Geometry::surface_error
+		std::double_t error;
+
+		std::uint32_t material_id;
+
+	public:
+
+		TriangleTransform() = delete;
+
+		TriangleTransform(
+			Double3 const& a,
+			Double3 const& b,
+			Double3 const& c,
+			std::uint32_t const material_id
+		) :
+			material_id( material_id )
+		{
+			Double3 const edge1 = b - a;
+			Double3 const edge2 = c - a;
+			Double3 const cross_product = edge1.cross( edge2 );
+			normal = cross_product.normalise();
+
+			box.grow( Geometry::Vector( a ) );
+			box.grow( Geometry::Vector( b ) );
+			box.grow( Geometry::Vector( c ) );
+
+			corner = Double3( Geometry::Vector( a ) );
+			std::double_t extent{ 0. };
+			for ( std::uint8_t axis{ 0 }; axis < 3; ++axis )
+				extent = std::max( { extent, std::abs( static_cast<std::double_t>( box.min[axis] ) ), std::abs( static_cast<std::double_t>( box.max[axis] ) ) } );
+			// Twice the bound of the corners, the test uses the rounded plane row of the transform instead
+			error = 2. * Geometry::surface_error( extent, normal );
+
+			// Project along the dominant normal axis k, and solve the barycentric coordinates in the ( i, j ) plane.
+			// The 2D determinant is then the k component of the normal, so rows one and two are zero along k.
+			std::uint8_t const k = ( std::abs( cross_product.x ) > std::abs( cross_product.y ) )
+				? ( std::abs( cross_product.x ) > std::abs( cross_product.z ) ? 0 : 2 )
+				: ( std::abs( cross_product.y ) > std::abs( cross_product.z ) ? 1 : 2 );
+			std::uint8_t const i = ( k + 1 ) % 3;
+			std::uint8_t const j = ( k + 2 ) % 3;
+			std::double_t const inv_n = 1. / cross_product[k];
+
+			std::double_t row[12] = {};
+			// Barycentric coordinate of b
+			row[i] = edge2[j] * inv_n;
+			row[j] = -edge2[i] * inv_n;
+			row[3] = ( a[j] * edge2[i] - a[i] * edge2[j] ) * inv_n;
+			// Barycentric coordinate of c
+			row[4 + i] = -edge1[j] * inv_n;
+			row[4 + j] = edge1[i] * inv_n;
+			row[7] = ( a[i] * edge1[j] - a[j] * edge1[i] ) * inv_n;
+			// Plane distance, scaled by the dominant normal component
+			row[8 + i] = cross_product[i] * inv_n;
+			row[8 + j] = cross_product[j] * inv_n;
+			row[8 + k] = 1.;
+			row[11] = -a.dot( cross_product ) * inv_n;
+
+			for ( std::uint8_t n{ 0 }; n < 12; ++n )
+				transform[n] = static_cast<Geometry::Scalar>( row[n] );
+		};
+
+		Geometry::Scalar intersect(
+			Ray::Query const& ray
+		) const override
+		{
+			// The return of different negative numbers is simply for debuging
+
+			// Ray origin and direction along the transformed z axis
+			Geometry::Scalar const t_origin = transform[8] * ray.origin.x + transform[9] * ray.origin.y + transform[10] * ray.origin.z + transform[11];
+			Geometry::Scalar const t_direction = transform[8] * ray.direction.x + transform[9] * ray.direction.y + transform[10] * ray.direction.z;
+
+			// Ray lies in plane of triangle
+			if ( t_direction == 0 )
+				return -1;
+
+			Geometry::Scalar const t = -t_origin / t_direction;
+			// Conservative bound on the rounding of t, so a ray leaving the triangle can not hit it again
+			Geometry::Scalar const delta_t = Geometry::gamma( 5 ) * ( std::abs( transform[8] * ray.origin.x ) + std::abs( transform[9] * ray.origin.y )
+				+ std::abs( transform[10] * ray.origin.z ) + std::abs( transform[11] ) ) / std::abs( t_direction );
+			if ( !( t > delta_t ) )
+				return -4;
+
+			Geometry::Vector const point = ray.origin + ray.direction * t;
+
+			Geometry::Scalar const u = transform[0] * point.x + transform[1] * point.y + transform[2] * point.z + transform[3];
+			if ( ( u < 0 ) || ( u > 1 ) )
+				return -2;
+
+			Geometry::Scalar const v = transform[4] * point.x + transform[5] * point.y + transform[6] * point.z + transform[7];
+			if ( ( v < 0 ) || ( u + v > 1 ) )
+				return -3;
+
+			return t;
+		};
+
+		Ray::Intersection post_intersect(
+			Ray::Section const& ray,
+			std::double_t const distance
+		) const override
+		{
+			Ray::Intersection idata;
+			// Projected on the plane of the triangle, as the distance carries the rounding of the geometry precision test
+			Double3 const point = ray.origin + ray.direction * distance;
+			idata.point = point - normal * normal.dot( point - corner );
+			idata.error = error;
+			// The shading frame is built here, only for hits that are shaded
+			idata.orthogonal = Orthogonal( normal );
+			idata.material_id = material_id;
+			idata.from_direction = -ray.direction;
+			idata.normal_shading = normal;
+			idata.normal_geometry = normal;
+
+			return idata;
+		};
+
+		std::uint32_t material() const override
+		{
+			return material_id;
+		};
+
+		Geometry::Vector facing() const override
+		{
+			return Geometry::Vector( normal );
+		};
+
+		Geometry::Bound bound() const override
+		{
+			return box;
+		};
+
+	};
+
+};
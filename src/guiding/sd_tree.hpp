@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "../geometry/bound.hpp"
+#include "../mathematics/constant.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+
+namespace Guiding
+{
+
+	// 1 / ( 4 * pi ), uniform pdf_W over the sphere
+	constexpr std::float_t inv_4pi = inv_pi * 0.25f;
+
+	// Directional quadtree, over the square of cylindrical coordinates ( cos_theta, phi ) of the sphere
+	// The mapping keeps area, so the density of a leaf is its share of the energy over its share of the square
+	class DTree final
+	{
+
+	private:
+
+		// Energy of the four quadrants, and their child node, zero (0) for a leaf
+		struct Node
+		{
+			std::array<std::float_t, 4> sum{ 0.f, 0.f, 0.f, 0.f };
+			std::array<std::uint32_t, 4> child{ 0, 0, 0, 0 };
+		};
+
+		// Energy share a quadrant needs to be split, and the deepest level
+		static constexpr std::float_t split_fraction{ 0.01f };
+		static constexpr std::uint8_t max_depth{ 20 };
+
+		// The root is node zero (0), children are always stored after their parent
+		std::vector<Node> node;
+
+		// Energy of the whole tree, set by build()
+		std::float_t total{ 0.f };
+
+		static std::tuple<std::float_t, std::float_t> to_square(
+			Double3 const& direction
+		)
+		{
+			std::float_t const u = static_cast<std::float_t>( std::clamp( ( direction.z + 1. ) * 0.5, 0., 1. ) );
+			std::float_t v = static_cast<std::float_t>( std::atan2( direction.y, direction.x ) ) * inv_2pi;
+			if ( v < 0.f )
+				v += 1.f;
+			return { u, std::clamp( v, 0.f, 1.f ) };
+		};
+
+		static Double3 from_square(
+			std::float_t const u,
+			std::float_t const v
+		)
+		{
+			std::float_t const cos_theta = 2.f * u - 1.f;
+			std::float_t const sin_theta = std::sqrt( std::max( 0.f, 1.f - cos_theta * cos_theta ) );
+			std::float_t const phi = two_pi * v;
+			return Double3( std::cos( phi ) * sin_theta, std::sin( phi ) * sin_theta, cos_theta );
+		};
+
+		// Quadrant of a point in the unit square, and the point moved into the unit square of that quadrant
+		static std::uint8_t quadrant(
+			std::float_t& u,
+			std::float_t& v
+		)
+		{
+			std::uint8_t q{ 0 };
+			u *= 2.f;
+			v *= 2.f;
+			if ( u >= 1.f )
+			{
+				q |= 1;
+				u -= 1.f;
+			}
+			if ( v >= 1.f )
+			{
+				q |= 2;
+				v -= 1.f;
+			}
+			return q;
+		};
+
+	public:
+
+		DTree() : node( 1 ) {};
+
+		bool has_energy() const { return total > 0.f; };
+
+		// Add energy arriving along a direction, may be called by several threads at once
+		void record(
+			Double3 const& direction,
+			std::float_t const value
+		)
+		{
+			if ( !( value > 0.f ) || !std::isfinite( value ) )
+				return;
+			auto [u, v] = to_square( direction );
+			std::uint32_t index{ 0 };
+			while ( true )
+			{
+				std::uint8_t const q = quadrant( u, v );
+				if ( node[index].child[q] == 0 )
+				{
+					std::atomic_ref<std::float_t>( node[index].sum[q] ).fetch_add( value, std::memory_order_relaxed );
+					return;
+				}
+				index = node[index].child[q];
+			}
+		};
+
+		// Sum the recorded energy of the leaves up to the root
+		void build()
+		{
+			for ( std::size_t i = node.size(); i-- > 0; )
+				for ( std::uint8_t q{ 0 }; q < 4; ++q )
+					if ( node[i].child[q] != 0 )
+					{
+						Node const& child = node[node[i].child[q]];
+						node[i].sum[q] = child.sum[0] + child.sum[1] + child.sum[2] + child.sum[3];
+					}
+			total = node[0].sum[0] + node[0].sum[1] + node[0].sum[2] + node[0].sum[3];
+		};
+
+		// Tree to record the next pass in, without energy. Quadrants with more than a small share of the
+		// energy are split, the others are merged. A tree without energy keeps its structure.
+		DTree refined() const
+		{
+			if ( !has_energy() )
+			{
+				DTree result( *this );
+				result.clear();
+				return result;
+			}
+
+			struct Entry
+			{
+				// Node of this tree, UINT32_MAX below one of its leaves
+				std::uint32_t old_index;
+				// Energy of the node, used below leaves
+				std::float_t energy;
+				std::uint32_t new_index;
+				std::uint8_t depth;
+			};
+
+			DTree result;
+			std::vector<Entry> stack{ Entry{ 0, total, 0, 1 } };
+			while ( !stack.empty() )
+			{
+				Entry const entry = stack.back();
+				stack.pop_back();
+				for ( std::uint8_t q{ 0 }; q < 4; ++q )
+				{
+					std::float_t const energy = ( entry.old_index != UINT32_MAX )
+						? node[entry.old_index].sum[q]
+						: entry.energy * 0.25f;
+					if ( entry.depth >= max_depth || energy <= total * split_fraction )
+						continue;
+					std::uint32_t const child = static_cast<std::uint32_t>( result.node.size() );
+					result.node[entry.new_index].child[q] = child;
+					result.node.emplace_back();
+					std::uint32_t const old_child = ( entry.old_index != UINT32_MAX && node[entry.old_index].child[q] != 0 )
+						? node[entry.old_index].child[q]
+						: UINT32_MAX;
+					stack.emplace_back( Entry{ old_child, energy, child, static_cast<std::uint8_t>( entry.depth + 1 ) } );
+				}
+			}
+			return result;
+		};
+
+		// Remove all energy, keep the structure
+		void clear()
+		{
+			for ( Node& value : node )
+				value.sum = { 0.f, 0.f, 0.f, 0.f };
+			total = 0.f;
+		};
+
+		// Direction in proportion to the energy, uniform on the sphere if there is none
+		Double3 sample(
+			Random::Mersenne& prng
+		) const
+		{
+			if ( !has_energy() )
+				return from_square( prng.get_float(), prng.get_float() );
+			// Offset and size of the current square
+			std::float_t u{ 0.f };
+			std::float_t v{ 0.f };
+			std::float_t size{ 1.f };
+			std::uint32_t index{ 0 };
+			while ( true )
+			{
+				Node const& current = node[index];
+				std::float_t const sum = current.sum[0] + current.sum[1] + current.sum[2] + current.sum[3];
+				std::float_t target = prng.get_float() * sum;
+				std::uint8_t q{ 0 };
+				while ( q < 3 && target >= current.sum[q] )
+					target -= current.sum[q++];
+				// Skip quadrants without energy, rounding may select them
+				while ( current.sum[q] <= 0.f )
+					q = ( q + 3 ) % 4;
+				size *= 0.5f;
+				u += ( q & 1 ) ? size : 0.f;
+				v += ( q & 2 ) ? size : 0.f;
+				if ( current.child[q] == 0 )
+					return from_square( u + size * prng.get_float(), v + size * prng.get_float() );
+				index = current.child[q];
+			}
+		};
+
+		// pdf_W of a direction
+		std::float_t pdf(
+			Double3 const& direction
+		) const
+		{
+			if ( !has_energy() )
+				return inv_4pi;
+			auto [u, v] = to_square( direction );
+			std::float_t value{ inv_4pi };
+			std::uint32_t index{ 0 };
+			while ( true )
+			{
+				Node const& current = node[index];
+				std::float_t const sum = current.sum[0] + current.sum[1] + current.sum[2] + current.sum[3];
+				if ( !( sum > 0.f ) )
+					return 0.f;
+				std::uint8_t const q = quadrant( u, v );
+				value *= 4.f * current.sum[q] / sum;
+				if ( current.child[q] == 0 )
+					return value;
+				index = current.child[q];
+			}
+		};
+
+	};
+
+	// Spatial binary tree of directional quadtrees, learned while rendering
+	// Each pass records the radiance arriving at camera path vertices into the building trees. Between passes,
+	// they become the sampling trees, and spatial leaves that received many samples are split.
+	// Practical Path Guiding for Efficient Light-Transport Simulation, Müller et al., 2017
+	class SDTree final
+	{
+
+	private:
+
+		// Inner nodes split their box in half along axis, children are child and child + 1
+		struct Node
+		{
+			std::uint32_t child{ 0 };
+			std::uint32_t leaf{ 0 };
+			std::uint8_t axis{ 0 };
+		};
+
+		// Samples a spatial leaf needs in a pass to be split
+		static constexpr std::uint32_t split_samples{ 12000 };
+
+		Double3 bound_min;
+		// 1 / size of the box, per axis
+		std::double_t inv_size[3];
+
+		std::vector<Node> node;
+
+		// Per spatial leaf
+		std::vector<DTree> sampling;
+		std::vector<DTree> building;
+		std::vector<std::uint32_t> n_sample;
+
+		// Number of refinements, the sampling trees are empty before the first one
+		std::uint32_t iteration{ 0 };
+
+		std::uint32_t leaf(
+			Double3 const& point
+		) const
+		{
+			Double3 const offset = point - bound_min;
+			// Position in the unit cube
+			std::double_t p[3] = { offset.x * inv_size[0], offset.y * inv_size[1], offset.z * inv_size[2] };
+			std::uint32_t index{ 0 };
+			while ( node[index].child != 0 )
+			{
+				std::double_t& value = p[node[index].axis];
+				value *= 2.;
+				if ( value < 1. )
+					index = node[index].child;
+				else
+				{
+					value -= 1.;
+					index = node[index].child + 1;
+				}
+			}
+			return node[index].leaf;
+		};
+
+	public:
+
+		SDTree() = delete;
+
+		SDTree(
+			Geometry::Bound const& bound
+		)
+			: node( 1 ), sampling( 1 ), building( 1 ), n_sample( 1, 0 )
+		{
+			// Slightly larger, so points on the boundary are inside
+			Double3 const extent = Double3( bound.extent() ) * 1.002 + Double3( 1., 1., 1. ) * 0.002;
+			bound_min = Double3( bound.min ) - extent * 0.001;
+			inv_size[0] = 1. / extent.x;
+			inv_size[1] = 1. / extent.y;
+			inv_size[2] = 1. / extent.z;
+		};
+
+		// True once a pass has been learned, before that camera paths are not guided
+		bool is_trained() const { return iteration > 0; };
+
+		// Radiance arriving at a point from a direction, may be called by several threads at once
+		void record(
+			Double3 const& point,
+			Double3 const& direction,
+			std::float_t const radiance
+		)
+		{
+			std::uint32_t const index = leaf( point );
+			std::atomic_ref<std::uint32_t>( n_sample[index] ).fetch_add( 1, std::memory_order_relaxed );
+			building[index].record( direction, radiance );
+		};
+
+		Double3 sample(
+			Double3 const& point,
+			Random::Mersenne& prng
+		) const
+		{
+			return sampling[leaf( point )].sample( prng );
+		};
+
+		std::float_t pdf(
+			Double3 const& point,
+			Double3 const& direction
+		) const
+		{
+			return sampling[leaf( point )].pdf( direction );
+		};
+
+		// Must not be called while rays are traced, e.g. only between render passes
+		void refine()
+		{
+			// Split the spatial leaves with many samples, both children start with the trees and half the samples
+			// of the parent, and are split again while they have too many
+			for ( std::uint32_t i{ 0 }; i < node.size(); ++i )
+			{
+				if ( node[i].child != 0 || n_sample[node[i].leaf] < split_samples )
+					continue;
+				std::uint32_t const parent_leaf = node[i].leaf;
+				std::uint8_t const child_axis = ( node[i].axis + 1 ) % 3;
+				n_sample[parent_leaf] /= 2;
+				// The first child reuses the leaf of the parent
+				std::uint32_t const second_leaf = static_cast<std::uint32_t>( building.size() );
+				building.emplace_back( building[parent_leaf] );
+				n_sample.emplace_back( n_sample[parent_leaf] );
+				node[i].child = static_cast<std::uint32_t>( node.size() );
+				node.emplace_back( Node{ 0, parent_leaf, child_axis } );
+				node.emplace_back( Node{ 0, second_leaf, child_axis } );
+			}
+
+			// The recorded trees are sampled in the next pass, and the new building trees follow their energy
+			sampling.resize( building.size() );
+			for ( std::uint32_t i{ 0 }; i < building.size(); ++i )
+			{
+				building[i].build();
+				sampling[i] = building[i];
+				building[i] = sampling[i].refined();
+				n_sample[i] = 0;
+			}
+			++iteration;
+		};
+
+	};
+
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "../colour/colour.hpp"
+#include "../geometry/bound.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+#include "../render/sensor.hpp"
+
+namespace Integrator
+{
+
+	// Adjoint-driven Russian roulette and splitting
+	// A low sample prepass estimates each pixel, and on a coarse grid over the scene, what the rest of a sub path
+	// contributes per unit of throughput at its vertices: the radiance for camera paths, and the importance for
+	// emission paths. While rendering, a sub path whose expected contribution is far below the estimate of its
+	// pixel is rouletted, and one far above is split.
+	// Adjoint-Driven Russian Roulette and Splitting in Light Transport Simulation, Vorba and Křivánek, 2016
+	class ADRRS final
+	{
+
+	private:
+
+		// Cells per axis of the grid
+		static constexpr std::uint32_t n_cell{ 16 };
+		// Ratio of the upper and lower bound of the weight window, centred on the target contribution
+		// Wider than the five (5) of the paper, as only the continuation of a sub path is compared with the whole pixel
+		static constexpr std::float_t window_size{ 20.f };
+		// Lowest pixel estimate, relative to the image mean, dark pixels would split every path
+		static constexpr std::float_t min_pixel{ 0.1f };
+
+		Double3 bound_min;
+		// Cells per unit of length, per axis
+		std::double_t cell_scale[3];
+
+		std::uint16_t const image_width;
+		std::uint16_t const image_height;
+
+		// Summed recordings of the prepass, and their count, per cell
+		std::vector<std::float_t> radiance_sum;
+		std::vector<std::uint32_t> radiance_count;
+		std::vector<std::float_t> importance_sum;
+		std::vector<std::uint32_t> importance_count;
+
+		// Estimates, set by build()
+		std::vector<std::float_t> pixel;
+		std::vector<std::float_t> radiance;
+		std::vector<std::float_t> importance;
+		std::float_t image_mean{ 0.f };
+
+		std::uint32_t cell(
+			Double3 const& point
+		) const
+		{
+			Double3 const offset = point - bound_min;
+			std::uint32_t const x = std::min( n_cell - 1, static_cast<std::uint32_t>( std::max( 0., offset.x * cell_scale[0] ) ) );
+			std::uint32_t const y = std::min( n_cell - 1, static_cast<std::uint32_t>( std::max( 0., offset.y * cell_scale[1] ) ) );
+			std::uint32_t const z = std::min( n_cell - 1, static_cast<std::uint32_t>( std::max( 0., offset.z * cell_scale[2] ) ) );
+			return ( z * n_cell + y ) * n_cell + x;
+		};
+
+		// Mean per cell, cells without recordings take the mean of all recordings
+		static std::vector<std::float_t> mean(
+			std::vector<std::float_t> const& sum,
+			std::vector<std::uint32_t> const& count
+		)
+		{
+			std::double_t total_sum{ 0. };
+			std::double_t total_count{ 0. };
+			for ( std::uint32_t i{ 0 }; i < sum.size(); ++i )
+			{
+				total_sum += sum[i];
+				total_count += count[i];
+			}
+			std::float_t const fallback = total_count > 0. ? static_cast<std::float_t>( total_sum / total_count ) : 0.f;
+			std::vector<std::float_t> result( sum.size() );
+			for ( std::uint32_t i{ 0 }; i < sum.size(); ++i )
+				result[i] = count[i] > 0 ? sum[i] / count[i] : fallback;
+			return result;
+		};
+
+	public:
+
+		// Measure of a colour the window compares
+		static std::float_t strength( Colour const& value ) { return value.r + value.g + value.b; };
+
+		// Most continuations of a split sub path
+		static constexpr std::uint8_t max_split{ 4 };
+
+		// Lowest survival probability of the roulette, a survivor gains at most window_size, as the estimates are coarse
+		// Survival follows the ratio only down to it, sub paths further below the window all survive with it
+		// Below the lower bound of the window, 2 / ( 1 + window_size ), or every rouletted path would survive with it
+		static constexpr std::float_t min_survival{ 1.f / window_size };
+
+		ADRRS() = delete;
+
+		ADRRS(
+			Geometry::Bound const& bound,
+			std::uint16_t const image_width,
+			std::uint16_t const image_height
+		)
+			: image_width( image_width )
+			, image_height( image_height )
+			, radiance_sum( n_cell * n_cell * n_cell, 0.f )
+			, radiance_count( n_cell * n_cell * n_cell, 0 )
+			, importance_sum( n_cell * n_cell * n_cell, 0.f )
+			, importance_count( n_cell * n_cell * n_cell, 0 )
+		{
+			Double3 const extent = Double3( bound.extent() ) + Double3( 1., 1., 1. ) * 0.002;
+			bound_min = Double3( bound.min ) - Double3( 1., 1., 1. ) * 0.001;
+			cell_scale[0] = n_cell / extent.x;
+			cell_scale[1] = n_cell / extent.y;
+			cell_scale[2] = n_cell / extent.z;
+		};
+
+		// True once built from the prepass, before that the prepass records
+		bool is_trained() const { return !pixel.empty(); };
+
+		// Contribution of the rest of a camera path per unit of throughput at a vertex, may be called by several threads at once
+		void record_radiance(
+			Double3 const& point,
+			std::float_t const value
+		)
+		{
+			if ( !std::isfinite( value ) )
+				return;
+			std::uint32_t const index = cell( point );
+			std::atomic_ref<std::float_t>( radiance_sum[index] ).fetch_add( value, std::memory_order_relaxed );
+			std::atomic_ref<std::uint32_t>( radiance_count[index] ).fetch_add( 1, std::memory_order_relaxed );
+		};
+
+		// Contribution of the rest of an emission path per unit of throughput at a vertex, may be called by several threads at once
+		void record_importance(
+			Double3 const& point,
+			std::float_t const value
+		)
+		{
+			if ( !std::isfinite( value ) )
+				return;
+			std::uint32_t const index = cell( point );
+			std::atomic_ref<std::float_t>( importance_sum[index] ).fetch_add( value, std::memory_order_relaxed );
+			std::atomic_ref<std::uint32_t>( importance_count[index] ).fetch_add( 1, std::memory_order_relaxed );
+		};
+
+		// Pixel estimates from the sensor of the prepass, and the grid estimates from its recordings
+		void build(
+			Render::Sensor const& sensor
+		)
+		{
+			pixel.resize( static_cast<std::uint32_t>( image_width ) * image_height );
+			std::double_t sum{ 0. };
+			for ( std::uint16_t y{ 0 }; y < image_height; ++y )
+				for ( std::uint16_t x{ 0 }; x < image_width; ++x )
+				{
+					std::float_t const value = strength( sensor.get_colour( x, y ) );
+					pixel[x + y * image_width] = std::isfinite( value ) ? value : 0.f;
+					sum += pixel[x + y * image_width];
+				}
+			image_mean = static_cast<std::float_t>( sum / pixel.size() );
+			for ( std::float_t& value : pixel )
+				value = std::max( value, image_mean * min_pixel );
+
+			radiance = mean( radiance_sum, radiance_count );
+			importance = mean( importance_sum, importance_count );
+		};
+
+		// Target contribution of a camera path of a pixel
+		std::float_t pixel_target(
+			std::uint16_t const x,
+			std::uint16_t const y
+		) const
+		{
+			return pixel[x + y * image_width];
+		};
+
+		// Target contribution of an emission path, it may contribute to any pixel
+		std::float_t image_target() const { return image_mean; };
+
+		std::float_t radiance_at( Double3 const& point ) const { return radiance[cell( point )]; };
+
+		std::float_t importance_at( Double3 const& point ) const { return importance[cell( point )]; };
+
+		// Weight window, Vorba and Křivánek 2016, Algorithm 1
+		// Returns the number of continuations of a sub path, zero (0) ends it, and the factor on their throughput
+		static std::tuple<std::uint8_t, std::float_t> window(
+			std::float_t const expected,
+			std::float_t const target,
+			std::uint8_t const split_limit,
+			Random::Mersenne& prng
+		)
+		{
+			if ( !( target > 0.f ) || !std::isfinite( expected ) )
+				return { 1, 1.f };
+			std::float_t const ratio = expected / target;
+			std::float_t const lower = 2.f / ( 1.f + window_size );
+			std::float_t const upper = lower * window_size;
+			std::float_t const centre = ( lower + upper ) / 2.f;
+			if ( ratio < lower )
+			{
+				// Survival tracks the ratio, so survivors are lifted to the centre of the window
+				// Below min_survival times the centre, survival is min_survival, and survivors stay below the centre
+				std::float_t const survive = std::max( ratio / centre, min_survival );
+				if ( prng.get_float() >= survive )
+					return { 0, 0.f };
+				return { 1, 1.f / survive };
+			}
+			if ( ratio > upper && split_limit > 1 )
+			{
+				std::uint8_t const n = static_cast<std::uint8_t>( std::min<std::float_t>( split_limit, std::round( ratio ) ) );
+				return { n, 1.f / n };
+			}
+			return { 1, 1.f };
+		};
+
+	};
+
+};
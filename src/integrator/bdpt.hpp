@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <tuple>
@@ -26,13 +27,22 @@
 #include "../bxdf/shading_correction.hpp"
 #include "../colour/colour.hpp"
 #include "../epsilon.hpp"
+#include "../guiding/sd_tree.hpp"
+#include "../integrator/adrrs.hpp"
+#include "../integrator/path_length.hpp"
+#include "../integrator/radiance_cache.hpp"
+#include "../integrator/reservoir.hpp"
 #include "../integrator/vertex.hpp"
 #include "../mathematics/double3.hpp"
 #include "../random/mersenne.hpp"
 #include "../random/mersenne.hpp"
+#include "../ray/hit.hpp"
+#include "../ray/mask.hpp"
 #include "../ray/section.hpp"
 #include "../render/camera.hpp"
 #include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/feature.hpp"
 #include "../render/scene.hpp"
 #include "../render/sensor.hpp"
 
@@ -41,20 +51,209 @@ namespace Integrator
 
 	// Veach thesis
 	// Bidrectional path tracer
+	// One per render thread. Scene, camera and config are shared (see Render::Context), a thread only owns
+	// its random number generator and path buffers, so memory use does not grow with the scene per thread.
 	class BDPT
 	{
 
 	private:
 
-		std::uint8_t const max_path_length{ 3 };
+		// Hit vertices per sub path, the max path length unless tuned, see limit_path_length
+		std::uint8_t max_camera_length{ 3 };
+		std::uint8_t max_emission_length{ 3 };
 		std::uint16_t const max_samples{ 1 };
 
-		Render::Camera const camera;
-		Render::Scene const scene;
+		Render::Config const& config;
+
+		Render::Camera const& camera;
+		Render::Scene const& scene;
 		Render::Sensor& sensor;
 
+		// Path guiding, shared by all threads, null if off
+		Guiding::SDTree* const guide;
+		// Share of the guided camera path directions sampled by the BxDF, one-sample MIS
+		static constexpr std::float_t bxdf_fraction{ 0.5f };
+
+		// Russian roulette and splitting of the sub paths, shared by all threads, null if off
+		// Until it is trained, the integrator renders its prepass
+		Integrator::ADRRS* const adrrs;
+		// Most sub path branches per sample, split off by the ADRRS
+		static constexpr std::uint8_t max_branch{ 16 };
+
+		// Energy of each strategy and the sub path lengths, recorded by a pilot to tune the path length, null if off
+		// Owned by this integrator only
+		Integrator::PathLength* const path_length;
+
+		// Radiance reflected by diffuse surfaces, that ends camera paths from Config::radiance_cache_depth on,
+		// shared by all threads, null if off
+		Integrator::RadianceCache const* const radiance_cache;
+
+		// Reservoir resampling of the first camera path vertex, see resample_tile
+		// Reservoirs of this many pixels of the tile, at most radius pixels away, are merged into each
+		static constexpr std::uint8_t restir_neighbours{ 3 };
+		static constexpr std::uint16_t restir_radius{ 3 };
+		// Only neighbours whose first vertex is alike are merged, Bitterli et al. 2020, section 6: geometric normals
+		// within 25 degrees, and depths within 10 percent. Others would mostly offer emitter samples of another target.
+		static constexpr std::double_t restir_min_cos{ 0.906 };
+		static constexpr std::double_t restir_max_depth{ 0.1 };
+
 		Random::Mersenne prng;
 
+		enum class ConnectionType : std::uint8_t
+		{
+			// Type 2) camera path vertex to emitter point
+			Emitter,
+			// Type 2) emission path vertex to camera lens
+			Lens,
+			// Type 3) material vertex to material vertex
+			Vertex
+		};
+
+		// A connection between the sub paths, waiting for its visibility test
+		struct Connection
+		{
+			ConnectionType type;
+			std::uint8_t s;
+			std::uint8_t t;
+			// Sensor position, only used by lens connections
+			std::float_t px;
+			std::float_t py;
+			// Unit vector, along the connection ray
+			Double3 direction;
+			// Pixel of the tile the connection belongs to, see process_tile
+			std::uint32_t pixel;
+			// Emitter vertex of emitter connections, zero (0) for the start of the emission path,
+			// otherwise one (1) past the extra emitter sample in light_sample
+			std::uint16_t light{ 0 };
+			// Uses a branch of the camera path, see trace_sample
+			bool f_branch{ false };
+		};
+
+		// A sub path between two bounces, its current ray, throughput and vertex count (depth)
+		struct PathState
+		{
+			Ray::Section ray;
+			Colour throughput;
+			std::uint8_t depth;
+			// Contribution the sub path is compared with by the ADRRS
+			std::float_t target{ 0.f };
+			// Set for a branch, the roulette and splitting at its next vertex is already decided, factor on the throughput
+			std::float_t split_factor{ 0.f };
+		};
+
+		// A sub path branch, split off by the ADRRS and not traced yet
+		// The vertices before the split, the state at the split vertex, and the hit of that vertex
+		struct Split
+		{
+			Integrator::Path vertices;
+			PathState state;
+			Ray::Hit hit;
+			BxDF::TraceMode trace_mode;
+		};
+
+		// Traced branches of a sub path, and the first vertex each of them owns. The vertices before are shared
+		// with the path it was split from, and are connected by that path only.
+		struct Branches
+		{
+			std::vector<Integrator::Path> path;
+			std::vector<std::uint8_t> first;
+			std::uint8_t size{ 0 };
+
+			void clear() { size = 0; };
+
+			void emplace_back(
+				Integrator::Path const& vertices,
+				std::uint8_t const first_vertex
+			)
+			{
+				if ( path.size() <= size )
+				{
+					path.emplace_back();
+					first.emplace_back();
+				}
+				path[size] = vertices;
+				first[size++] = first_vertex;
+			};
+		};
+
+	public:
+
+		// Connections of all samples rendered by this integrator, by what happened to their shadow ray
+		struct Statistics
+		{
+			// Shadow ray traced
+			std::uint64_t n_traced{ 0 };
+			// Skipped, the connection has no contribution
+			std::uint64_t n_zero{ 0 };
+			// Skipped by Russian roulette, below the shadow threshold
+			std::uint64_t n_roulette{ 0 };
+		};
+
+	private:
+
+		Statistics counter;
+
+		// Per sample connection buffers, reused to avoid allocations
+		std::vector<Connection> connection;
+		std::vector<Ray::Section> connection_ray;
+		std::vector<std::double_t> connection_distance;
+		// Contribution if unoccluded, evaluated before the visibility test
+		std::vector<Colour> connection_value;
+		Ray::Mask connection_occluded;
+
+		// Sub paths of the current sample, reused to avoid allocations
+		Integrator::Path emission_path;
+		Integrator::Path camera_path;
+		// Extra emitter samples of the next event estimation, light_samples - 1 per camera path vertex
+		Integrator::Path light_sample;
+		// Branches of the sub paths, besides emission_path and camera_path, and the splits waiting to be traced
+		Branches emission_branch;
+		Branches camera_branch;
+		std::vector<Split> split;
+		// Branches of the sub path being traced, itself included
+		std::uint8_t n_branch{ 1 };
+
+		// Per tile buffers, one entry per pixel
+		std::vector<Random::Mersenne> tile_prng;
+		std::vector<Colour> tile_accumulate;
+		std::vector<Ray::Section> tile_ray;
+		std::vector<Ray::Hit> tile_hit;
+		std::vector<Render::Feature> tile_feature;
+		// Contribution the camera paths of a pixel are compared with, see Integrator::ADRRS
+		std::vector<std::float_t> tile_target;
+		// First camera path vertex of each pixel, for this and the previous sample, and their reservoirs
+		// tile_reservoir holds the candidates and the previous sample, tile_resampled adds the neighbours
+		std::vector<Integrator::Vertex> tile_first;
+		std::vector<Ray::Intersection> tile_first_idata;
+		std::vector<Integrator::Vertex> tile_previous;
+		std::vector<Ray::Intersection> tile_previous_idata;
+		std::vector<Integrator::Reservoir> tile_reservoir;
+		std::vector<Integrator::Reservoir> tile_resampled;
+		// Reservoirs merged into one, and their pixel, see merge
+		std::vector<Integrator::Reservoir> merge_source;
+		std::vector<std::uint32_t> merge_pixel;
+
+		// Wavefront buffers, the sub paths of all pixels in the tile, see process_wavefront
+		std::vector<Integrator::Path> tile_emission_path;
+		std::vector<Integrator::Path> tile_camera_path;
+		std::vector<Integrator::Path> tile_light_sample;
+		std::vector<PathState> tile_state;
+		std::vector<Colour> tile_sample;
+		// Queue of pixels with an active sub path, and the rays and hits of the queue
+		std::vector<std::uint32_t> queue;
+		std::vector<std::uint32_t> queue_next;
+		std::vector<Ray::Section> queue_ray;
+		std::vector<Ray::Hit> queue_hit;
+		// Queue entries sorted by material, material id in the upper and queue index in the lower 32 bits
+		std::vector<std::uint64_t> queue_order;
+
+		// Contributions of the current sample, by the last camera path vertex they use, path_stride per pixel
+		// They are summed into the radiance arriving at the vertices before, to train the guide and the ADRRS
+		std::vector<Colour> path_radiance;
+		// Contributions by the last emission path vertex they use, to train the ADRRS
+		std::vector<Colour> path_importance;
+		std::uint32_t const path_stride;
+
 		// Veach 273
 		inline std::double_t MIS( std::double_t value ) const
 		{
@@ -66,157 +265,598 @@ namespace Integrator
 
 	public:
 
+		// Pixels per tile side, the camera rays of a tile are traced together
+		static constexpr std::uint16_t tile_size = 8;
+		// Pixels per tile side in wavefront mode, the sub paths of a tile are traced together
+		static constexpr std::uint16_t wavefront_tile_size = 32;
+
 		BDPT() = delete;
 
 		BDPT(
-			Render::Camera const& camera,
+			Render::Context const& context,
 			Render::Sensor& sensor,
-			Render::Scene const& scene,
-			Render::Config const& config
+			Guiding::SDTree* const guide = nullptr,
+			Integrator::ADRRS* const adrrs = nullptr,
+			Integrator::PathLength* const path_length = nullptr,
+			Integrator::RadianceCache const* const radiance_cache = nullptr
 		)
-			: camera( camera )
+			: max_camera_length( context.config.max_path_length )
+			, max_emission_length( context.config.max_path_length )
+			, max_samples( context.config.max_samples )
+			, config( context.config )
+			, camera( context.camera )
+			, scene( context.scene )
 			, sensor( sensor )
-			, scene( scene )
-			, max_path_length( config.max_path_length )
-			, max_samples( config.max_samples )
+			, guide( guide )
+			, adrrs( adrrs )
+			, path_length( path_length )
+			, radiance_cache( radiance_cache )
+			, path_stride( context.config.max_path_length + 2 )
 		{};
 
-		void process(
+		// Render the samples of one pass, for a tile of pixels, [x;x+width[ and [y;y+height[
+		// The camera rays of all pixels in the tile are traced as packets, one sample at a time
+		void process_tile(
 			std::uint16_t const x,
-			std::uint16_t const y
+			std::uint16_t const y,
+			std::uint16_t const width,
+			std::uint16_t const height,
+			std::uint16_t const pass = 0,
+			std::uint16_t const seed = 0
 		)
 		{
-			prng = Random::Mersenne( ( ( x + 1 ) * 0x1337 ) + ( ( y + 1 ) * 0xbeef ) );
+			std::uint32_t const n_pixel = static_cast<std::uint32_t>( width ) * height;
+			tile_prng.resize( n_pixel );
+			tile_accumulate.assign( n_pixel, Colour::Black );
+			tile_ray.resize( n_pixel );
+			tile_hit.resize( n_pixel );
+			tile_feature.assign( n_pixel, Render::Feature{} );
+			tile_target.resize( n_pixel );
+
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				std::uint16_t const px = x + i % width;
+				std::uint16_t const py = y + i / width;
+				// Each pass of each seed has its own random sequence, e.g. pilots render with seeds of their own
+				tile_prng[i] = Random::Mersenne( ( ( ( px + 1 ) * 0x1337 ) + ( ( py + 1 ) * 0xbeef ) )
+					^ ( ( ( static_cast<std::uint32_t>( seed ) << 16 ) | pass ) * 0x9e3779b9 ) );
+				tile_target[i] = ( adrrs && adrrs->is_trained() ) ? adrrs->pixel_target( px, py ) : 0.f;
+			}
+			// The first sample of a pass has no previous sample to reuse
+			if ( config.restir_candidates > 0 )
+				tile_resampled.assign( n_pixel, Integrator::Reservoir{} );
 
-			Colour accumulate( Colour::Black );
+			for ( std::uint32_t sample{ config.pass_first_sample( pass ) }; sample < config.pass_first_sample( pass + 1 ); ++sample )
+			{
+				// Primary visibility for the whole tile
+				for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+					tile_ray[i] = camera.generate_ray( x + i % width, y + i / width, tile_prng[i] );
+				scene.intersect_packet( tile_ray, tile_hit );
+				if ( config.restir_candidates > 0 )
+					resample_tile( width, height );
+				if ( gathering() )
+				{
+					path_radiance.assign( ( config.f_wavefront ? n_pixel : 1 ) * path_stride, Colour::Black );
+					path_importance.assign( ( config.f_wavefront ? n_pixel : 1 ) * path_stride, Colour::Black );
+				}
 
-			for ( std::uint16_t sample{ 0 }; sample < max_samples; ++sample )
-			{
-				// Generate paths
-				auto const emission_path = trace_emission_path();
-				auto const camera_path = trace_camera_path( x, y );
-				// Check if paths hit an element type sampled from the other path
-				bool const f_hit_camera = emission_path.back().f_camera; // Only possible for cameras with an area lens
-				bool const f_hit_emitter = camera_path.back().f_emitter;
-				// Subtract one (1) from path if hit special case above, full path is only evaluated in Type 1)
-				std::uint8_t const n_emission_path = emission_path.size() - ( f_hit_camera ? 1 : 0 );
-				std::uint8_t const n_camera_path = camera_path.size() - ( f_hit_emitter ? 1 : 0 );
-
-				// Three (3) types of connections
-
-				// Type 1) Direct hit on an emitter
-				if ( ( n_camera_path > 0 ) && f_hit_emitter )
-				{
-					// s=0, t>1
-					// Fully traced camera path, hitting an area/environment emitter
-					// No path visibility check is needed
-					std::uint8_t const t = n_camera_path + 1;
-					Integrator::Vertex const& vertex = camera_path[t - 1];
-					if ( !vertex.f_dirac )
+				if ( config.f_wavefront )
+				{
+					process_wavefront( n_pixel );
+					continue;
+				}
+
+				for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+				{
+					prng = tile_prng[i];
+					tile_accumulate[i] += trace_sample( tile_ray[i], tile_hit[i], tile_target[i], reservoir( i ) );
+					tile_feature[i] += first_hit( camera_path );
+					tile_prng[i] = prng;
+					if ( gathering() )
 					{
-						Integrator::Vertex const& previous_vertex = camera_path[t - 2];
-						Double3 const evaluate_direction = ( previous_vertex.get_point() - vertex.get_point() ).normalise();
-						Double3 const evaluate_point = vertex.get_point();
-						accumulate +=
-							vertex.throughput
-							* vertex.ptr_light->radiance(evaluate_point, evaluate_direction)
-							* Weight( 0, t, emission_path, camera_path );
+						train( 0, emission_path, camera_path );
+						std::fill_n( path_radiance.begin(), path_stride, Colour::Black );
+						std::fill_n( path_importance.begin(), path_stride, Colour::Black );
 					}
 				}
+			}
 
-				// Type 1) Direct hit on an emitter or a camera lens
-				if ( ( n_emission_path > 0 ) && f_hit_camera )
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				sensor.pixel( x + i % width, y + i / width, tile_accumulate[i] );
+				sensor.feature( x + i % width, y + i / width, tile_feature[i] );
+			}
+		};
+
+		Statistics const& statistics() const { return counter; };
+
+		// Separate limits of the camera and emission sub paths, in hit vertices, up to the max path length
+		// See Integrator::PathLength. Must not be called while rendering, e.g. only between render passes
+		void limit_path_length(
+			std::uint8_t const camera_length,
+			std::uint8_t const emission_length
+		)
+		{
+			max_camera_length = std::clamp<std::uint8_t>( camera_length, 1, config.max_path_length );
+			max_emission_length = std::clamp<std::uint8_t>( emission_length, 1, config.max_path_length );
+		};
+
+		// Render all samples of a pixel
+		void process(
+			std::uint16_t const x,
+			std::uint16_t const y
+		)
+		{
+			for ( std::uint16_t pass{ 0 }; pass < config.passes; ++pass )
+				process_tile( x, y, 1, 1, pass );
+		}; // end process
+
+	private:
+
+		// One sample of all pixels in the tile, given their traced camera rays
+		// Wavefront path tracing, Laine et al., 2013. Instead of one pixel sample at a time, each stage runs over
+		// the queue of all active sub paths: extend (intersect), sort by material, shade and sample, connect,
+		// shadow test, and accumulate. Every pixel keeps its own random sequence, so the result is the same.
+		void process_wavefront(
+			std::uint32_t const n_pixel
+		)
+		{
+			tile_emission_path.resize( n_pixel );
+			tile_camera_path.resize( n_pixel );
+			tile_light_sample.resize( n_pixel );
+			tile_state.resize( n_pixel );
+
+			// Generate emission paths, and trace them one bounce per stage
+			queue.clear();
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				prng = tile_prng[i];
+				tile_state[i] = begin_emission_path( tile_emission_path[i] );
+				tile_prng[i] = prng;
+				queue.emplace_back( i );
+			}
+			extend_queue();
+			trace_wavefront( tile_emission_path, BxDF::TraceMode::Importance );
+
+			// Camera paths, the first hits are already traced with the primary rays
+			queue.clear();
+			queue_hit.clear();
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				prng = tile_prng[i];
+				tile_state[i] = begin_camera_path( tile_camera_path[i], tile_ray[i] );
+				tile_state[i].target = tile_target[i];
+				tile_prng[i] = prng;
+				queue.emplace_back( i );
+				queue_hit.emplace_back( tile_hit[i] );
+			}
+			trace_wavefront( tile_camera_path, BxDF::TraceMode::Radiance );
+
+			// Connect, all connections of the tile are shadow tested in one batch
+			connection.clear();
+			connection_ray.clear();
+			connection_distance.clear();
+			connection_value.clear();
+			tile_sample.resize( n_pixel );
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				prng = tile_prng[i];
+				tile_sample[i] = connect_paths( i, tile_emission_path[i], tile_camera_path[i], tile_light_sample[i], reservoir( i ) );
+				tile_prng[i] = prng;
+			}
+			scene.occluded_each( connection_ray, connection_distance, connection_occluded, config.interleaved_queries );
+
+			// Accumulate, connections are in pixel order
+			for ( std::uint32_t c{ 0 }; c < connection.size(); ++c )
+				if ( !connection_occluded.test( c ) )
+					tile_sample[connection[c].pixel] += deliver( connection[c], connection_value[c] );
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				tile_accumulate[i] += tile_sample[i];
+				tile_feature[i] += first_hit( tile_camera_path[i] );
+				if ( gathering() )
+					train( i, tile_emission_path[i], tile_camera_path[i] );
+				if ( path_length )
+					path_length->record_sample( tile_camera_path[i].size() - 1, tile_emission_path[i].size() - 1 );
+			}
+		};
+
+		// Bounce the queued sub paths until all have ended, queue_hit holds the hits of their current rays
+		void trace_wavefront(
+			std::vector<Integrator::Path>& paths,
+			BxDF::TraceMode const trace_mode
+		)
+		{
+			while ( !queue.empty() )
+			{
+				// Sort by material, so the same material is sampled in a row. Misses are last.
+				queue_order.clear();
+				for ( std::uint32_t j{ 0 }; j < queue.size(); ++j )
 				{
-					// Needs a camera with a lens radius large than zero
-					// s>1, t=0
-					// Fully traced emission path, hitting a camera lens
-					// Path visibility is therefore true
+					std::uint64_t const material_id = queue_hit[j] ? scene.material_id( queue_hit[j] ) : UINT32_MAX;
+					queue_order.emplace_back( ( material_id << 32 ) | j );
 				}
+				std::sort( queue_order.begin(), queue_order.end() );
 
-				// Type 2) Connecting camera path to an emitter
-				if ( n_camera_path > 0 )
+				// Shade and sample
+				queue_next.clear();
+				for ( std::uint64_t const order : queue_order )
 				{
-					// Evaluate the camera path, next event estimator (NEE)
-					// unless it is a camera (t=0) or emitter (t=end)
+					std::uint32_t const j = static_cast<std::uint32_t>( order );
+					std::uint32_t const i = queue[j];
+					prng = tile_prng[i];
+					if ( extend_path( paths[i], tile_state[i], queue_hit[j], trace_mode ) )
+						queue_next.emplace_back( i );
+					tile_prng[i] = prng;
+				}
+				queue.swap( queue_next );
 
-					Integrator::Vertex const& vertex_emitter = emission_path[0];
-					std::double_t const emitter_select_prb = scene.emitter_select_probability( vertex_emitter.emitter_id );
-					Double3 const& emitter_point = vertex_emitter.get_point();
-					for ( std::uint8_t t{ 1 };t < n_camera_path;++t )
+				extend_queue();
+			}
+		};
+
+		// Extend stage, closest hits for the current rays of all queued sub paths
+		void extend_queue()
+		{
+			queue_ray.clear();
+			for ( std::uint32_t const i : queue )
+				queue_ray.emplace_back( tile_state[i].ray );
+			queue_hit.resize( queue.size() );
+			scene.intersect_each( queue_ray, queue_hit, config.interleaved_queries );
+		};
+
+		// Resampled reservoir of a pixel of the tile, null if off
+		Integrator::Reservoir const* reservoir(
+			std::uint32_t const pixel
+		) const
+		{
+			return config.restir_candidates > 0 ? &tile_resampled[pixel] : nullptr;
+		};
+
+		// Reservoir resampling of direct light, for the first camera path vertex of each pixel of the tile
+		// Each pixel streams emitter candidates into a reservoir, without shadow rays, and may merge the reservoir of
+		// its previous sample. Then the reservoirs of a few alike neighbours are merged, so only the survivor is
+		// connected, see connect_paths. Merges are weighted by 1/Z, the candidates of all reservoirs whose vertex the
+		// survivor may reach, which keeps it unbiased for neighbours with other normals. The targets leave out
+		// visibility, so a reservoir never rejects a survivor that another one may reach, see check_restir.
+		// Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting, Bitterli et al., 2020
+		void resample_tile(
+			std::uint16_t const width,
+			std::uint16_t const height
+		)
+		{
+			std::uint32_t const n_pixel = static_cast<std::uint32_t>( width ) * height;
+			tile_first.swap( tile_previous );
+			tile_first_idata.swap( tile_previous_idata );
+			tile_first.resize( n_pixel );
+			tile_first_idata.resize( n_pixel );
+			tile_reservoir.resize( n_pixel );
+
+			// Candidates, and the previous sample
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				Integrator::Reservoir& current = tile_reservoir[i];
+				current = Integrator::Reservoir{};
+				if ( !tile_hit[i] )
+				{
+					tile_resampled[i] = current;
+					continue;
+				}
+				prng = tile_prng[i];
+				tile_first_idata[i] = scene.shade( tile_ray[i], tile_hit[i] );
+				tile_first[i] = Integrator::Vertex( tile_first_idata[i], Colour::White, 0.f, 0.f, false, false );
+				for ( std::uint16_t c{ 0 }; c < config.restir_candidates; ++c )
+				{
+					auto const [candidate, candidate_idata, candidate_direction] = random_emitter_vertex();
+					std::float_t const target = restir_target( tile_first[i], tile_first_idata[i], candidate );
+					// The reverse pdf of an emitter vertex is the pdf_A it was sampled with
+					current.update( candidate, target / candidate.pdf_reverse, target, 1, prng );
+				}
+				if ( current.target > 0.f )
+					current.W = current.w_sum / ( current.M * current.target );
+				if ( ( config.restir_history > 0 ) && ( tile_resampled[i].M > 0 ) )
+				{
+					merge_source.assign( { current, tile_resampled[i] } );
+					merge_pixel.assign( { i, UINT32_MAX } );
+					current = merge( i );
+				}
+				tile_prng[i] = prng;
+			}
+
+			// Neighbours
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				if ( !tile_hit[i] || ( n_pixel == 1 ) )
+				{
+					tile_resampled[i] = tile_reservoir[i];
+					continue;
+				}
+				prng = tile_prng[i];
+				std::int32_t const x = i % width;
+				std::int32_t const y = i / width;
+				merge_source.assign( 1, tile_reservoir[i] );
+				merge_pixel.assign( 1, i );
+				for ( std::uint8_t n{ 0 }; n < restir_neighbours; ++n )
+				{
+					std::int32_t const nx = std::clamp<std::int32_t>( x + static_cast<std::int32_t>( prng.get_integer() % ( 2 * restir_radius + 1 ) ) - restir_radius, 0, width - 1 );
+					std::int32_t const ny = std::clamp<std::int32_t>( y + static_cast<std::int32_t>( prng.get_integer() % ( 2 * restir_radius + 1 ) ) - restir_radius, 0, height - 1 );
+					std::uint32_t const j = static_cast<std::uint32_t>( nx + ny * width );
+					if ( ( j != i ) && ( tile_reservoir[j].M > 0 ) && similar( i, j ) )
 					{
-						Integrator::Vertex const& vertex = camera_path[t];
-						if ( vertex.f_dirac )
-							continue;
-						Double3 const& surface_point = vertex.get_point();
-						Double3 const delta = emitter_point - surface_point;
-						Double3 const evaluate_direction = delta.normalise();
-						std::double_t const evaluate_distance = delta.magnitude();
-						Ray::Section const ray( surface_point, evaluate_direction, EPSILON_RAY );
-						if ( !scene.occluded( ray, evaluate_distance - 2. * EPSILON_RAY ) )
-						{
-							Double3 const previous_direction = ( camera_path[t - 1].get_point() - surface_point ).normalise();
-							accumulate +=
-								vertex.throughput
-								* vertex_emitter.ptr_light->radiance(emitter_point, -evaluate_direction)
-								* vertex.ptr_material->factor(evaluate_direction, previous_direction, vertex.idata, BxDF::TraceMode::Radiance)
-								* Gprime(vertex, vertex_emitter)
-								* Weight(1, t, emission_path, camera_path)
-								/ ( vertex_emitter.ptr_light->pdf_A( emitter_point, -evaluate_direction ) * emitter_select_prb );
-						}
+						merge_source.emplace_back( tile_reservoir[j] );
+						merge_pixel.emplace_back( j );
 					}
 				}
+				tile_resampled[i] = merge( i );
+				tile_prng[i] = prng;
+			}
+		};
+
+		// True if the first vertices of pixels i and j of the tile are alike, to merge their reservoirs
+		// The choice does not depend on the survivor, and only merged reservoirs are counted by Z, see merge, so the
+		// result stays unbiased
+		bool similar(
+			std::uint32_t const i,
+			std::uint32_t const j
+		) const
+		{
+			return ( tile_first_idata[i].normal_geometry.dot( tile_first_idata[j].normal_geometry ) >= restir_min_cos )
+				&& ( std::abs( tile_hit[i].distance - tile_hit[j].distance ) <= restir_max_depth * tile_hit[i].distance );
+		};
+
+		// Merges the reservoirs of merge_source into one for the vertex of pixel i, each was resampled for the vertex
+		// of its merge_pixel, UINT32_MAX for the previous vertex of pixel i. The previous sample counts at most
+		// Config::restir_history times the candidates of a sample.
+		Integrator::Reservoir merge(
+			std::uint32_t const i
+		)
+		{
+			std::vector<Integrator::Reservoir> const& source = merge_source;
+			std::vector<std::uint32_t> const& pixel = merge_pixel;
+			std::uint32_t const max_M = std::max<std::uint32_t>( 1, config.restir_history ) * config.restir_candidates;
+			Integrator::Reservoir result;
+			for ( Integrator::Reservoir const& value : source )
+			{
+				if ( value.M == 0 )
+					continue;
+				// A reservoir without survivor still counts its candidates
+				std::float_t const target = ( value.W > 0.f ) ? restir_target( tile_first[i], tile_first_idata[i], value.sample ) : 0.f;
+				std::uint32_t const M = std::min( value.M, max_M );
+				result.update( value.sample, target * value.W * M, target, M, prng );
+			}
+			if ( !( result.target > 0.f ) )
+				return result;
+			// Candidates of the reservoirs whose vertex the survivor may reach
+			std::uint32_t Z{ 0 };
+			for ( std::uint32_t k{ 0 }; k < source.size(); ++k )
+			{
+				if ( source[k].M == 0 )
+					continue;
+				bool const f_previous = pixel[k] == UINT32_MAX;
+				Integrator::Vertex const& vertex = f_previous ? tile_previous[i] : tile_first[pixel[k]];
+				Ray::Intersection const& idata = f_previous ? tile_previous_idata[i] : tile_first_idata[pixel[k]];
+				if ( restir_target( vertex, idata, result.sample ) > 0.f )
+					Z += std::min( source[k].M, max_M );
+			}
+			result.W = result.w_sum / ( Z * result.target );
+			return result;
+		};
+
+		// Target function of the reservoirs, the unoccluded contribution of an emitter vertex to a camera vertex
+		// per unit of throughput
+		std::float_t restir_target(
+			Integrator::Vertex const& vertex,
+			Ray::Intersection const& idata,
+			Integrator::Vertex const& emitter
+		) const
+		{
+			Double3 const emitter_point = emitter.get_point();
+			Double3 const direction = ( emitter_point - vertex.get_point() ).normalise();
+			Colour const value = light( emitter ).radiance( emitter_point, -direction )
+				* scene.material( idata.material_id )->factor( direction, idata.from_direction, idata, BxDF::TraceMode::Radiance )
+				* Gprime( vertex, emitter );
+			std::float_t const strength = value.r + value.g + value.b;
+			return std::isfinite( strength ) ? strength : 0.f;
+		};
+
+		// One sample of a pixel, given its traced camera ray, and the contribution its camera path is compared with
+		// The first camera path vertex connects to the survivor of the reservoir, if not null
+		Colour trace_sample(
+			Ray::Section const& primary_ray,
+			Ray::Hit const& primary_hit,
+			std::float_t const target = 0.f,
+			Integrator::Reservoir const* const reservoir = nullptr
+		)
+		{
+			// Generate paths, and the branches split off them by the ADRRS
+			trace_emission_path();
+			trace_splits( emission_branch );
+			trace_camera_path( primary_ray, primary_hit, target );
+			trace_splits( camera_branch );
+
+			// Connections are gathered first, and their visibility is resolved in one batched scene query
+			connection.clear();
+			connection_ray.clear();
+			connection_distance.clear();
+			connection_value.clear();
+			Colour accumulate = connect_paths( 0, emission_path, camera_path, light_sample, reservoir );
+			// Each pair of branches connects the vertices they own
+			for ( std::uint8_t a{ 0 }; a <= emission_branch.size; ++a )
+				for ( std::uint8_t b{ 0 }; b <= camera_branch.size; ++b )
+					if ( a > 0 || b > 0 )
+						accumulate += connect_paths( 0,
+							a > 0 ? emission_branch.path[a - 1] : emission_path,
+							b > 0 ? camera_branch.path[b - 1] : camera_path,
+							light_sample,
+							nullptr,
+							a > 0 ? emission_branch.first[a - 1] : 0,
+							b > 0 ? camera_branch.first[b - 1] : 0 );
+
+			// The visibility term in G, is evaluated independently
+			scene.occluded_each( connection_ray, connection_distance, connection_occluded, config.interleaved_queries );
+
+			// Accumulate the contribution of all unoccluded connections
+			for ( std::uint32_t i{ 0 }; i < connection.size(); ++i )
+				if ( !connection_occluded.test( i ) )
+					accumulate += deliver( connection[i], connection_value[i] );
+			if ( path_length )
+				path_length->record_sample( camera_path.size() - 1, emission_path.size() - 1 );
+
+			return accumulate;
+		}; // end trace_sample
+
+		// Direct hits of the sub paths (Type 1) are returned, all other connections (Type 2 and 3) are appended to
+		// the connection buffers, for their visibility test. Connections are tagged with the pixel they belong to.
+		// See add_connection, for connections that skip the visibility test.
+		// Only vertices from s_first and t_first on are connected, the ones before belong to the path a branch was
+		// split from. The emitter and camera vertex belong to the unsplit paths.
+		// With a reservoir, the first camera path vertex connects to its survivor instead of the emitter samples.
+		Colour connect_paths(
+			std::uint32_t const pixel,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path,
+			Integrator::Path& light_sample,
+			Integrator::Reservoir const* const reservoir = nullptr,
+			std::uint8_t const s_first = 0,
+			std::uint8_t const t_first = 0
+		)
+		{
+			Colour accumulate( Colour::Black );
+
+			// Check if paths hit an element type sampled from the other path
+			bool const f_hit_camera = emission_path.back().f_camera; // Only possible for cameras with an area lens
+			bool const f_hit_emitter = camera_path.back().f_emitter;
+			// Subtract one (1) from path if hit special case above, full path is only evaluated in Type 1)
+			std::uint8_t const n_emission_path = emission_path.size() - ( f_hit_camera ? 1 : 0 );
+			std::uint8_t const n_camera_path = camera_path.size() - ( f_hit_emitter ? 1 : 0 );
 
-				// Type 2) Connecting emitter path to a camera lens
-				if ( n_emission_path > 0 )
+			// Three (3) types of connections
+
+			// Type 1) Direct hit on an emitter
+			if ( ( n_camera_path > 0 ) && f_hit_emitter && ( s_first == 0 ) && ( n_camera_path >= t_first ) )
+			{
+				// s=0, t>1
+				// Fully traced camera path, hitting an area/environment emitter
+				// No path visibility check is needed
+				std::uint8_t const t = n_camera_path + 1;
+				Integrator::Vertex const& vertex = camera_path[t - 1];
+				if ( !vertex.f_dirac )
 				{
-					// Evaluate the emmision path, particle/light trace
-					// unless it is a emitter (s=0) or camera (s=end)
+					Double3 const& evaluate_direction = camera_path.idata( t - 1 ).from_direction;
+					Double3 const evaluate_point = vertex.get_point();
+					Colour const value =
+						vertex.throughput
+						* light( vertex ).radiance(evaluate_point, evaluate_direction)
+						* Weight( 0, t, emission_path, camera_path );
+					accumulate += value;
+					if ( gathering() && ( t_first == 0 ) )
+						path_radiance[pixel * path_stride + t - 1] += value;
+					if ( path_length )
+						path_length->record_contribution( 0, t, value );
+				}
+			}
 
-					Integrator::Vertex const& vertex_camera = camera_path[0];
-					Double3 const lens_point = camera.sample_lens( prng );
-					for ( std::uint8_t s{ 1 };s < n_emission_path;++s )
+			// Camera path ended at the radiance cache, which stands in for all paths through its last vertex
+			if ( ( n_camera_path > t_first ) && at_cache( camera_path, n_camera_path - 1 ) )
+			{
+				std::uint8_t const t = n_camera_path;
+				Colour const value = camera_path[t - 1].throughput * radiance_cache->radiance( camera_path.idata( t - 1 ), prng );
+				accumulate += value;
+				if ( gathering() && ( t_first == 0 ) )
+					path_radiance[pixel * path_stride + t - 1] += value;
+			}
+
+			// Type 1) Direct hit on an emitter or a camera lens
+			if ( ( n_emission_path > 0 ) && f_hit_camera )
+			{
+				// Needs a camera with a lens radius large than zero
+				// s>1, t=0
+				// Fully traced emission path, hitting a camera lens
+				// Path visibility is therefore true
+			}
+
+			// Type 2) Connecting camera path to an emitter
+			light_sample.clear();
+			if ( ( n_camera_path > 0 ) && ( s_first == 0 ) )
+			{
+				// Evaluate the camera path, next event estimator (NEE)
+				// unless it is a camera (t=0) or emitter (t=end)
+				// Each vertex connects to the start of the emission path, and to light_samples - 1 emitter points of
+				// its own. Their shadow rays are tested in the same batch as all other connections.
+
+				for ( std::uint8_t t{ std::max<std::uint8_t>( 1, t_first ) };t < n_camera_path;++t )
+				{
+					Integrator::Vertex const& vertex = camera_path[t];
+					if ( vertex.f_dirac || cached( 1, t + 1, emission_path, camera_path ) )
+						continue;
+					Double3 const surface_point = vertex.get_point();
+					if ( ( t == 1 ) && reservoir )
 					{
-						Integrator::Vertex const& vertex = emission_path[s];
-						if ( vertex.f_dirac )
-							continue;
-						auto const [x, y, f_valid] = camera.sensor( vertex.get_point(), lens_point );
-						if ( f_valid )
+						if ( reservoir->W > 0.f )
 						{
-							Double3 const delta = vertex.get_point() - lens_point;
-							Double3 const evaluate_direction = delta.normalise();
-							std::double_t const evaluate_distance = delta.magnitude();
-							Ray::Section const ray( lens_point, evaluate_direction, EPSILON_RAY );
-							if ( !scene.occluded( ray, evaluate_distance - 2. * EPSILON_RAY ) )
-							{
-								Double3 const previous_direction = ( emission_path[s - 1].get_point() - vertex.get_point() ).normalise();
-								// Note: the result is stored in a different buffer than camera traces (pixel)
-								sensor.splash( x, y,
-									vertex.throughput * ShadingCorrection( evaluate_direction, vertex.idata.from_direction, vertex.idata, BxDF::TraceMode::Importance )
-									* vertex.ptr_material->factor( -evaluate_direction, previous_direction, vertex.idata, BxDF::TraceMode::Importance )
-									* Gprime( vertex, vertex_camera )
-									* Weight( s, 1, emission_path, camera_path )
-									/ camera.We( lens_point, evaluate_direction )
-								);
-							}
+							Double3 const evaluate_direction = ( reservoir->sample.get_point() - surface_point ).normalise();
+							auto const [edge_ray, edge_distance] = connect_vertices( vertex, reservoir->sample );
+							add_connection( Connection{ ConnectionType::Emitter, 1, t, 0.f, 0.f, evaluate_direction, pixel },
+								edge_ray, edge_distance,
+								evaluate_reservoir( *reservoir, emission_path, camera_path, evaluate_direction ) );
 						}
+						continue;
+					}
+					for ( std::uint8_t j{ 0 }; j < config.light_samples; ++j )
+					{
+						if ( j > 0 )
+							sample_emitter( light_sample );
+						std::uint16_t const light = j > 0 ? static_cast<std::uint16_t>( light_sample.size() ) : 0;
+						Integrator::Vertex const& vertex_emitter = j > 0 ? light_sample.back() : emission_path[0];
+						Double3 const evaluate_direction = ( vertex_emitter.get_point() - surface_point ).normalise();
+						auto const [edge_ray, edge_distance] = connect_vertices( vertex, vertex_emitter );
+						add_connection( Connection{ ConnectionType::Emitter, 1, t, 0.f, 0.f, evaluate_direction, pixel, light, t_first > 0 },
+							edge_ray, edge_distance,
+							emission_path, camera_path, light_sample );
 					}
 				}
+			}
 
-				// Type 3) Connect all (non dirac) material vertices from one path to the other
+			// Type 2) Connecting emitter path to a camera lens
+			Double3 const lens_point = camera.sample_lens( prng );
+			if ( ( n_emission_path > 0 ) && ( t_first == 0 ) )
+			{
+				// Evaluate the emmision path, particle/light trace
+				// unless it is a emitter (s=0) or camera (s=end)
 
-				// No possible connections
-				if ( n_emission_path < 2 && n_camera_path < 2 )
-					continue;
+				for ( std::uint8_t s{ std::max<std::uint8_t>( 1, s_first ) };s < n_emission_path;++s )
+				{
+					Integrator::Vertex const& vertex = emission_path[s];
+					if ( vertex.f_dirac || cached( s + 1, 1, emission_path, camera_path ) )
+						continue;
+					auto const [x, y, f_valid] = camera.sensor( vertex.get_point(), lens_point );
+					if ( f_valid )
+					{
+						Double3 const evaluate_direction = ( vertex.get_point() - lens_point ).normalise();
+						// The connection ray starts at the lens point, which is not on a surface
+						auto const [edge_ray, edge_distance] = Ray::connect( lens_point, Double3::Zero, 0.,
+							vertex.get_point(), vertex.get_normal(), vertex.error );
+						add_connection( Connection{ ConnectionType::Lens, s, 1, x, y, evaluate_direction, pixel },
+							edge_ray, edge_distance,
+							emission_path, camera_path, light_sample );
+					}
+				}
+			}
+
+			// Type 3) Connect all (non dirac) material vertices from one path to the other
 
-				for ( std::uint8_t s{ 2 };s <= n_emission_path;++s )
+			// Skipped if there are no possible connections
+			if ( n_emission_path >= 2 || n_camera_path >= 2 )
+			{
+				for ( std::uint8_t s{ std::max<std::uint8_t>( 2, s_first + 1 ) };s <= n_emission_path;++s )
 				{
 					Integrator::Vertex const& s_vertex = emission_path[s - 1];
 					if ( s_vertex.f_dirac )
 						continue;
-					for ( std::uint8_t t{ 2 };t <= n_camera_path;++t )
+					for ( std::uint8_t t{ std::max<std::uint8_t>( 2, t_first + 1 ) };t <= n_camera_path;++t )
 					{
 						Integrator::Vertex const& t_vertex = camera_path[t - 1];
-						if ( t_vertex.f_dirac )
+						if ( t_vertex.f_dirac || cached( s, t, emission_path, camera_path ) )
 							continue;
 
 						// Limit to k = s + t - 1. Faster render, but can appear darker
@@ -224,44 +864,408 @@ namespace Integrator
 						//	continue;
 
 						// Connecting edge, Veach 301
-						Double3 const delta = t_vertex.get_point() - s_vertex.get_point();
-						Double3 const evaluate_direction = delta.normalise();
-						std::double_t const evaluate_distance = delta.magnitude();
-
-						// The visibility term in G, is evaluated independently
-						bool const f_occluded = scene.occluded( Ray::Section( s_vertex.get_point(), evaluate_direction, EPSILON_RAY ), evaluate_distance - 2. * EPSILON_RAY );
-						if ( !f_occluded )
-						{
-							Double3 const previous_direction_emission = ( emission_path[s - 2].get_point() - s_vertex.get_point() ).normalise();
-							Double3 const previous_direction_camera = ( camera_path[t - 2].get_point() - t_vertex.get_point() ).normalise();
-
-							accumulate +=
-								// Flow from emitter
-								s_vertex.throughput * ShadingCorrection( evaluate_direction, s_vertex.idata.from_direction, s_vertex.idata, BxDF::TraceMode::Importance )
-								* s_vertex.ptr_material->factor( evaluate_direction, previous_direction_emission, s_vertex.idata, BxDF::TraceMode::Importance )
-								// Flow from camera
-								* t_vertex.throughput
-								* t_vertex.ptr_material->factor( -evaluate_direction, previous_direction_camera, t_vertex.idata, BxDF::TraceMode::Radiance )
-								// G and MIS weight
-								* Gprime( s_vertex, t_vertex )
-								* Weight( s, t, emission_path, camera_path );
-						}
+						Double3 const evaluate_direction = ( t_vertex.get_point() - s_vertex.get_point() ).normalise();
+						auto const [edge_ray, edge_distance] = connect_vertices( s_vertex, t_vertex );
+						add_connection( Connection{ ConnectionType::Vertex, s, t, 0.f, 0.f, evaluate_direction, pixel, 0, t_first > 0 },
+							edge_ray, edge_distance,
+							emission_path, camera_path, light_sample );
 					} // end t
 				} // end s
+			}
 
-			} // end sample loop
+			return accumulate;
+		}; // end connect_paths
+
+		// Evaluates a connection, and appends it to the connection buffers for its visibility test
+		// Connections without contribution are dropped. Below the shadow threshold, they are kept by Russian
+		// roulette, with the contribution divided by the survival probability, so shadow rays are spent on the
+		// connections that matter.
+		void add_connection(
+			Connection const& edge,
+			Ray::Section const& edge_ray,
+			std::double_t const distance,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path,
+			Integrator::Path const& light_sample
+		)
+		{
+			add_connection( edge, edge_ray, distance, evaluate_connection( edge, edge_ray, emission_path, camera_path, light_sample ) );
+		};
 
-			sensor.pixel( x, y, accumulate );
-		}; // end process
+		// Appends an evaluated connection
+		void add_connection(
+			Connection const& edge,
+			Ray::Section const& edge_ray,
+			std::double_t const distance,
+			Colour value
+		)
+		{
+			std::float_t const strength = std::max( { value.r, value.g, value.b } );
+			if ( !( strength > 0.f ) )
+			{
+				++counter.n_zero;
+				return;
+			}
+			if ( strength < config.shadow_threshold )
+			{
+				std::float_t const survive = strength / config.shadow_threshold;
+				if ( prng.get_float() >= survive )
+				{
+					++counter.n_roulette;
+					return;
+				}
+				value = value / survive;
+			}
+			++counter.n_traced;
+			connection.emplace_back( edge );
+			connection_ray.emplace_back( edge_ray );
+			connection_distance.emplace_back( distance );
+			connection_value.emplace_back( value );
+		};
 
-	private:
+		// Adds an unoccluded connection, lens connections are splashed onto the sensor directly and return black
+		// The others are returned, for their pixel
+		Colour deliver(
+			Connection const& edge,
+			Colour const& value
+		)
+		{
+			if ( path_length )
+			{
+				auto const [s, t] = strategy( edge );
+				path_length->record_contribution( s, t, value );
+			}
+			if ( edge.type == ConnectionType::Lens )
+			{
+				sensor.splash( edge.px, edge.py, value );
+				return Colour::Black;
+			}
+			gather( edge, value );
+			return value;
+		};
 
-		std::vector<Integrator::Vertex> trace_emission_path()
+		// Vertices of the emission and camera path a connection uses, its strategy ( s, t )
+		static std::tuple<std::uint8_t, std::uint8_t> strategy(
+			Connection const& edge
+		)
+		{
+			switch ( edge.type )
+			{
+				case ConnectionType::Emitter:
+					return { 1, edge.t + 1 };
+				case ConnectionType::Lens:
+					return { edge.s + 1, 1 };
+				default:
+					return { edge.s, edge.t };
+			}
+		};
+
+		// True if a camera path vertex is where the path ends at the radiance cache, its first diffuse vertex from
+		// the cache depth on. Camera paths are not continued past it, see extend_path.
+		bool at_cache(
+			Integrator::Path const& camera_path,
+			std::uint8_t const index
+		) const
+		{
+			Integrator::Vertex const& vertex = camera_path[index];
+			return radiance_cache && ( index >= config.radiance_cache_depth ) && !vertex.f_dirac && !vertex.f_emitter;
+		};
+
+		// True if the path of strategy ( s, t ) is left to the radiance cache, i.e. a camera path would have ended
+		// at the cache before its last vertex. Its vertices are counted from the camera, the cache depth on.
+		// The strategies of the remaining paths all exist, so their MIS weights still sum to one (1).
+		bool cached(
+			std::uint8_t const s,
+			std::uint8_t const t,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path
+		) const
+		{
+			if ( !radiance_cache )
+				return false;
+			std::uint8_t const n = s + t;
+			for ( std::uint8_t i{ config.radiance_cache_depth }; i + 1 < n; ++i )
+			{
+				Integrator::Vertex const& vertex = i < t ? camera_path[i] : emission_path[n - 1 - i];
+				if ( !vertex.f_dirac && !vertex.f_emitter )
+					return true;
+			}
+			return false;
+		};
+
+		// Contribution of the first camera path vertex, connected to the survivor of its reservoir, if unoccluded
+		// One sample, weighted by the contribution weight W instead of the emitter pdf_A
+		Colour evaluate_reservoir(
+			Integrator::Reservoir const& reservoir,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path,
+			Double3 const& evaluate_direction
+		) const
+		{
+			Integrator::Vertex const& vertex_emitter = reservoir.sample;
+			Integrator::Vertex const& vertex = camera_path[1];
+			return
+				vertex.throughput
+				* light( vertex_emitter ).radiance( vertex_emitter.get_point(), -evaluate_direction )
+				* scene.material( vertex.material_id )->factor( evaluate_direction, camera_path.idata( 1 ).from_direction, camera_path.idata( 1 ), BxDF::TraceMode::Radiance )
+				* Gprime( vertex, vertex_emitter )
+				* Weight( 1, 2, emission_path, camera_path, &vertex_emitter )
+				* reservoir.W;
+		};
+
+		// Contribution of a connection to its pixel, if unoccluded
+		// For lens connections it is the contribution to the sensor position px, py
+		Colour evaluate_connection(
+			Connection const& edge,
+			Ray::Section const& edge_ray,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path,
+			Integrator::Path const& light_sample
+		) const
+		{
+			Double3 const& evaluate_direction = edge.direction;
+			switch ( edge.type )
+			{
+				case ConnectionType::Emitter:
+				{
+					Integrator::Vertex const& vertex_emitter = edge.light > 0 ? light_sample[edge.light - 1] : emission_path[0];
+					Integrator::Vertex const& vertex = camera_path[edge.t];
+					Double3 const emitter_point = vertex_emitter.get_point();
+					std::double_t const emitter_select_prb = scene.emitter_select_probability( vertex_emitter.emitter_id );
+					Double3 const& previous_direction = camera_path.idata( edge.t ).from_direction;
+					return
+						vertex.throughput
+						* light( vertex_emitter ).radiance( emitter_point, -evaluate_direction )
+						* scene.material( vertex.material_id )->factor( evaluate_direction, previous_direction, camera_path.idata( edge.t ), BxDF::TraceMode::Radiance )
+						* Gprime( vertex, vertex_emitter )
+						* Weight( 1, edge.t + 1, emission_path, camera_path, &vertex_emitter )
+						/ ( light( vertex_emitter ).pdf_A( emitter_point, -evaluate_direction ) * emitter_select_prb * config.light_samples );
+				}
+				case ConnectionType::Lens:
+				{
+					Integrator::Vertex const& vertex_camera = camera_path[0];
+					Integrator::Vertex const& vertex = emission_path[edge.s];
+					Double3 const& previous_direction = emission_path.idata( edge.s ).from_direction;
+					// The lens point is not on a surface, so the ray starts at it
+					Double3 const& lens_point = edge_ray.origin;
+					// Note: the result is stored in a different buffer than camera traces (pixel)
+					// The camera emits importance We towards the vertex, Veach 115. We integrates to one (1) over the
+					// sensor, and each pixel sample traces one emission path, so the splashes of a pixel average to its radiance
+					return
+						vertex.throughput * ShadingCorrection( evaluate_direction, emission_path.idata( edge.s ).from_direction, emission_path.idata( edge.s ), BxDF::TraceMode::Importance )
+						* scene.material( vertex.material_id )->factor( -evaluate_direction, previous_direction, emission_path.idata( edge.s ), BxDF::TraceMode::Importance )
+						* Gprime( vertex, vertex_camera )
+						* Weight( edge.s + 1, 1, emission_path, camera_path )
+						* camera.We( lens_point, evaluate_direction );
+				}
+				case ConnectionType::Vertex:
+				{
+					Integrator::Vertex const& s_vertex = emission_path[edge.s - 1];
+					Integrator::Vertex const& t_vertex = camera_path[edge.t - 1];
+					Ray::Intersection const& s_idata = emission_path.idata( edge.s - 1 );
+					Ray::Intersection const& t_idata = camera_path.idata( edge.t - 1 );
+					Double3 const& previous_direction_emission = s_idata.from_direction;
+					Double3 const& previous_direction_camera = t_idata.from_direction;
+
+					return
+						// Flow from emitter
+						s_vertex.throughput * ShadingCorrection( evaluate_direction, s_idata.from_direction, s_idata, BxDF::TraceMode::Importance )
+						* scene.material( s_vertex.material_id )->factor( evaluate_direction, previous_direction_emission, s_idata, BxDF::TraceMode::Importance )
+						// Flow from camera
+						* t_vertex.throughput
+						* scene.material( t_vertex.material_id )->factor( -evaluate_direction, previous_direction_camera, t_idata, BxDF::TraceMode::Radiance )
+						// G and MIS weight
+						* Gprime( s_vertex, t_vertex )
+						* Weight( edge.s, edge.t, emission_path, camera_path );
+				}
+			} // end switch
+			return Colour::Black;
+		}; // end evaluate_connection
+
+		// True while contributions are gathered by the vertices they use, to train the guide or the ADRRS
+		bool gathering() const { return guide || ( adrrs && !adrrs->is_trained() ); };
+
+		// Add the contribution of a connection to the last vertex of each sub path it uses, see train
+		void gather(
+			Connection const& edge,
+			Colour const& value
+		)
+		{
+			// Camera path branches are not gathered, their vertices before the split are shared
+			if ( !gathering() || edge.f_branch )
+				return;
+			std::uint32_t const offset = edge.pixel * path_stride;
+			// Lens connections use the camera vertex only
+			if ( edge.type != ConnectionType::Lens )
+				path_radiance[offset + ( edge.type == ConnectionType::Emitter ? edge.t : edge.t - 1 )] += value;
+			path_importance[offset + ( edge.type == ConnectionType::Lens ? edge.s : edge.s - 1 )] += value;
+		};
+
+		// Train the guide and the ADRRS prepass, on the gathered contributions of a sample
+		void train(
+			std::uint32_t const pixel,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path
+		)
+		{
+			if ( guide )
+				train_guide( pixel, camera_path );
+			if ( adrrs && !adrrs->is_trained() )
+				train_window( pixel, emission_path, camera_path );
+		};
+
+		// Record what the rest of each sub path contributed, per unit of throughput at its diffuse vertices
+		// That is the sum of the contributions using the later vertices, over the throughput arriving at the vertex.
+		void train_window(
+			std::uint32_t const pixel,
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path
+		)
+		{
+			Colour const* const radiance = &path_radiance[pixel * path_stride];
+			Colour later( Colour::Black );
+			for ( std::size_t i = camera_path.size(); i-- > 1; )
+			{
+				Integrator::Vertex const& vertex = camera_path[i];
+				if ( !vertex.f_dirac && !vertex.f_emitter )
+					adrrs->record_radiance( vertex.get_point(), ADRRS::strength( later ) / ADRRS::strength( vertex.throughput ) );
+				later += radiance[i];
+			}
+
+			Colour const* const importance = &path_importance[pixel * path_stride];
+			later = Colour::Black;
+			for ( std::size_t i = emission_path.size(); i-- > 1; )
+			{
+				Integrator::Vertex const& vertex = emission_path[i];
+				if ( !vertex.f_dirac )
+					adrrs->record_importance( vertex.get_point(), ADRRS::strength( later ) / ADRRS::strength( vertex.throughput ) );
+				later += importance[i];
+			}
+		};
+
+		// Record the radiance arriving at each vertex of a camera path, from the direction it was continued in.
+		// That is the sum of the contributions using the later vertices, over the throughput up to the next vertex.
+		void train_guide(
+			std::uint32_t const pixel,
+			Integrator::Path const& camera_path
+		)
+		{
+			Colour const* const radiance = &path_radiance[pixel * path_stride];
+			Colour incident( Colour::Black );
+			for ( std::size_t i = camera_path.size() - 1; i-- > 1; )
+			{
+				incident += radiance[i + 1];
+				Integrator::Vertex const& vertex = camera_path[i];
+				Colour const& throughput = camera_path[i + 1].throughput;
+				std::float_t const scale = throughput.r + throughput.g + throughput.b;
+				if ( vertex.f_dirac || !( scale > 0.f ) )
+					continue;
+				guide->record( vertex.get_point(), -camera_path.idata( i + 1 ).from_direction,
+					( incident.r + incident.g + incident.b ) / scale );
+			}
+		};
+
+		// pdf_W of a camera sub path continuing from a diffuse vertex, the BxDF and the guide are mixed by
+		// one-sample MIS. Emission sub paths are not guided, they use the BxDF pdf_W.
+		std::float_t camera_pdf_W(
+			Double3 const& point,
+			Double3 const& direction,
+			std::float_t const bxdf_pdf_W
+		) const
+		{
+			if ( !guide || !guide->is_trained() || !( bxdf_pdf_W > 0.f ) )
+				return bxdf_pdf_W;
+			return bxdf_fraction * bxdf_pdf_W + ( 1.f - bxdf_fraction ) * guide->pdf( point, direction );
+		};
+
+		// Features of the first hit of a traced camera path, see Render::Feature
+		Render::Feature first_hit(
+			Integrator::Path const& camera_path
+		) const
+		{
+			if ( camera_path.size() < 2 )
+				return Render::Feature{};
+			Ray::Intersection const& idata = camera_path.idata( 1 );
+			return {
+				scene.material( idata.material_id )->albedo(),
+				idata.normal_shading,
+				static_cast<std::float_t>( ( idata.point - camera_path.idata( 0 ).point ).magnitude() ) };
+		};
+
+		// Fills in emission_path
+		void trace_emission_path()
+		{
+			n_branch = 1;
+			PathState state = begin_emission_path( emission_path );
+			while ( extend_path( emission_path, state, scene.intersect( state.ray ), BxDF::TraceMode::Importance ) );
+		};
+
+		// Fills in camera_path
+		void trace_camera_path(
+			Ray::Section const& primary_ray,
+			Ray::Hit const& primary_hit,
+			std::float_t const target
+		)
+		{
+			n_branch = 1;
+			PathState state = begin_camera_path( camera_path, primary_ray );
+			state.target = target;
+			// The first hit is already traced with the other camera rays of the tile
+			Ray::Hit hit = primary_hit;
+			while ( extend_path( camera_path, state, hit, BxDF::TraceMode::Radiance ) )
+				hit = scene.intersect( state.ray );
+		};
+
+		// Traces the splits of the last sub path, and the splits of those, into branches
+		// A branch starts again from the hit of its split vertex, so it samples its own direction there
+		void trace_splits(
+			Branches& branches
+		)
+		{
+			branches.clear();
+			while ( !split.empty() )
+			{
+				Split current = std::move( split.back() );
+				split.pop_back();
+				std::uint8_t const first = static_cast<std::uint8_t>( current.vertices.size() + 1 );
+				Ray::Hit hit = current.hit;
+				while ( extend_path( current.vertices, current.state, hit, current.trace_mode ) )
+					hit = scene.intersect( current.state.ray );
+				branches.emplace_back( current.vertices, first );
+			}
+		};
+
+		// Emitter vertex y0 of an emission path, and the ray leaving it
+		PathState begin_emission_path(
+			Integrator::Path& vertices
+		)
 		{
 			// Veach 92
 			// Particle/Importance tracing.
 			// From emitter (wi), BxDF samples wo
-			std::vector<Integrator::Vertex> vertices;
+			vertices.clear();
+			auto const [emitter_point, emitter_direction] = sample_emitter( vertices );
+			// An emission path may contribute to any pixel
+			std::float_t const target = ( adrrs && adrrs->is_trained() ) ? adrrs->image_target() : 0.f;
+			Ray::Intersection const& idata = vertices.idata( 0 );
+			return { Ray::Section( emitter_point, emitter_direction, idata.normal_geometry, idata.error ), vertices[0].throughput, 1, target };
+		};
+
+		// Appends an emitter vertex, for a randomly selected emitter and a point on it
+		// Returns the point, and the direction sampled to leave it
+		std::tuple<Double3, Double3> sample_emitter(
+			Integrator::Path& vertices
+		)
+		{
+			auto const [vertex, idata, emitter_direction] = random_emitter_vertex();
+			vertices.emplace_back( vertex, idata );
+			return { idata.point, emitter_direction };
+		};
+
+		// Emitter vertex for a randomly selected emitter and a point on it, its intersection data, and the
+		// direction sampled to leave it
+		std::tuple<Integrator::Vertex, Ray::Intersection, Double3> random_emitter_vertex()
+		{
 			std::uint32_t const emitter_id = scene.random_emitter( prng );
 			auto const [p_emitter, emitter_select_probability]
 				= scene.emitter( emitter_id );
@@ -269,195 +1273,196 @@ namespace Integrator
 			auto const [emitter_factor, emitter_point, emitter_direction, emitter_normal, emitter_pdf_W, emitter_pdf_A, emitter_cos_theta]
 				= p_emitter->emit( prng );
 
-			Colour throughput = emitter_factor * emitter_cos_theta / ( emitter_select_probability * emitter_pdf_W * emitter_pdf_A );
+			Colour const throughput = emitter_factor * emitter_cos_theta / ( emitter_select_probability * emitter_pdf_W * emitter_pdf_A );
 
 			// Light vertex is y0
 			Ray::Intersection idata;
 			idata.point = emitter_point;
 			if ( !p_emitter->is_dirac() )
+			{
 				idata.orthogonal = Orthogonal( emitter_normal );
-			std::float_t pdf_reverse = emitter_select_probability * emitter_pdf_A;
-			std::float_t pdf_forward = p_emitter->is_dirac()
+				idata.normal_geometry = emitter_normal;
+				idata.error = p_emitter->surface_error();
+			}
+			std::float_t const pdf_reverse = emitter_select_probability * emitter_pdf_A;
+			std::float_t const pdf_forward = p_emitter->is_dirac()
 				? emitter_pdf_W
 				: emitter_pdf_W / emitter_cos_theta;
-			vertices.emplace_back( Integrator::Vertex( idata, throughput, pdf_forward, pdf_reverse, p_emitter->is_dirac(), true ) );
-			vertices[0].ptr_light = p_emitter.get();
-			vertices[0].emitter_id = emitter_id;
-
-			Ray::Section ray( emitter_point, emitter_direction, EPSILON_RAY );
-			std::uint8_t depth{ 1 };
-
-			while ( 1 )
-			{
-				auto [f_hit, hit_distance, idata] = scene.intersect( ray );
-				if ( !f_hit )
-					return vertices;
-
-				std::shared_ptr<BxDF::Polymorphic> const& p_material = scene.material( idata.material_id );
-				auto [bxdf_colour, bxdf_direction, bxdf_event, bxdf_pdf_W, bxdf_cos_theta]
-					= p_material->sample( idata, BxDF::TraceMode::Importance, prng );
-
-				pdf_forward = bxdf_pdf_W / bxdf_cos_theta;
-
-				switch ( bxdf_event )
-				{
-					default:
-					case BxDF::Event::None:
-					case BxDF::Event::Emission:
-					{
-						return vertices;
-					}
-					case BxDF::Event::Diffuse:
-					{
-						if ( depth == 1 && p_emitter->is_dirac() )
-							// Impossible to intersect
-							pdf_reverse = 0.f;
-						else
-						{
-							auto const [evaluate_colour, evaluate_pdf_W, evaluate_cos_theta]
-								= p_material->evaluate( -ray.direction, bxdf_direction, idata, BxDF::TraceMode::Importance );
-							pdf_reverse = evaluate_pdf_W / evaluate_cos_theta;
-						}
-						Integrator::Vertex vertex = Integrator::Vertex( idata, throughput, pdf_forward, pdf_reverse, false, false );
-						vertex.ptr_material = p_material.get();
-						vertex.G = Gprime( vertex, vertices.back() );
-						vertices.emplace_back( vertex );
-						throughput *= ( bxdf_colour / pdf_forward ) * ShadingCorrection( bxdf_direction, idata.from_direction, idata, BxDF::TraceMode::Importance );
-						break;
-					}
-					case BxDF::Event::Reflect:
-					{
-						pdf_reverse = ( depth == 1 & p_emitter->is_dirac() )
-							? 0.f
-							: pdf_forward;
-						Integrator::Vertex vertex = Integrator::Vertex( idata, throughput, pdf_forward, pdf_reverse, true, false );
-						vertex.ptr_material = p_material.get();
-						vertex.G = Gprime( vertex, vertices.back() );
-						vertices.emplace_back( vertex );
-						throughput *= bxdf_colour * ShadingCorrection( bxdf_direction, idata.from_direction, idata, BxDF::TraceMode::Importance );
-						break;
-					}
-				} // end switch
-
-				if ( ++depth > max_path_length )
-					break;
+			Integrator::Vertex vertex( idata, throughput, pdf_forward, pdf_reverse, p_emitter->is_dirac(), true );
+			vertex.emitter_id = emitter_id;
 
-				ray = Ray::Section( idata.point, bxdf_direction, EPSILON_RAY );
-			} // end trace loop
-
-			return vertices;
+			return { vertex, idata, emitter_direction };
 		};
 
-		std::vector<Integrator::Vertex> trace_camera_path(
-			std::uint16_t const x,
-			std::uint16_t const y
+		// Camera vertex z0 of a camera path, the primary ray leaves it
+		PathState begin_camera_path(
+			Integrator::Path& vertices,
+			Ray::Section const& primary_ray
 		)
 		{
 			// Veach 92
 			// Path/Radiance tracing.
 			// From camera (wo), BxDF samples wi
-			std::vector<Integrator::Vertex> vertices;
-			Ray::Section ray = camera.generate_ray( x, y, prng );
+			vertices.clear();
 
-			auto [pdf_W, pdf_A, cos_theta]
-				= camera.evaluate( ray.origin, ray.direction );
+			auto const [pdf_W, pdf_A, cos_theta]
+				= camera.evaluate( primary_ray.origin, primary_ray.direction );
 
-			std::float_t pdf_forward = pdf_W / cos_theta;
-			std::float_t pdf_reverse = pdf_A;
+			std::float_t const pdf_forward = pdf_W / cos_theta;
+			std::float_t const pdf_reverse = pdf_A;
 
 			// Camera vertex is z0
 			Ray::Intersection idata;
-			idata.point = ray.origin;
-			idata.orthogonal = Orthogonal( camera.lens_normal( ray.origin ) );
-			vertices.emplace_back( Integrator::Vertex( idata, Colour::White, pdf_forward, pdf_reverse, camera.is_dirac(), false ) );
+			idata.point = primary_ray.origin;
+			idata.orthogonal = Orthogonal( camera.lens_normal( primary_ray.origin ) );
+			vertices.emplace_back( Integrator::Vertex( idata, Colour::White, pdf_forward, pdf_reverse, camera.is_dirac(), false ), idata );
 
-			std::uint8_t depth{ 1 };
-
-			Colour throughput{ Colour::White * camera.We( ray.origin, ray.direction ) / pdf_forward };
+			return { primary_ray, Colour::White * camera.We( primary_ray.origin, primary_ray.direction ) / pdf_forward, 1 };
+		};
 
-			// Trace loop
-			while ( 1 )
+		// One bounce of a sub path, given the traced hit of its current ray
+		// Appends the hit vertex, and returns true if the path continues, with the next ray in state
+		bool extend_path(
+			Integrator::Path& vertices,
+			PathState& state,
+			Ray::Hit const& hit,
+			BxDF::TraceMode const trace_mode
+		)
+		{
+			if ( !hit )
+				return false;
+			Ray::Intersection const idata = scene.shade( state.ray, hit );
+
+			std::shared_ptr<BxDF::Polymorphic> const& p_material = scene.material( idata.material_id );
+			auto [bxdf_colour, bxdf_direction, bxdf_event, bxdf_pdf_W, bxdf_cos_theta]
+				= p_material->sample( idata, trace_mode, prng );
+
+			// Guided camera paths, the direction is taken from the guide instead of the BxDF with some probability
+			// A guided direction below the surface ends the path, after its vertex is kept for connections
+			bool f_extend{ true };
+			bool const f_guided = guide && guide->is_trained() && ( trace_mode == BxDF::TraceMode::Radiance ) && ( bxdf_event == BxDF::Event::Diffuse );
+			if ( f_guided )
 			{
-				auto const [f_hit, hit_distance, idata] = scene.intersect( ray );
-				if ( !f_hit )
-					return vertices;
+				if ( prng.get_float() >= bxdf_fraction )
+				{
+					bxdf_direction = guide->sample( idata.point, prng );
+					std::tie( bxdf_colour, bxdf_pdf_W, bxdf_cos_theta ) = p_material->evaluate( bxdf_direction, idata.from_direction, idata, trace_mode );
+					f_extend = bxdf_cos_theta >= EPSILON_COS_THETA;
+				}
+				bxdf_pdf_W = camera_pdf_W( idata.point, bxdf_direction, bxdf_pdf_W );
+			}
+
+			// Camera paths end at the radiance cache, the rest of the path is taken from it, see connect_paths
+			if ( radiance_cache && ( trace_mode == BxDF::TraceMode::Radiance ) && ( bxdf_event == BxDF::Event::Diffuse )
+				&& ( state.depth >= config.radiance_cache_depth ) )
+				f_extend = false;
 
-				std::shared_ptr<BxDF::Polymorphic> const& p_material = scene.material( idata.material_id );
-				auto const [bxdf_colour, bxdf_direction, bxdf_event, bxdf_pdf_W, bxdf_cos_theta]
-					= p_material->sample( idata, BxDF::TraceMode::Radiance, prng );
+			// Russian roulette and splitting at diffuse vertices, by the expected contribution of the rest of the path,
+			// see Integrator::ADRRS. A rouletted path keeps this vertex for its connections. Splits start again from
+			// this vertex, and are traced after the path. The wavefront mode only roulettes.
+			std::float_t window_factor{ 1.f };
+			if ( state.split_factor > 0.f )
+			{
+				window_factor = state.split_factor;
+				state.split_factor = 0.f;
+			}
+			else if ( adrrs && adrrs->is_trained() && ( bxdf_event == BxDF::Event::Diffuse ) && f_extend && ( state.depth < max_length( trace_mode ) ) )
+			{
+				std::float_t const expected = ADRRS::strength( state.throughput ) * ( ( trace_mode == BxDF::TraceMode::Radiance )
+					? adrrs->radiance_at( idata.point )
+					: adrrs->importance_at( idata.point ) );
+				std::uint8_t const split_limit = config.f_wavefront ? 1 : std::min<std::uint8_t>( ADRRS::max_split, max_branch - n_branch + 1 );
+				auto const [n, factor] = adrrs->window( expected, state.target, split_limit, prng );
+				f_extend = n > 0;
+				for ( std::uint8_t i{ 1 }; i < n; ++i )
+				{
+					split.emplace_back( Split{ vertices, state, hit, trace_mode } );
+					split.back().state.split_factor = factor;
+				}
+				n_branch += n > 0 ? n - 1 : 0;
+				window_factor = factor;
+			}
 
-				pdf_forward = bxdf_pdf_W / bxdf_cos_theta;
+			std::float_t const pdf_forward = f_extend ? bxdf_pdf_W / bxdf_cos_theta : 0.f;
+			std::float_t pdf_reverse{ 0.f };
+			// Emitter or camera at the start of the path
+			bool const f_source_dirac = vertices[0].f_dirac;
 
-				switch ( bxdf_event )
+			switch ( bxdf_event )
+			{
+				default:
+				case BxDF::Event::None:
 				{
-					default:
-					case BxDF::Event::None:
-					{
-						return vertices;
-					}
-					case BxDF::Event::Emission:
-					{
-						auto const [p_light, select_prb] = scene.emitter( p_material->emitter_id() );
-						Integrator::Vertex vertex = Integrator::Vertex( idata, throughput, 1, 1, false, true );
-						vertex.ptr_material = p_material.get(); // Just for access to emitter_id in MIS // TODO
-						vertex.ptr_light = p_light.get();
-						vertex.G = Gprime( vertex, vertices.back() );
-						vertices.emplace_back( vertex );
-						return vertices;
-					}
-					case BxDF::Event::Diffuse:
-					{
-						if ( depth == 1 && camera.is_dirac() )
-							pdf_reverse = 0.f;
-						else
-						{
-							auto const [evaluate_colour, evaluate_pdf_W, evaluate_cos_theta]
-								= p_material->evaluate( -ray.direction, bxdf_direction, idata, BxDF::TraceMode::Radiance );
-							pdf_reverse = evaluate_pdf_W / evaluate_cos_theta;
-						}
-						Integrator::Vertex vertex = Integrator::Vertex( idata, throughput, pdf_forward, pdf_reverse, false, false );
-						vertex.ptr_material = p_material.get();
-						vertex.G = Gprime( vertex, vertices.back() );
-						vertices.emplace_back( vertex );
-						throughput *= bxdf_colour / pdf_forward;
-						break;
-					}
-					case BxDF::Event::Reflect:
+					return false;
+				}
+				case BxDF::Event::Emission:
+				{
+					// Only camera paths keep the emitter they hit, for Type 1) connections
+					if ( trace_mode == BxDF::TraceMode::Importance )
+						return false;
+					Integrator::Vertex vertex = Integrator::Vertex( idata, state.throughput, 1, 1, false, true );
+					vertex.emitter_id = p_material->emitter_id();
+					vertex.G = Gprime( vertex, vertices.back() );
+					vertices.emplace_back( vertex, idata );
+					return false;
+				}
+				case BxDF::Event::Diffuse:
+				{
+					if ( ( state.depth == 1 && f_source_dirac ) || !f_extend )
+						// Impossible to intersect, or not used as the path ends here
+						pdf_reverse = 0.f;
+					else
 					{
-						pdf_reverse = ( depth == 1 & camera.is_dirac() )
-							? 0.f
-							: pdf_forward;
-						Integrator::Vertex vertex = Integrator::Vertex( idata, throughput, pdf_forward, pdf_reverse, true, false );
-						vertex.ptr_material = p_material.get();
-						vertex.G = Gprime( vertex, vertices.back() );
-						vertices.emplace_back( vertex );
-						throughput *= bxdf_colour;
-						break;
+						auto const [evaluate_colour, evaluate_pdf_W, evaluate_cos_theta]
+							= p_material->evaluate( -state.ray.direction, bxdf_direction, idata, trace_mode );
+						// A camera path would sample the reverse direction of an emission path
+						pdf_reverse = ( trace_mode == BxDF::TraceMode::Importance )
+							? camera_pdf_W( idata.point, -state.ray.direction, evaluate_pdf_W ) / evaluate_cos_theta
+							: evaluate_pdf_W / evaluate_cos_theta;
 					}
-				} // end switch
-
-				if ( ++depth > max_path_length )
+					Integrator::Vertex vertex = Integrator::Vertex( idata, state.throughput, pdf_forward, pdf_reverse, false, false );
+					vertex.G = Gprime( vertex, vertices.back() );
+					vertices.emplace_back( vertex, idata );
+					if ( !f_extend )
+						return false;
+					// The shading correction is one (1) for radiance
+					state.throughput *= ( bxdf_colour / pdf_forward ) * ShadingCorrection( bxdf_direction, idata.from_direction, idata, trace_mode ) * window_factor;
 					break;
+				}
+				case BxDF::Event::Reflect:
+				{
+					pdf_reverse = ( state.depth == 1 && f_source_dirac )
+						? 0.f
+						: pdf_forward;
+					Integrator::Vertex vertex = Integrator::Vertex( idata, state.throughput, pdf_forward, pdf_reverse, true, false );
+					vertex.G = Gprime( vertex, vertices.back() );
+					vertices.emplace_back( vertex, idata );
+					state.throughput *= bxdf_colour * ShadingCorrection( bxdf_direction, idata.from_direction, idata, trace_mode ) * window_factor;
+					break;
+				}
+			} // end switch
 
-				ray = Ray::Section( idata.point, bxdf_direction, EPSILON_RAY );
-			} // end trace loop
+			if ( ++state.depth > max_length( trace_mode ) )
+				return false;
 
-			return vertices;
+			state.ray = Ray::Section( idata.point, bxdf_direction, idata.normal_geometry, idata.error );
+			return true;
 		};
 
-		// Veach // TODO
-		std::double_t Gprime(
-			Integrator::Vertex const& vertex_a,
-			Integrator::Vertex const& vertex_b
+		// Hit vertices of a sub path
+		std::uint8_t max_length(
+			BxDF::TraceMode const trace_mode
 		) const
 		{
-			// Assumes that vertices a and b are not dirac
-			Double3 const delta = vertex_b.get_point() - vertex_a.get_point();
-			Double3 const evaluate_direction = delta.normalise();
-			return
-				std::max( 0., evaluate_direction.dot( vertex_a.get_normal() ) )
-				* std::max( 0., -( evaluate_direction.dot( vertex_b.get_normal() ) ) )
-				/ ( delta.dot( delta ) );
+			return ( trace_mode == BxDF::TraceMode::Radiance ) ? max_camera_length : max_emission_length;
+		};
+
+		// Emitter of an emitter vertex
+		Emitter::Polymorphic const& light(
+			Integrator::Vertex const& vertex
+		) const
+		{
+			return *std::get<0>( scene.emitter( vertex.emitter_id ) );
 		};
 
 		struct Node
@@ -467,16 +1472,33 @@ namespace Integrator
 			bool f_dirac{ false };
 		};
 
+		// Samples taken per path by the strategy ( s, t ), Veach 259
+		// Zero (0) for strategies that are never sampled: the emitter connected to the pinhole (s=1, t=1), and sub paths
+		// longer than traced. The next event estimation (s=1) takes light_samples, all others one (1).
+		std::double_t strategy_samples(
+			std::uint8_t const s,
+			std::uint8_t const t
+		) const
+		{
+			if ( ( ( s == 1 ) && ( t == 1 ) ) || ( s > max_emission_length + 1 ) || ( t > max_camera_length + 1 ) )
+				return 0.;
+			return s == 1 ? config.light_samples : 1.;
+		};
+
+		// Multi-sample MIS, the path density of each strategy is scaled by its number of samples, Veach 259
+		// emitter replaces the start of the emission path for s=1, i.e. an extra emitter sample of the NEE
 		std::double_t Weight(
 			std::uint8_t const s,
 			std::uint8_t const t,
-			std::vector<Integrator::Vertex> const& emission_path,
-			std::vector<Integrator::Vertex> const& camera_path
+			Integrator::Path const& emission_path,
+			Integrator::Path const& camera_path,
+			Integrator::Vertex const* const emitter = nullptr
 		) const
 		{
 			std::uint8_t const k = s + t - 1;
 
-			Integrator::Vertex const& s_vertex = emission_path[s - 1];
+			Integrator::Vertex const& y0 = emitter ? *emitter : emission_path[0];
+			Integrator::Vertex const& s_vertex = s == 1 ? y0 : emission_path[s - 1];
 			Integrator::Vertex const& t_vertex = camera_path[t - 1];
 
 			// s/emission vertex
@@ -491,17 +1513,17 @@ namespace Integrator
 			{
 				if ( t_vertex.f_emitter )
 				{
-					Double3 const evaluate_direction = ( camera_path[t - 2].get_point() - t_vertex.get_point() ).normalise();
+					Double3 const& evaluate_direction = camera_path.idata( t - 1 ).from_direction;
 					auto const [emitter_pdf_W, emitter_pdf_A, emitter_cos_theta]
-						= t_vertex.ptr_light->pdf_Le( t_vertex.get_point(), evaluate_direction );
-					pdf_t_forward = emitter_pdf_A * scene.emitter_select_probability( t_vertex.ptr_material->emitter_id() );
+						= light( t_vertex ).pdf_Le( t_vertex.get_point(), evaluate_direction );
+					pdf_t_forward = emitter_pdf_A * scene.emitter_select_probability( t_vertex.emitter_id );
 					pdf_t_reverse = emitter_pdf_W / emitter_cos_theta;
 				}
 			}
 			else if ( t == 0 )
 			{
-				Double3 const& point = s_vertex.get_point();
-				Double3 const evaluate_direction = ( emission_path[s - 2].get_point() - point ).normalise();
+				Double3 const point = s_vertex.get_point();
+				Double3 const& evaluate_direction = emission_path.idata( s - 1 ).from_direction;
 				auto const [pdf_W, pdf_A, cos_theta]
 					= camera.evaluate( point, evaluate_direction );
 				pdf_s_forward = pdf_A;
@@ -509,26 +1531,28 @@ namespace Integrator
 			}
 			else
 			{
-				Double3 const& s_vertex_point = s_vertex.get_point();
-				Double3 const& t_vertex_point = t_vertex.get_point();
+				Double3 const s_vertex_point = s_vertex.get_point();
+				Double3 const t_vertex_point = t_vertex.get_point();
 
 				{
 					Double3 const evaluate_direction = ( t_vertex_point - s_vertex_point ).normalise();
 					if ( s == 1 )
 					{
-						Double3 const& vertex_normal = s_vertex.get_normal();
-						std::float_t const pdfW = s_vertex.ptr_light->pdf_W( s_vertex_point, evaluate_direction );
-						pdf_s_forward = s_vertex.ptr_light->is_dirac()
+						Double3 const vertex_normal = s_vertex.get_normal();
+						std::float_t const pdfW = light( s_vertex ).pdf_W( s_vertex_point, evaluate_direction );
+						pdf_s_forward = light( s_vertex ).is_dirac()
 							? pdfW
 							: pdfW / vertex_normal.dot( evaluate_direction );
 						pdf_s_reverse = s_vertex.pdf_reverse;
 					}
 					else
 					{
-						Double3 const& vertex_normal = s_vertex.get_normal();
-						Double3 const previous_direction = ( emission_path[s - 2].get_point() - s_vertex_point ).normalise();
-						pdf_s_forward = s_vertex.ptr_material->pdf( evaluate_direction, previous_direction, s_vertex.idata ) / vertex_normal.dot( evaluate_direction );
-						pdf_s_reverse = s_vertex.ptr_material->pdf( previous_direction, evaluate_direction, s_vertex.idata ) / vertex_normal.dot( previous_direction );
+						Double3 const vertex_normal = s_vertex.get_normal();
+						Double3 const& previous_direction = emission_path.idata( s - 1 ).from_direction;
+						BxDF::Polymorphic const& material = *scene.material( s_vertex.material_id );
+						pdf_s_forward = material.pdf( evaluate_direction, previous_direction, emission_path.idata( s - 1 ) ) / vertex_normal.dot( evaluate_direction );
+						pdf_s_reverse = camera_pdf_W( s_vertex_point, previous_direction, material.pdf( previous_direction, evaluate_direction, emission_path.idata( s - 1 ) ) )
+							/ vertex_normal.dot( previous_direction );
 					}
 				}
 
@@ -537,7 +1561,7 @@ namespace Integrator
 					if ( t == 1 )
 					{
 						// Dirac camera
-						Double3 const& vertex_normal = t_vertex.get_normal();
+						Double3 const vertex_normal = t_vertex.get_normal();
 						auto const [pdf_W, pdf_A, cos_theta]
 							= camera.evaluate( t_vertex_point, evaluate_direction );
 						pdf_t_forward = pdf_W / vertex_normal.dot( evaluate_direction );
@@ -545,10 +1569,12 @@ namespace Integrator
 					}
 					else
 					{
-						Double3 const& vertex_normal = t_vertex.get_normal();
-						Double3 const previous_direction = ( camera_path[t - 2].get_point() - t_vertex_point ).normalise();
-						pdf_t_forward = t_vertex.ptr_material->pdf( evaluate_direction, previous_direction, t_vertex.idata ) / vertex_normal.dot( evaluate_direction );
-						pdf_t_reverse = t_vertex.ptr_material->pdf( previous_direction, evaluate_direction, t_vertex.idata ) / vertex_normal.dot( previous_direction );
+						Double3 const vertex_normal = t_vertex.get_normal();
+						Double3 const& previous_direction = camera_path.idata( t - 1 ).from_direction;
+						BxDF::Polymorphic const& material = *scene.material( t_vertex.material_id );
+						pdf_t_forward = camera_pdf_W( t_vertex_point, evaluate_direction, material.pdf( evaluate_direction, previous_direction, camera_path.idata( t - 1 ) ) )
+							/ vertex_normal.dot( evaluate_direction );
+						pdf_t_reverse = material.pdf( previous_direction, evaluate_direction, camera_path.idata( t - 1 ) ) / vertex_normal.dot( previous_direction );
 					}
 				}
 			}
@@ -604,7 +1630,7 @@ namespace Integrator
 				node[s - 1].p_reverse = s == 1
 					? pdf_s_reverse
 					: pdf_s_reverse * emission_path[s - 1].G;
-				node[s - 1].f_dirac = emission_path[s - 1].f_dirac;
+				node[s - 1].f_dirac = s_vertex.f_dirac;
 			}
 
 			for ( std::uint8_t i{ 0 }; i < t - 1; ++i )
@@ -626,6 +1652,11 @@ namespace Integrator
 				node[k - ( t - 1 )].f_dirac = camera_path[t - 1].f_dirac;
 			}
 
+			// The ends of the path can be connected to, even if they are dirac, e.g. a pinhole camera or a point emitter.
+			// That they can not be hit is checked by the strategies that hit them (i == 0 and i == k).
+			node[0].f_dirac = false;
+			node[k].f_dirac = false;
+
 			// Calculate all (relative) path weights
 			std::double_t sum_path{ 1.0 }; // Self weight is one (1)
 
@@ -650,7 +1681,8 @@ namespace Integrator
 					if ( node[i].f_dirac || node[i + 1].f_dirac )
 						continue;
 				}
-				sum_path += MIS( p_k );
+				if ( std::double_t const samples = strategy_samples( i + 1, k - i ); samples > 0. )
+					sum_path += MIS( p_k * samples / strategy_samples( s, t ) );
 			}
 
 			p_k = 1.0;
@@ -664,7 +1696,7 @@ namespace Integrator
 				}
 				else if ( i == 1 )
 				{
-					if ( emission_path[0].ptr_light->is_dirac() )
+					if ( light( y0 ).is_dirac() )
 						break;
 					p_k *= node[1].p_reverse / node[0].p_reverse;
 				}
@@ -674,7 +1706,8 @@ namespace Integrator
 					if ( node[i - 1].f_dirac || node[i - 2].f_dirac )
 						continue;
 				}
-				sum_path += MIS( p_k );
+				if ( std::double_t const samples = strategy_samples( i - 1, k + 2 - i ); samples > 0. )
+					sum_path += MIS( p_k * samples / strategy_samples( s, t ) );
 			}
 
 			// Return pdf of path weights
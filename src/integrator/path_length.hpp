@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "../colour/colour.hpp"
+
+namespace Integrator
+{
+
+	// Energy of each strategy ( s, t ) and the lengths of the sub paths, recorded by a pilot at the max path length
+	// From those, separate limits for the camera and emission sub paths are chosen, the cheapest that keep the
+	// energy of the strategies they cut below a share of the total. The MIS weights are not renormalised for the
+	// cut strategies, so their energy is the bias of the limits.
+	// Not shared, each integrator records its own, merged after the pilot
+	class PathLength final
+	{
+
+	private:
+
+		// Max path length of the pilot, hit vertices per sub path
+		std::uint8_t const max_length;
+		std::uint8_t const light_samples;
+		// Strategies ( s, t ), s emission and t camera path vertices, s in [0;max_length+1] and t in [1;max_length+1]
+		std::uint32_t const stride;
+		std::vector<std::double_t> energy;
+		// Samples by the hit vertices of their camera and emission path, both in [0;max_length]
+		std::vector<std::uint64_t> n_sample;
+
+		// Extension and shadow rays per sample, for each pair of camera and emission path limits, in hit vertices
+		// A sub path cut at a limit traces min( hits, limit ), and each pair of the vertices may be connected.
+		// tail[a][b] counts the samples with at least a camera and b emission path hits.
+		static std::vector<std::double_t> cost(
+			std::vector<std::uint64_t> const& n_sample,
+			std::uint8_t const max_length,
+			std::uint8_t const light_samples
+		)
+		{
+			std::uint32_t const n = max_length + 1;
+			std::vector<std::double_t> tail( n * n, 0. );
+			for ( std::uint32_t a = n; a-- > 0; )
+				for ( std::uint32_t b = n; b-- > 0; )
+					tail[a * n + b] = static_cast<std::double_t>( n_sample[a * n + b] )
+						+ ( a + 1 < n ? tail[( a + 1 ) * n + b] : 0. )
+						+ ( b + 1 < n ? tail[a * n + b + 1] : 0. )
+						- ( ( a + 1 < n && b + 1 < n ) ? tail[( a + 1 ) * n + b + 1] : 0. );
+
+			// Extension ray and next event estimation of each camera vertex, extension ray and lens connection
+			// of each emission vertex
+			std::vector<std::double_t> camera( n, 0. );
+			std::vector<std::double_t> emission( n, 0. );
+			for ( std::uint32_t i{ 1 }; i < n; ++i )
+			{
+				camera[i] = camera[i - 1] + ( 1. + light_samples ) * tail[i * n];
+				emission[i] = emission[i - 1] + 2. * tail[i];
+			}
+
+			// Vertex pairs, summed up to both limits
+			std::vector<std::double_t> result( n * n, 0. );
+			for ( std::uint32_t a{ 1 }; a < n; ++a )
+				for ( std::uint32_t b{ 1 }; b < n; ++b )
+					result[a * n + b] = tail[a * n + b]
+						+ result[( a - 1 ) * n + b]
+						+ result[a * n + b - 1]
+						- result[( a - 1 ) * n + b - 1];
+			for ( std::uint32_t a{ 1 }; a < n; ++a )
+				for ( std::uint32_t b{ 1 }; b < n; ++b )
+					result[a * n + b] += camera[a] + emission[b];
+			return result;
+		};
+
+	public:
+
+		PathLength() = delete;
+
+		PathLength(
+			std::uint8_t const max_length,
+			std::uint8_t const light_samples
+		)
+			: max_length( max_length )
+			, light_samples( light_samples )
+			, stride( max_length + 2 )
+			, energy( stride * stride, 0. )
+			, n_sample( ( max_length + 1 ) * ( max_length + 1 ), 0 )
+		{};
+
+		// Contribution of a strategy, s emission and t camera path vertices
+		void record_contribution(
+			std::uint8_t const s,
+			std::uint8_t const t,
+			Colour const& value
+		)
+		{
+			std::double_t const strength = value.r + value.g + value.b;
+			if ( ( s < stride ) && ( t < stride ) && std::isfinite( strength ) )
+				energy[s * stride + t] += strength;
+		};
+
+		// Hit vertices of the sub paths of a sample, the emitter hit of a camera path included
+		void record_sample(
+			std::uint8_t const camera_hits,
+			std::uint8_t const emission_hits
+		)
+		{
+			std::uint32_t const a = std::min( camera_hits, max_length );
+			std::uint32_t const b = std::min( emission_hits, max_length );
+			++n_sample[a * ( max_length + 1 ) + b];
+		};
+
+		void merge(
+			PathLength const& other
+		)
+		{
+			for ( std::uint32_t i{ 0 }; i < energy.size(); ++i )
+				energy[i] += other.energy[i];
+			for ( std::uint32_t i{ 0 }; i < n_sample.size(); ++i )
+				n_sample[i] += other.n_sample[i];
+		};
+
+		// Share of the energy of all strategies of a path length, in edges, k = s + t - 1
+		std::double_t depth_share(
+			std::uint16_t const k
+		) const
+		{
+			std::double_t sum{ 0. };
+			std::double_t total{ 0. };
+			for ( std::uint32_t s{ 0 }; s < stride; ++s )
+				for ( std::uint32_t t{ 1 }; t < stride; ++t )
+				{
+					total += energy[s * stride + t];
+					if ( s + t == k + 1u )
+						sum += energy[s * stride + t];
+				}
+			return total > 0. ? sum / total : 0.;
+		};
+
+		// The cheapest camera and emission path limits, in hit vertices, that cut at most threshold of the energy
+		// Returns both limits, the share of the energy they cut, and the share of the rays they trace
+		std::tuple<std::uint8_t, std::uint8_t, std::float_t, std::float_t> tune(
+			std::float_t const threshold
+		) const
+		{
+			std::uint32_t const n = max_length + 1;
+
+			// Energy of the strategies kept by limits, s - 1 <= emission hits and t - 1 <= camera hits
+			std::vector<std::double_t> kept( stride * stride, 0. );
+			for ( std::uint32_t s{ 0 }; s < stride; ++s )
+				for ( std::uint32_t t{ 0 }; t < stride; ++t )
+					kept[s * stride + t] = energy[s * stride + t]
+						+ ( s > 0 ? kept[( s - 1 ) * stride + t] : 0. )
+						+ ( t > 0 ? kept[s * stride + t - 1] : 0. )
+						- ( ( s > 0 && t > 0 ) ? kept[( s - 1 ) * stride + t - 1] : 0. );
+			std::double_t const total = kept.back();
+
+			std::vector<std::double_t> const rays = cost( n_sample, max_length, light_samples );
+			std::double_t const full = rays.back();
+			if ( !( total > 0. ) || !( full > 0. ) )
+				return { max_length, max_length, 0.f, 1.f };
+
+			std::uint8_t camera{ max_length };
+			std::uint8_t emission{ max_length };
+			for ( std::uint32_t a{ 1 }; a < n; ++a )
+				for ( std::uint32_t b{ 1 }; b < n; ++b )
+				{
+					// Emission path limit b keeps s up to b + 1, camera path limit a keeps t up to a + 1
+					// Rounding may leave a small cut, when nothing is cut
+					std::double_t const cut = 1. - kept[( b + 1 ) * stride + a + 1] / total;
+					if ( ( cut <= threshold + 1e-9 ) && ( rays[a * n + b] < rays[camera * n + emission] ) )
+					{
+						camera = static_cast<std::uint8_t>( a );
+						emission = static_cast<std::uint8_t>( b );
+					}
+				}
+			std::float_t const cut = static_cast<std::float_t>( std::max( 0., 1. - kept[( emission + 1 ) * stride + camera + 1] / total ) );
+			return { camera, emission, cut, static_cast<std::float_t>( rays[camera * n + emission] / full ) };
+		};
+
+	};
+
+};
@@ -0,0 +1,271 @@
+// Copyright (c) 2025 Thomas Klietsch, all rights reserved.
+//
+// Licensed under the GNU Lesser General Public License, version 3.0 or later
+//
+// This program is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or ( at your option ) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General
+// Public License along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../bxdf/polymorphic.hpp"
+#include "../colour/colour.hpp"
+#include "../epsilon.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+#include "../ray/hit.hpp"
+#include "../ray/intersection.hpp"
+#include "../ray/mask.hpp"
+#include "../ray/section.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/context.hpp"
+#include "../render/feature.hpp"
+#include "../render/scene.hpp"
+#include "../render/sensor.hpp"
+
+namespace Integrator
+{
+
+	// Unidirectional path tracer
+	// Camera paths only, each diffuse vertex samples the emitters (next event estimation), and the emitters hit by
+	// BxDF sampled directions are weighted against those samples by the balance heuristic, Veach 252.
+	// One per render thread, like Integrator::BDPT it shares the scene, camera and sensor. A vertex costs its
+	// emitter samples only, instead of a connection to every emission path vertex, which suits mostly directly
+	// lit scenes.
+	class PathTracer final
+	{
+
+	private:
+
+		Render::Config const& config;
+
+		Render::Camera const& camera;
+		Render::Scene const& scene;
+		Render::Sensor& sensor;
+
+		// Scatter vertices of a path, as many as the longest BDPT path, i.e. both sub paths at the max path length
+		std::uint16_t const max_depth;
+
+		Random::Mersenne prng;
+
+		// Per tile buffers, one entry per pixel
+		std::vector<Random::Mersenne> tile_prng;
+		std::vector<Colour> tile_accumulate;
+		std::vector<Ray::Section> tile_ray;
+		std::vector<Ray::Hit> tile_hit;
+		std::vector<Render::Feature> tile_feature;
+
+		// Shadow rays of the current sample, and their contribution if unoccluded, tested in one batch
+		std::vector<Ray::Section> shadow_ray;
+		std::vector<std::double_t> shadow_distance;
+		std::vector<Colour> shadow_value;
+		Ray::Mask shadow_occluded;
+
+	public:
+
+		// Pixels per tile side, the camera rays of a tile are traced together
+		static constexpr std::uint16_t tile_size = 8;
+
+		PathTracer() = delete;
+
+		PathTracer(
+			Render::Context const& context,
+			Render::Sensor& sensor
+		)
+			: config( context.config )
+			, camera( context.camera )
+			, scene( context.scene )
+			, sensor( sensor )
+			, max_depth( 2 * context.config.max_path_length )
+		{};
+
+		// Render the samples of one pass, for a tile of pixels, [x;x+width[ and [y;y+height[
+		// Pixels have the same random sequences as with Integrator::BDPT
+		void process_tile(
+			std::uint16_t const x,
+			std::uint16_t const y,
+			std::uint16_t const width,
+			std::uint16_t const height,
+			std::uint16_t const pass = 0,
+			std::uint16_t const seed = 0
+		)
+		{
+			std::uint32_t const n_pixel = static_cast<std::uint32_t>( width ) * height;
+			tile_prng.resize( n_pixel );
+			tile_accumulate.assign( n_pixel, Colour::Black );
+			tile_ray.resize( n_pixel );
+			tile_hit.resize( n_pixel );
+			tile_feature.assign( n_pixel, Render::Feature{} );
+
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				std::uint16_t const px = x + i % width;
+				std::uint16_t const py = y + i / width;
+				// Each pass of each seed has its own random sequence, e.g. pilots render with seeds of their own
+				tile_prng[i] = Random::Mersenne( ( ( ( px + 1 ) * 0x1337 ) + ( ( py + 1 ) * 0xbeef ) )
+					^ ( ( ( static_cast<std::uint32_t>( seed ) << 16 ) | pass ) * 0x9e3779b9 ) );
+			}
+
+			for ( std::uint32_t sample{ config.pass_first_sample( pass ) }; sample < config.pass_first_sample( pass + 1 ); ++sample )
+			{
+				// Primary visibility for the whole tile
+				for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+					tile_ray[i] = camera.generate_ray( x + i % width, y + i / width, tile_prng[i] );
+				scene.intersect_packet( tile_ray, tile_hit );
+
+				for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+				{
+					prng = tile_prng[i];
+					tile_accumulate[i] += trace_sample( tile_ray[i], tile_hit[i], tile_feature[i] );
+					tile_prng[i] = prng;
+				}
+			}
+
+			for ( std::uint32_t i{ 0 }; i < n_pixel; ++i )
+			{
+				sensor.pixel( x + i % width, y + i / width, tile_accumulate[i] );
+				sensor.feature( x + i % width, y + i / width, tile_feature[i] );
+			}
+		};
+
+	private:
+
+		// One sample of a pixel, given its traced camera ray, adds the features of its first hit to feature
+		Colour trace_sample(
+			Ray::Section const& primary_ray,
+			Ray::Hit const& primary_hit,
+			Render::Feature& feature
+		)
+		{
+			shadow_ray.clear();
+			shadow_distance.clear();
+			shadow_value.clear();
+
+			Colour accumulate( Colour::Black );
+			auto const [camera_pdf_W, camera_pdf_A, camera_cos_theta]
+				= camera.evaluate( primary_ray.origin, primary_ray.direction );
+			Colour throughput = Colour::White * ( camera.We( primary_ray.origin, primary_ray.direction ) * camera_cos_theta / camera_pdf_W );
+			Ray::Section ray = primary_ray;
+			Ray::Hit hit = primary_hit;
+			// pdf_W of the direction sampled at the last vertex, and its point, zero (0) after the camera or a dirac vertex
+			std::float_t bxdf_pdf_W{ 0.f };
+			Double3 previous_point = primary_ray.origin;
+
+			for ( std::uint16_t depth{ 1 }; depth <= max_depth + 1; ++depth )
+			{
+				if ( !hit )
+					break;
+				Ray::Intersection const idata = scene.shade( ray, hit );
+				BxDF::Polymorphic const& material = *scene.material( idata.material_id );
+				if ( depth == 1 )
+					feature += Render::Feature{ material.albedo(), idata.normal_shading, static_cast<std::float_t>( ( idata.point - primary_ray.origin ).magnitude() ) };
+				auto const [bxdf_colour, bxdf_direction, bxdf_event, pdf_W, cos_theta]
+					= material.sample( idata, BxDF::TraceMode::Radiance, prng );
+
+				if ( bxdf_event == BxDF::Event::Emission )
+				{
+					// Emitters seen by the camera, or after a dirac vertex, are not sampled by the emitters
+					auto const [p_emitter, select_probability] = scene.emitter( material.emitter_id() );
+					Colour const emission = p_emitter->radiance( idata.point, idata.from_direction );
+					if ( bxdf_pdf_W > 0.f )
+					{
+						Double3 const delta = idata.point - previous_point;
+						std::double_t const cos_emitter = idata.normal_shading.dot( idata.from_direction );
+						std::double_t const pdf_bxdf = bxdf_pdf_W * cos_emitter / delta.dot( delta );
+						std::double_t const pdf_emitter = config.light_samples * select_probability * p_emitter->pdf_A( idata.point, idata.from_direction );
+						if ( ( cos_emitter > 0. ) && ( pdf_bxdf > 0. ) )
+							accumulate += throughput * emission * static_cast<std::float_t>( pdf_bxdf / ( pdf_bxdf + pdf_emitter ) );
+					}
+					else
+						accumulate += throughput * emission;
+					break;
+				}
+				if ( ( bxdf_event != BxDF::Event::Diffuse ) && ( bxdf_event != BxDF::Event::Reflect ) )
+					break;
+				if ( depth > max_depth )
+					break;
+
+				if ( bxdf_event == BxDF::Event::Diffuse )
+				{
+					for ( std::uint8_t j{ 0 }; j < config.light_samples; ++j )
+						sample_emitter( idata, material, throughput );
+					if ( !( pdf_W > 0.f ) )
+						break;
+					throughput *= bxdf_colour * ( cos_theta / pdf_W );
+					bxdf_pdf_W = pdf_W;
+				}
+				else
+				{
+					throughput *= bxdf_colour;
+					bxdf_pdf_W = 0.f;
+				}
+				previous_point = idata.point;
+				ray = Ray::Section( idata.point, bxdf_direction, idata.normal_geometry, idata.error );
+				hit = scene.intersect( ray );
+			}
+
+			// The visibility of the emitter samples, is evaluated in one batch
+			scene.occluded_each( shadow_ray, shadow_distance, shadow_occluded, config.interleaved_queries );
+			for ( std::uint32_t i{ 0 }; i < shadow_ray.size(); ++i )
+				if ( !shadow_occluded.test( i ) )
+					accumulate += shadow_value[i];
+
+			return accumulate;
+		};
+
+		// Next event estimation, one emitter sample for a diffuse vertex, appended to the shadow rays
+		// Weighted against the emitter hits by the balance heuristic, counting all light_samples of the vertex
+		void sample_emitter(
+			Ray::Intersection const& idata,
+			BxDF::Polymorphic const& material,
+			Colour const& throughput
+		)
+		{
+			std::uint32_t const emitter_id = scene.random_emitter( prng );
+			auto const [p_emitter, select_probability] = scene.emitter( emitter_id );
+			auto const [emitter_energy, emitter_point, emitter_direction, emitter_normal, emitter_pdf_W, emitter_pdf_A, emitter_cos_theta]
+				= p_emitter->emit( prng );
+			Double3 const delta = emitter_point - idata.point;
+			std::double_t const distance = delta.magnitude();
+			if ( distance <= Ray::min_distance( idata.error, p_emitter->surface_error() ) )
+				return;
+			Double3 const direction = delta / distance;
+			std::double_t const cos_vertex = idata.normal_shading.dot( direction );
+			std::double_t const cos_emitter = p_emitter->is_dirac() ? 1. : -emitter_normal.dot( direction );
+			if ( ( cos_vertex < EPSILON_COS_THETA ) || ( cos_emitter < EPSILON_COS_THETA ) )
+				return;
+			std::double_t const pdf_emitter = select_probability * emitter_pdf_A;
+			std::double_t const pdf_bxdf = p_emitter->is_dirac()
+				? 0.
+				: material.pdf( direction, idata.from_direction, idata ) * cos_emitter / ( distance * distance );
+			Colour const value = throughput
+				* p_emitter->radiance( emitter_point, -direction )
+				* material.factor( direction, idata.from_direction, idata, BxDF::TraceMode::Radiance )
+				* static_cast<std::float_t>( cos_vertex * cos_emitter / ( distance * distance ) / ( config.light_samples * pdf_emitter + pdf_bxdf ) );
+			if ( !( std::max( { value.r, value.g, value.b } ) > 0.f ) )
+				return;
+			auto const [edge_ray, edge_distance] = Ray::connect( idata.point, idata.normal_geometry, idata.error,
+				emitter_point, emitter_normal, p_emitter->surface_error() );
+			shadow_ray.emplace_back( edge_ray );
+			shadow_distance.emplace_back( edge_distance );
+			shadow_value.emplace_back( value );
+		};
+
+	};
+
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../bxdf/polymorphic.hpp"
+#include "../colour/colour.hpp"
+#include "../epsilon.hpp"
+#include "../geometry/bound.hpp"
+#include "../mathematics/double3.hpp"
+#include "../random/mersenne.hpp"
+#include "../ray/intersection.hpp"
+#include "../ray/section.hpp"
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/scene.hpp"
+
+namespace Integrator
+{
+
+	// Radiance reflected by diffuse surfaces, on a spatial hash of the scene, learned before rendering
+	// Cells are keyed by their position, on a grid over the scene, and the main axis of the normal, so both sides of
+	// a wall are apart. Camera paths end at the cache beyond a depth, see Integrator::BDPT, which trades the noise
+	// and cost of the long diffuse tails for a bias bounded by the cell size. Cells that were not learned are black.
+	// Lookups are jittered in the tangent plane, by up to half a cell, which blurs the cell borders.
+	// Sharc: spatially hashed radiance cache, Nvidia, 2024
+	class RadianceCache final
+	{
+
+	private:
+
+		// Cells per axis, along the largest extent of the scene
+		static constexpr std::uint32_t n_cell{ 64 };
+		// Hash table entries, and the entries probed for a key
+		static constexpr std::uint32_t n_entry{ 1u << 18 };
+		static constexpr std::uint32_t max_probe{ 16 };
+
+		// Zero (0) for an empty entry, the key of a cell has its top bit set
+		struct Entry
+		{
+			std::uint64_t key{ 0 };
+			std::float_t r{ 0.f };
+			std::float_t g{ 0.f };
+			std::float_t b{ 0.f };
+			std::uint32_t count{ 0 };
+		};
+
+		Double3 bound_min;
+		std::double_t cell_size;
+
+		std::vector<Entry> entry;
+
+		std::uint64_t key(
+			Double3 const& point,
+			Double3 const& normal
+		) const
+		{
+			Double3 const offset = ( point - bound_min ) / cell_size;
+			std::uint64_t const x = static_cast<std::uint64_t>( std::clamp( offset.x, 0., 524287. ) );
+			std::uint64_t const y = static_cast<std::uint64_t>( std::clamp( offset.y, 0., 524287. ) );
+			std::uint64_t const z = static_cast<std::uint64_t>( std::clamp( offset.z, 0., 524287. ) );
+			// Main axis of the normal, and its sign
+			std::double_t const ax = std::abs( normal.x );
+			std::double_t const ay = std::abs( normal.y );
+			std::double_t const az = std::abs( normal.z );
+			std::uint64_t const axis = ( ax >= ay && ax >= az )
+				? ( normal.x > 0. ? 0 : 1 )
+				: ( ay >= az ? ( normal.y > 0. ? 2 : 3 ) : ( normal.z > 0. ? 4 : 5 ) );
+			return ( 1ull << 63 ) | ( axis << 57 ) | ( z << 38 ) | ( y << 19 ) | x;
+		};
+
+		// Entry of a key, inserted if absent, or UINT32_MAX if the probed entries are taken
+		std::uint32_t find(
+			std::uint64_t const value,
+			bool const f_insert
+		)
+		{
+			std::uint32_t index = static_cast<std::uint32_t>( ( value * 0x9e3779b97f4a7c15ull ) >> 46 );
+			for ( std::uint32_t probe{ 0 }; probe < max_probe; ++probe, index = ( index + 1 ) & ( n_entry - 1 ) )
+			{
+				std::atomic_ref<std::uint64_t> current( entry[index].key );
+				std::uint64_t stored = current.load( std::memory_order_relaxed );
+				if ( stored == value )
+					return index;
+				if ( stored != 0 )
+					continue;
+				if ( !f_insert )
+					return UINT32_MAX;
+				if ( current.compare_exchange_strong( stored, value, std::memory_order_relaxed ) || ( stored == value ) )
+					return index;
+			}
+			return UINT32_MAX;
+		};
+
+		std::uint32_t find(
+			std::uint64_t const value
+		) const
+		{
+			return const_cast<RadianceCache*>( this )->find( value, false );
+		};
+
+		// Radiance reflected at a point, may be called by several threads at once
+		void record(
+			Double3 const& point,
+			Double3 const& normal,
+			Colour const& radiance
+		)
+		{
+			if ( !std::isfinite( radiance.r + radiance.g + radiance.b ) )
+				return;
+			std::uint32_t const index = find( key( point, normal ), true );
+			if ( index == UINT32_MAX )
+				return;
+			std::atomic_ref<std::float_t>( entry[index].r ).fetch_add( radiance.r, std::memory_order_relaxed );
+			std::atomic_ref<std::float_t>( entry[index].g ).fetch_add( radiance.g, std::memory_order_relaxed );
+			std::atomic_ref<std::float_t>( entry[index].b ).fetch_add( radiance.b, std::memory_order_relaxed );
+			std::atomic_ref<std::uint32_t>( entry[index].count ).fetch_add( 1, std::memory_order_relaxed );
+		};
+
+	public:
+
+		RadianceCache() = delete;
+
+		RadianceCache(
+			Geometry::Bound const& bound
+		)
+			: entry( n_entry )
+		{
+			Double3 const extent = Double3( bound.extent() );
+			cell_size = std::max( { extent.x, extent.y, extent.z, 1e-3 } ) / n_cell;
+			bound_min = Double3( bound.min ) - Double3( 1., 1., 1. ) * cell_size;
+		};
+
+		// Trace camera paths with next event estimation, and record the radiance reflected at each diffuse vertex
+		// That is the radiance of the rest of the path, with the emitter hits and the emitter samples weighted by
+		// the balance heuristic. Paths are traced twice the max path length, and only the vertices of the first half are
+		// recorded, so each has the max path length after it, like the tails it stands in for.
+		// Must be called before rendering, each path has a random sequence of its own.
+		void learn(
+			Render::Scene const& scene,
+			Render::Camera const& camera,
+			Render::Config const& config
+		)
+		{
+#pragma omp parallel
+			{
+				// Per vertex, the radiance it reflects from emitter samples, and the factor on the radiance
+				// arriving from the next vertex
+				std::vector<Colour> direct;
+				std::vector<Colour> weight;
+				std::vector<Ray::Intersection> vertex;
+				std::vector<bool> f_diffuse;
+#pragma omp for schedule( dynamic, 256 )
+				for ( std::int64_t path = 0; path < config.radiance_cache_paths; ++path )
+				{
+					Random::Mersenne prng( static_cast<std::uint32_t>( path ) * 0x9e3779b9u + 1 );
+					std::uint16_t const x = static_cast<std::uint16_t>( prng.get_integer() % config.image_width );
+					std::uint16_t const y = static_cast<std::uint16_t>( prng.get_integer() % config.image_height );
+					Ray::Section ray = camera.generate_ray( x, y, prng );
+					direct.clear();
+					weight.clear();
+					vertex.clear();
+					f_diffuse.clear();
+					// Emission of the emitter that ends the path
+					Colour end( Colour::Black );
+					// pdf_W of the direction sampled at the last vertex, zero (0) after a dirac vertex
+					std::float_t bxdf_pdf_W{ 0.f };
+
+					for ( std::uint16_t depth{ 1 }; depth <= 2 * config.max_path_length; ++depth )
+					{
+						Ray::Hit const hit = scene.intersect( ray );
+						if ( !hit )
+							break;
+						Ray::Intersection const idata = scene.shade( ray, hit );
+						BxDF::Polymorphic const& material = *scene.material( idata.material_id );
+						auto const [bxdf_colour, bxdf_direction, bxdf_event, pdf_W, cos_theta] = material.sample( idata, BxDF::TraceMode::Radiance, prng );
+
+						if ( bxdf_event == BxDF::Event::Emission )
+						{
+							// Camera rays that see an emitter do not reflect it
+							if ( !vertex.empty() )
+							{
+								auto const [p_emitter, select_probability] = scene.emitter( material.emitter_id() );
+								Double3 const delta = idata.point - vertex.back().point;
+								std::double_t const cos_emitter = idata.normal_shading.dot( idata.from_direction );
+								// Dirac vertices have no emitter sample to share the hit with
+								std::double_t const pdf_bxdf = bxdf_pdf_W * cos_emitter / delta.dot( delta );
+								std::double_t const pdf_emitter = f_diffuse.back()
+									? select_probability * p_emitter->pdf_A( idata.point, idata.from_direction )
+									: 0.;
+								if ( ( cos_emitter > 0. ) && ( !f_diffuse.back() || ( pdf_bxdf > 0. ) ) )
+									end = p_emitter->radiance( idata.point, idata.from_direction )
+										* static_cast<std::float_t>( f_diffuse.back() ? pdf_bxdf / ( pdf_bxdf + pdf_emitter ) : 1. );
+							}
+							break;
+						}
+						if ( ( bxdf_event != BxDF::Event::Diffuse ) && ( bxdf_event != BxDF::Event::Reflect ) )
+							break;
+						bool const f_vertex_diffuse = bxdf_event == BxDF::Event::Diffuse;
+
+						Colour reflected( Colour::Black );
+						if ( f_vertex_diffuse )
+						{
+							// Next event estimation, one emitter sample
+							std::uint32_t const emitter_id = scene.random_emitter( prng );
+							auto const [p_emitter, select_probability] = scene.emitter( emitter_id );
+							auto const [emitter_energy, emitter_point, emitter_direction, emitter_normal, emitter_pdf_W, emitter_pdf_A, emitter_cos_theta]
+								= p_emitter->emit( prng );
+							Double3 const delta = emitter_point - idata.point;
+							std::double_t const distance = delta.magnitude();
+							if ( distance > Ray::min_distance( idata.error, p_emitter->surface_error() ) )
+							{
+								Double3 const direction = delta / distance;
+								std::double_t const cos_vertex = idata.normal_shading.dot( direction );
+								std::double_t const cos_emitter = p_emitter->is_dirac() ? 1. : -emitter_normal.dot( direction );
+								auto const [edge_ray, edge_distance] = Ray::connect( idata.point, idata.normal_geometry, idata.error,
+									emitter_point, emitter_normal, p_emitter->surface_error() );
+								if ( ( cos_vertex > EPSILON_COS_THETA ) && ( cos_emitter > EPSILON_COS_THETA )
+									&& !scene.occluded( edge_ray, edge_distance ) )
+								{
+									std::double_t const pdf_emitter = select_probability * emitter_pdf_A;
+									std::double_t const pdf_bxdf = p_emitter->is_dirac()
+										? 0.
+										: material.pdf( direction, idata.from_direction, idata ) * cos_emitter / ( distance * distance );
+									reflected = p_emitter->radiance( emitter_point, -direction )
+										* material.factor( direction, idata.from_direction, idata, BxDF::TraceMode::Radiance )
+										* static_cast<std::float_t>( cos_vertex * cos_emitter / ( distance * distance ) / ( pdf_emitter + pdf_bxdf ) );
+								}
+							}
+						}
+						if ( f_vertex_diffuse && !( pdf_W > 0.f ) )
+							break;
+						direct.emplace_back( reflected );
+						weight.emplace_back( f_vertex_diffuse ? bxdf_colour * ( cos_theta / pdf_W ) : bxdf_colour );
+						vertex.emplace_back( idata );
+						f_diffuse.emplace_back( f_vertex_diffuse );
+						bxdf_pdf_W = f_vertex_diffuse ? pdf_W : 0.f;
+						ray = Ray::Section( idata.point, bxdf_direction, idata.normal_geometry, idata.error );
+					}
+
+					// Radiance leaving each vertex towards the one before, from the end of the path
+					Colour radiance = end;
+					for ( std::size_t i = vertex.size(); i-- > 0; )
+					{
+						radiance = direct[i] + weight[i] * radiance;
+						if ( f_diffuse[i] && ( i < config.max_path_length ) )
+							record( vertex[i].point, vertex[i].normal_shading, radiance );
+					}
+				}
+			}
+		};
+
+		// Radiance reflected at a diffuse point, towards any direction, black if its cell was not learned
+		Colour radiance(
+			Ray::Intersection const& idata,
+			Random::Mersenne& prng
+		) const
+		{
+			// Jitter in the tangent plane, falls back to the cell of the point itself
+			Double3 const jitter = idata.orthogonal.to_world( Double3( prng.get_float() - 0.5, prng.get_float() - 0.5, 0. ) ) * cell_size;
+			std::uint32_t index = find( key( idata.point + jitter, idata.normal_shading ) );
+			if ( ( index == UINT32_MAX ) || ( entry[index].count == 0 ) )
+				index = find( key( idata.point, idata.normal_shading ) );
+			if ( ( index == UINT32_MAX ) || ( entry[index].count == 0 ) )
+				return Colour::Black;
+			Entry const& value = entry[index];
+			return Colour( value.r, value.g, value.b ) / static_cast<std::float_t>( value.count );
+		};
+
+	};
+
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "../integrator/vertex.hpp"
+#include "../random/mersenne.hpp"
+
+namespace Integrator
+{
+
+	// Weighted reservoir of emitter samples, for the first camera path vertex of a pixel
+	// Candidates are streamed in, and one survives in proportion to its resampling weight. The contribution weight
+	// W of the survivor y makes f( y ) W an unbiased estimate of the integral of f, also once reservoirs of other
+	// pixels, or of the previous sample, are merged into it, see Integrator::BDPT::resample_tile
+	// Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting, Bitterli et al., 2020
+	struct Reservoir
+	{
+		// Surviving emitter vertex
+		Integrator::Vertex sample;
+		// Target function of the survivor, for the vertex of the reservoir
+		std::float_t target{ 0.f };
+		// Sum of the resampling weights
+		std::float_t w_sum{ 0.f };
+		// Candidates seen, a merged reservoir adds its own
+		std::uint32_t M{ 0 };
+		// Contribution weight of the survivor, zero (0) without one
+		std::float_t W{ 0.f };
+
+		// Streams in a candidate, with its resampling weight and target function, counted as count candidates
+		void update(
+			Integrator::Vertex const& candidate,
+			std::float_t const weight,
+			std::float_t const candidate_target,
+			std::uint32_t const count,
+			Random::Mersenne& prng
+		)
+		{
+			M += count;
+			if ( !( weight > 0.f ) || !std::isfinite( weight ) )
+				return;
+			w_sum += weight;
+			if ( prng.get_float() * w_sum < weight )
+			{
+				sample = candidate;
+				target = candidate_target;
+			}
+		};
+
+	};
+
+};
@@ -1,36 +1,50 @@
 #pragma once
 
-#include "../bxdf/polymorphic.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
 #include "../colour/colour.hpp"
-#include "../emitter/polymorphic.hpp"
+#include "../geometry/precision.hpp"
 #include "../mathematics/double3.hpp"
+#include "../mathematics/octahedral.hpp"
 #include "../ray/intersection.hpp"
+#include "../ray/section.hpp"
 
 namespace Integrator
 {
 
 	// Storage for path traced vertices
+	// Only the data used by connections and MIS weights, the full intersection data is kept in Integrator::Path
 	struct Vertex
 	{
 
-		Ray::Intersection idata;
-
+		// First, so an aligned Colour (MATH_SIMD) does not pad the vertex
 		Colour throughput;
 
+		// In geometry precision, a connection ray leaving it has the offset of that precision, see epsilon.hpp
+		Geometry::Vector point;
+		// Normal of the orthogonal space, i.e. the shading normal
+		Octahedral normal;
+
 		std::float_t pdf_forward;
 		std::float_t pdf_reverse;
 
-		std::double_t G{ 1. };
+		std::float_t G{ 1.f };
+
+		// Distance along the normal, within which the surface of point lies, see Geometry::surface_error
+		std::float_t error{ 0.f };
+
+		// Index into the scene materials and emitters
+		std::uint32_t material_id{ UINT32_MAX };
+		std::uint32_t emitter_id{ UINT32_MAX }; // If used, but not set correctly, will throw a std::overflow_error
 
 		bool f_dirac;
 		bool f_emitter;
 		// Note: only dirac camera is implemented
 		bool f_camera;
 
-		Emitter::Polymorphic* ptr_light{ nullptr };
-		std::uint32_t emitter_id{ UINT32_MAX }; // If used, but not set correctly, will throw a std::overflow_error
-		BxDF::Polymorphic* ptr_material{ nullptr };
-
 		Vertex() = default;
 
 		Vertex(
@@ -42,19 +56,88 @@ namespace Integrator
 			bool const f_emitter,
 			bool const f_camera = false
 		)
-			: idata( idata )
-			, throughput( throughput )
+			: throughput( throughput )
+			, point( idata.point )
+			, normal( idata.orthogonal.normal() )
 			, pdf_forward( pdf_forward )
 			, pdf_reverse( pdf_reverse )
+			, error( static_cast<std::float_t>( idata.error ) )
+			, material_id( idata.material_id )
 			, f_dirac( f_dirac )
 			, f_emitter( f_emitter )
 			, f_camera( f_camera ) // See note above
 		{};
 
 		// TODO dirac
-		Double3 const& get_normal() const { return idata.orthogonal.normal(); };
+		Double3 get_normal() const { return normal.decode(); };
+
+		Double3 get_point() const { return Double3( point ); };
+
+	};
+
+	// Geometric term without visibility, Veach 8.3
+	// cos_a * cos_b / d^2, with the cosines taken against the unnormalised delta, i.e. ( delta.n_a ) ( -delta.n_b ) / d^4
+	// Assumes that vertices a and b are not dirac
+	inline std::double_t Gprime(
+		Integrator::Vertex const& vertex_a,
+		Integrator::Vertex const& vertex_b
+	)
+	{
+		Double3 const delta = vertex_b.get_point() - vertex_a.get_point();
+		std::double_t const distance2 = delta.dot( delta );
+		return
+			std::max( 0., delta.dot( vertex_a.get_normal() ) )
+			* std::max( 0., -( delta.dot( vertex_b.get_normal() ) ) )
+			/ ( distance2 * distance2 );
+	};
+
+	// Shadow ray from vertex_a to vertex_b, and the distance to test it for occlusion, see Ray::connect
+	inline std::tuple<Ray::Section, std::double_t> connect_vertices(
+		Integrator::Vertex const& vertex_a,
+		Integrator::Vertex const& vertex_b
+	)
+	{
+		return Ray::connect( vertex_a.get_point(), vertex_a.get_normal(), vertex_a.error,
+			vertex_b.get_point(), vertex_b.get_normal(), vertex_b.error );
+	};
+
+	// Sub path, vertices and their intersection data in separate arrays
+	// The vertices are read by every connection and weight, the intersection data only by material evaluations
+	class Path final
+	{
+
+	private:
+
+		std::vector<Integrator::Vertex> vertex;
+		std::vector<Ray::Intersection> intersection;
+
+	public:
+
+		// Keeps allocated memory, paths are reused for every sample
+		void clear()
+		{
+			vertex.clear();
+			intersection.clear();
+		};
+
+		void emplace_back(
+			Integrator::Vertex const& value,
+			Ray::Intersection const& idata
+		)
+		{
+			vertex.emplace_back( value );
+			intersection.emplace_back( idata );
+		};
+
+		std::size_t size() const { return vertex.size(); };
+
+		Integrator::Vertex const& operator [] ( std::size_t const index ) const { return vertex[index]; };
+		Integrator::Vertex& operator [] ( std::size_t const index ) { return vertex[index]; };
+
+		Integrator::Vertex const& back() const { return vertex.back(); };
 
-		Double3 const& get_point() const { return idata.point; };
+		// Intersection data of a vertex
+		Ray::Intersection const& idata( std::size_t const index ) const { return intersection[index]; };
 
 	};
 
@@ -15,29 +15,104 @@
 // You should have received a copy of the GNU Lesser General
 // Public License along with this program.If not, see < https://www.gnu.org/licenses/>. 
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <omp.h>
 
+#include "./guiding/sd_tree.hpp"
+#include "./integrator/adrrs.hpp"
 #include "./integrator/bdpt.hpp"
+#include "./integrator/path_length.hpp"
+#include "./integrator/path_tracer.hpp"
+#include "./integrator/radiance_cache.hpp"
 #include "./random/mersenne.hpp"
 #include "./render/camera.hpp"
 #include "./render/config.hpp"
+#include "./render/context.hpp"
+#include "./render/denoise.hpp"
 #include "./render/save_image.hpp"
 #include "./render/scene.hpp"
 #include "./render/sensor.hpp"
+#include "./render/topology.hpp"
 
-int main( int argc, char* argv[] )
+// Render time of the pilot config, times the variance of a pixel, by integrators that make returns for a sensor
+// The variance is estimated from the difference of two independent images, rendered with the seeds seed and
+// seed + 1. The integrator with the lower cost needs less time for the same noise.
+template<typename Make>
+std::double_t pilot_cost(
+	Render::Config const& config,
+	int const tile_size,
+	std::uint16_t const seed,
+	Make const& make
+)
 {
-	Render::Config const config(
-		400, // image width
-		400, // image height
-		25, // samples per pixel
-		5 // max path trace depth
-	);
+	int const n_tile_x = ( config.image_width + tile_size - 1 ) / tile_size;
+	int const n_tile_y = ( config.image_height + tile_size - 1 ) / tile_size;
+	Render::Sensor sensor_a( config );
+	Render::Sensor sensor_b( config );
+
+	std::chrono::steady_clock::time_point const start_time = std::chrono::steady_clock::now();
+#pragma omp parallel
+	{
+		auto const pilot_a = make( sensor_a );
+		auto const pilot_b = make( sensor_b );
+#pragma omp for schedule( dynamic )
+		for ( int tile = 0; tile < n_tile_x * n_tile_y; ++tile )
+		{
+			int const x = ( tile % n_tile_x ) * tile_size;
+			int const y = ( tile / n_tile_x ) * tile_size;
+			int const width = std::min( tile_size, config.image_width - x );
+			int const height = std::min( tile_size, config.image_height - y );
+			pilot_a->process_tile( x, y, width, height, 0, seed );
+			pilot_b->process_tile( x, y, width, height, 0, seed + 1 );
+		}
+	}
+	std::double_t const seconds = std::chrono::duration<std::double_t>( std::chrono::steady_clock::now() - start_time ).count();
 
-	Render::Sensor sensor( config );
+	// Each image has half the samples, Var( a - b ) = 2 Var( a ), i.e. four (4) times the variance of their mean
+	std::double_t variance{ 0. };
+	for ( std::uint16_t y{ 0 }; y < config.image_height; ++y )
+		for ( std::uint16_t x{ 0 }; x < config.image_width; ++x )
+		{
+			Colour const delta = sensor_a.get_colour( x, y ) + sensor_b.get_colour( x, y ) * -1.f;
+			variance += ( delta.r * delta.r + delta.g * delta.g + delta.b * delta.b ) / 4.;
+		}
+	return seconds * variance / ( static_cast<std::double_t>( config.image_width ) * config.image_height );
+};
+
+int main( int argc, char* argv[] )
+{
+	// Settings by name, clamped to their valid ranges
+	Render::Config const config = Render::Config{
+		.image_width = 400,
+		.image_height = 400,
+		.max_samples = 25, // samples per pixel
+		.max_path_length = 5, // max path trace depth
+		.passes = 1, // progressive passes
+		.f_lazy_hierarchy = false, // lazy scene hierarchy
+		.spatial_split_budget = 0.5f, // spatial split memory budget, relative to the object count
+		.f_wavefront = false, // wavefront path tracing, the paths of a tile are traced stage by stage
+		.interleaved_queries = 0, // scene queries in flight per thread, interleaved to hide memory latency on large scenes
+		.f_numa = false, // pin threads to cores, and copy scene and sensor per NUMA node
+		.thread_placement = Render::Topology::Placement::Spread, // pinned threads spread over the nodes, or compact to fill node 0 first
+		.emission_guide_paths = 0, // camera paths to learn the emission direction of each emitter, zero (0) for cosine weighted
+		.f_path_guiding = false, // guide camera paths by the radiance learned in earlier passes
+		.light_samples = 1, // emitter samples per camera path vertex, next event estimation
+		.shadow_threshold = 0.f, // contribution below which shadow rays are Russian rouletted, zero (0) tests all
+		.adrrs_samples = 0, // samples per pixel of a prepass steering roulette and splitting of the sub paths, zero (0) for none
+		.path_length_samples = 0, // samples per pixel of a pilot tuning the camera and emission path lengths, zero (0) for the max path length
+		.truncation_error = 0.01f, // share of the energy the tuned path lengths may cut
+		.restir_candidates = 0, // emitter candidates per sample resampled for the first camera vertex (ReSTIR), zero (0) for none
+		.restir_history = 0, // reuse of the previous sample's reservoir, in candidates of a sample, zero (0) for none
+		.radiance_cache_depth = 0, // depth from which camera paths end at the radiance cache of diffuse surfaces, zero (0) for none
+		.radiance_cache_paths = 1000000, // camera paths to learn the radiance cache
+		.technique = Render::Config::Technique::BDPT, // light transport algorithm, or automatic to choose by a pilot
+		.technique_samples = 2, // samples per pixel of each pilot image of the automatic choice
+		.f_denoise = false, // denoise the image after the render
+		.image_format = Render::Config::ImageFormat::TGA // image file format, TGA, or PFM and EXR that keep the full range
+	}.validate();
 
 	// Cornell camera, coordinates for world up using the z axis
 	Render::Camera const camera(
@@ -47,38 +122,284 @@ int main( int argc, char* argv[] )
 		config
 	);
 
-	Render::Scene const scene;
-	if ( !scene.is_valid() )
+	// One copy (replica) of scene and sensor per NUMA node, or a single one shared by all threads
+	// Each copy is built by the first thread on its node, so its memory is local to that node (first touch)
+	Render::Topology const topology;
+	int const n_thread = omp_get_max_threads();
+	std::uint32_t const n_replica = config.f_numa ? topology.node_count() : 1;
+	std::vector<int> replica_builder( n_replica, -1 );
+	for ( int thread = 0; thread < n_thread; ++thread )
+	{
+		std::uint32_t const replica = config.f_numa ? topology.thread_node( thread, config.thread_placement ) : 0;
+		if ( replica_builder[replica] < 0 )
+			replica_builder[replica] = thread;
+	}
+	if ( config.f_numa )
+	{
+		std::cout << "Threads: " << n_thread << ", pinned on " << topology.cpu_count() << " cores of " << n_replica << " NUMA node(s)." << std::endl;
+		for ( int thread = 0; thread < n_thread; ++thread )
+			std::cout << "Thread " << thread << ": core " << topology.thread_cpu( thread, config.thread_placement )
+				<< ", node " << topology.thread_node( thread, config.thread_placement ) << std::endl;
+	}
+
+	std::vector<std::unique_ptr<Render::Scene>> scene( n_replica );
+	std::vector<std::unique_ptr<Render::Sensor>> sensor( n_replica );
+	std::vector<std::unique_ptr<Render::Context>> context( n_replica );
+	// Path guiding, one tree learned from all threads and refined between passes
+	std::unique_ptr<Guiding::SDTree> guide;
+	// Russian roulette and splitting, estimated by a prepass
+	std::unique_ptr<Integrator::ADRRS> adrrs;
+	// Radiance of diffuse surfaces, learned before rendering
+	std::unique_ptr<Integrator::RadianceCache> radiance_cache;
+	// Integrator for each thread
+	std::vector<std::unique_ptr<Integrator::BDPT>> integrator( n_thread );
+	std::vector<std::unique_ptr<Integrator::PathTracer>> path_tracer( n_thread );
+
+	std::chrono::steady_clock::time_point const scene_time = std::chrono::steady_clock::now();
+	// Time to learn the emission guide on the first copy of the scene, and to copy it to the others
+	std::chrono::steady_clock::duration learn_time{ 0 };
+	std::chrono::steady_clock::duration copy_time{ 0 };
+#pragma omp parallel
+	{
+		int const thread = omp_get_thread_num();
+		std::uint32_t const replica = config.f_numa ? topology.thread_node( thread, config.thread_placement ) : 0;
+		// Thread numbers stay with the same pinned thread, as long as the team size does not change
+		if ( config.f_numa )
+			Render::Topology::pin( topology.thread_cpu( thread, config.thread_placement ) );
+		if ( replica_builder[replica] == thread )
+		{
+			scene[replica] = std::make_unique<Render::Scene>( config.f_lazy_hierarchy, config.spatial_split_budget );
+			sensor[replica] = std::make_unique<Render::Sensor>( config );
+			// Read only, shared by the threads of the node
+			context[replica] = std::make_unique<Render::Context>( config, camera, *scene[replica] );
+			if ( config.f_path_guiding && replica == 0 )
+				guide = std::make_unique<Guiding::SDTree>( scene[replica]->bound() );
+			if ( config.adrrs_samples > 0 && replica == 0 )
+				adrrs = std::make_unique<Integrator::ADRRS>( scene[replica]->bound(), config.image_width, config.image_height );
+			if ( config.radiance_cache_depth > 0 && replica == 0 )
+				radiance_cache = std::make_unique<Integrator::RadianceCache>( scene[replica]->bound() );
+		}
+		// The emission guide is learned once, and each other copy of the scene takes it on its own node
+#pragma omp barrier
+		if ( config.emission_guide_paths > 0 && replica == 0 && replica_builder[replica] == thread )
+		{
+			std::chrono::steady_clock::time_point const learn_start = std::chrono::steady_clock::now();
+			scene[replica]->learn_emission( camera, config );
+			learn_time = std::chrono::steady_clock::now() - learn_start;
+		}
+#pragma omp barrier
+		if ( config.emission_guide_paths > 0 && replica > 0 && replica_builder[replica] == thread )
+		{
+			std::chrono::steady_clock::time_point const copy_start = std::chrono::steady_clock::now();
+			scene[replica]->copy_emission( *scene[0] );
+#pragma omp critical
+			copy_time = std::max( copy_time, std::chrono::steady_clock::now() - copy_start );
+		}
+#pragma omp barrier
+		integrator[thread] = std::make_unique<Integrator::BDPT>( *context[replica], *sensor[replica], guide.get(), adrrs.get(), nullptr, radiance_cache.get() );
+		path_tracer[thread] = std::make_unique<Integrator::PathTracer>( *context[replica], *sensor[replica] );
+	}
+	if ( config.emission_guide_paths > 0 )
+		std::cout << "Emission guide: learned in " << std::chrono::duration_cast<std::chrono::milliseconds>( learn_time ).count()
+			<< " millie seconds, copied to " << n_replica - 1 << " more node(s) in "
+			<< std::chrono::duration_cast<std::chrono::microseconds>( copy_time ).count() << " micro seconds." << std::endl;
+	std::cout << "Scene time: " << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - scene_time ).count() << " millie seconds." << std::endl;
+	if ( !scene[0]->is_valid() )
 	{
 		std::cout << "Nothing to render, no light and/or object(s)." << std::endl;
 		return EXIT_FAILURE;
 	}
-
-	// Create an integrator for each thread
-	std::vector<std::unique_ptr<Integrator::BDPT>> integrator;
-	for ( std::uint8_t i{ 0 }; i < omp_get_max_threads(); ++i )
-		integrator.emplace_back( std::make_unique<Integrator::BDPT>( camera, sensor, scene, config ) );
+	// Learned before any integrator traces a path
+	if ( radiance_cache )
+	{
+		std::chrono::steady_clock::time_point const cache_time = std::chrono::steady_clock::now();
+		radiance_cache->learn( *scene[0], camera, config );
+		std::cout << "Radiance cache time: " << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - cache_time ).count() << " millie seconds." << std::endl;
+	}
 
 	std::cout << "\033[32mRender start\033[0m" << std::endl; // Green text, such luxury. XD
 	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
-	// Lazy arse parallel processing. This is terrible. xD
-#pragma omp parallel for
-	for ( int y= 0 ; y < config.image_height; ++y )
-		for ( int x= 0; x < config.image_width; ++x )
+	// Seeds of the random sequences of the pilots and the prepass, apart from the render passes (seed 0)
+	std::uint16_t const adrrs_seed{ 1 };
+	std::uint16_t const path_length_seed{ 2 };
+	// The technique pilot renders two images, with this seed and the next
+	std::uint16_t const technique_seed{ 3 };
+
+	// The pilots and the prepass of the BDPT run before the technique pilot, so it compares the BDPT as configured
+	bool const f_bdpt_possible{ config.technique != Render::Config::Technique::PathTracer };
+	int const bdpt_tile_size = config.f_wavefront ? Integrator::BDPT::wavefront_tile_size : Integrator::BDPT::tile_size;
+	int const n_bdpt_tile_x = ( config.image_width + bdpt_tile_size - 1 ) / bdpt_tile_size;
+	int const n_bdpt_tile_y = ( config.image_height + bdpt_tile_size - 1 ) / bdpt_tile_size;
+
+	// Path length pilot, a few samples per pixel at the max path length into a sensor of its own, by integrators that
+	// record the energy of each strategy. The tuned limits apply to the prepass below, and the render.
+	std::uint8_t camera_length{ config.max_path_length };
+	std::uint8_t emission_length{ config.max_path_length };
+	if ( ( config.path_length_samples > 0 ) && f_bdpt_possible )
+	{
+		Render::Config pilot_config( config );
+		pilot_config.max_samples = config.path_length_samples;
+		pilot_config.passes = 1;
+		Render::Sensor pilot_sensor( pilot_config );
+		Render::Context const pilot_context{ pilot_config, camera, *scene[0] };
+		std::vector<Integrator::PathLength> pilot_length( n_thread, Integrator::PathLength( config.max_path_length, config.light_samples ) );
+#pragma omp parallel
+		{
+			Integrator::BDPT pilot( pilot_context, pilot_sensor, nullptr, nullptr, &pilot_length[omp_get_thread_num()] );
+#pragma omp for schedule( dynamic )
+			for ( int tile = 0; tile < n_bdpt_tile_x * n_bdpt_tile_y; ++tile )
+			{
+				int const x = ( tile % n_bdpt_tile_x ) * bdpt_tile_size;
+				int const y = ( tile / n_bdpt_tile_x ) * bdpt_tile_size;
+				pilot.process_tile( x, y,
+					std::min( bdpt_tile_size, config.image_width - x ),
+					std::min( bdpt_tile_size, config.image_height - y ),
+					0, path_length_seed );
+			}
+		}
+		for ( int thread = 1; thread < n_thread; ++thread )
+			pilot_length[0].merge( pilot_length[thread] );
+
+		std::cout << "Energy by path length:";
+		for ( std::uint16_t k{ 1 }; k <= 2 * config.max_path_length; ++k )
+			std::cout << " " << k << ": " << 100. * pilot_length[0].depth_share( k ) << "%";
+		std::cout << std::endl;
+
+		auto const [camera_tuned, emission_tuned, energy_cut, ray_share] = pilot_length[0].tune( config.truncation_error );
+		camera_length = camera_tuned;
+		emission_length = emission_tuned;
+		for ( std::unique_ptr<Integrator::BDPT> const& value : integrator )
+			value->limit_path_length( camera_length, emission_length );
+		std::cout << "Path length: " << +camera_length << " camera and " << +emission_length << " emission path vertices, an estimated "
+			<< 100. * energy_cut << "% of the energy cut, " << 100. * ray_share << "% of the rays traced." << std::endl;
+	}
+
+	// ADRRS prepass, a few samples per pixel into a sensor of its own, by integrators that record the estimates
+	if ( adrrs && f_bdpt_possible )
+	{
+		Render::Config prepass_config( config );
+		prepass_config.max_samples = config.adrrs_samples;
+		prepass_config.passes = 1;
+		Render::Sensor prepass_sensor( prepass_config );
+		Render::Context const prepass_context{ prepass_config, camera, *scene[0] };
+#pragma omp parallel
+		{
+			Integrator::BDPT prepass( prepass_context, prepass_sensor, nullptr, adrrs.get(), nullptr, radiance_cache.get() );
+			prepass.limit_path_length( camera_length, emission_length );
+#pragma omp for schedule( dynamic )
+			for ( int tile = 0; tile < n_bdpt_tile_x * n_bdpt_tile_y; ++tile )
+			{
+				int const x = ( tile % n_bdpt_tile_x ) * bdpt_tile_size;
+				int const y = ( tile / n_bdpt_tile_x ) * bdpt_tile_size;
+				prepass.process_tile( x, y,
+					std::min( bdpt_tile_size, config.image_width - x ),
+					std::min( bdpt_tile_size, config.image_height - y ),
+					0, adrrs_seed );
+			}
+		}
+		adrrs->build( prepass_sensor );
+	}
+
+	// Technique pilot, the BDPT as configured, with its guide, ADRRS, radiance cache and path lengths, and the path
+	// tracer each render two images of a few samples per pixel. The time of the prepasses above is not counted.
+	// The guide learns from the BDPT pilot, as it would from the first pass
+	bool f_path_tracer{ config.technique == Render::Config::Technique::PathTracer };
+	if ( config.technique == Render::Config::Technique::Automatic )
+	{
+		Render::Config pilot_config( config );
+		pilot_config.max_samples = config.technique_samples;
+		pilot_config.passes = 1;
+		Render::Context const pilot_context{ pilot_config, camera, *scene[0] };
+		std::double_t const bdpt_cost = pilot_cost( pilot_config, bdpt_tile_size, technique_seed,
+			[&]( Render::Sensor& pilot_sensor )
+			{
+				std::unique_ptr<Integrator::BDPT> pilot = std::make_unique<Integrator::BDPT>( pilot_context, pilot_sensor,
+					guide.get(), adrrs.get(), nullptr, radiance_cache.get() );
+				pilot->limit_path_length( camera_length, emission_length );
+				return pilot;
+			} );
+		std::double_t const path_tracer_cost = pilot_cost( pilot_config, Integrator::PathTracer::tile_size, technique_seed,
+			[&]( Render::Sensor& pilot_sensor )
+			{
+				return std::make_unique<Integrator::PathTracer>( pilot_context, pilot_sensor );
+			} );
+		f_path_tracer = path_tracer_cost < bdpt_cost;
+		std::cout << "Technique: " << ( f_path_tracer ? "path tracer" : "BDPT" ) << ", time times variance of " << bdpt_cost
+			<< " for BDPT and " << path_tracer_cost << " for the path tracer." << std::endl;
+	}
+
+	// Image is split into tiles, each thread renders a whole tile
+	int const tile_size = f_path_tracer ? Integrator::PathTracer::tile_size : bdpt_tile_size;
+	int const n_tile_x = ( config.image_width + tile_size - 1 ) / tile_size;
+	int const n_tile_y = ( config.image_height + tile_size - 1 ) / tile_size;
+
+	for ( std::uint16_t pass{ 0 }; pass < config.passes; ++pass )
+	{
+#pragma omp parallel for schedule( dynamic )
+		for ( int tile = 0; tile < n_tile_x * n_tile_y; ++tile )
+		{
+			int const x = ( tile % n_tile_x ) * tile_size;
+			int const y = ( tile / n_tile_x ) * tile_size;
 			// Execute thread
-			integrator[omp_get_thread_num()]->process( x, y );
+			if ( f_path_tracer )
+				path_tracer[omp_get_thread_num()]->process_tile( x, y,
+					std::min( tile_size, config.image_width - x ),
+					std::min( tile_size, config.image_height - y ),
+					pass );
+			else
+				integrator[omp_get_thread_num()]->process_tile( x, y,
+					std::min( tile_size, config.image_width - x ),
+					std::min( tile_size, config.image_height - y ),
+					pass );
+		}
+
+		// No rays are traced between passes
+		bool f_updated{ false };
+		for ( std::unique_ptr<Render::Scene> const& replica : scene )
+			if ( replica && replica->update_hierarchy() )
+				f_updated = true;
+		if ( f_updated )
+			std::cout << "Full scene hierarchy in use, after pass " << pass + 1 << "." << std::endl;
+		if ( guide )
+			guide->refine();
+	}
 
 	std::chrono::steady_clock::time_point stop_time = std::chrono::steady_clock::now();
 	std::chrono::milliseconds total_time = std::chrono::duration_cast<std::chrono::milliseconds>( stop_time - start_time );
 	std::cout << "Render time: " << total_time.count() << " millie seconds." << std::endl;
 
+	// Connections of the BDPT only
+	if ( !f_path_tracer )
+	{
+		Integrator::BDPT::Statistics shadow;
+		for ( std::unique_ptr<Integrator::BDPT> const& value : integrator )
+		{
+			shadow.n_traced += value->statistics().n_traced;
+			shadow.n_zero += value->statistics().n_zero;
+			shadow.n_roulette += value->statistics().n_roulette;
+		}
+		std::cout << "Shadow rays: " << shadow.n_traced << " traced, " << shadow.n_zero << " skipped without contribution, "
+			<< shadow.n_roulette << " skipped by roulette." << std::endl;
+	}
+
 	std::cout << "Saving image." << std::endl;
-	if ( !Render::SaveImage( "result", sensor, config ) )
+	for ( std::uint32_t replica{ 1 }; replica < n_replica; ++replica )
+		if ( sensor[replica] )
+			sensor[0]->merge( *sensor[replica] );
+	if ( config.f_denoise )
+	{
+		std::chrono::steady_clock::time_point const denoise_time = std::chrono::steady_clock::now();
+		Render::Denoise( *sensor[0], config );
+		std::cout << "Denoise time: " << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - denoise_time ).count() << " millie seconds." << std::endl;
+	}
+	std::chrono::steady_clock::time_point const save_time = std::chrono::steady_clock::now();
+	if ( !Render::SaveImage( "result", *sensor[0], config ) )
 	{
 		std::cout << "PANIC! Could not save image." << std::endl;
 		return EXIT_FAILURE;
 	}
+	std::cout << "Save time: " << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - save_time ).count() << " millie seconds." << std::endl;
 
 	std::cout << "Work complete." << std::endl;
 	return EXIT_SUCCESS;
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <sstream>
 
+#include "../mathematics/simd.hpp"
+
 // 3D vector, using double
-class Double3 final
+// With MATH_SIMD, stored as four aligned doubles, see mathematics/simd.hpp
+class alignas( SIMD::double3_alignment ) Double3 final
 {
 
 public:
@@ -12,11 +16,35 @@ public:
 	std::double_t x{ 0.0 };
 	std::double_t y{ 0.0 };
 	std::double_t z{ 0.0 };
+#ifdef MATH_SIMD
+private:
+	std::double_t padding{ 0.0 };
+public:
+
+	explicit Double3( __m256d const value ) { _mm256_store_pd( &x, value ); };
+
+	__m256d load() const { return _mm256_load_pd( &x ); };
+#endif
 
 	Double3() {};
 
+#ifdef MATH_SIMD
+	// One vector store, so a following load is forwarded from it, instead of stalling on three scalar stores
+	Double3( std::double_t const x, std::double_t const y, std::double_t const z ) { _mm256_store_pd( &this->x, _mm256_set_pd( 0., z, y, x ) ); };
+#else
 	Double3( std::double_t const x, std::double_t const y, std::double_t const z ) : x( x ), y( y ), z( z ) {};
-
+#endif
+
+#ifdef MATH_SIMD
+	// Unary minus, flips the sign bit of x, y and z
+	Double3 operator - () const { return Double3( _mm256_xor_pd( load(), _mm256_set_pd( 0., -0., -0., -0. ) ) ); };
+
+	Double3 operator + ( Double3 const& value ) const { return Double3( _mm256_add_pd( load(), value.load() ) ); };
+	Double3 operator - ( Double3 const& value ) const { return Double3( _mm256_sub_pd( load(), value.load() ) ); };
+	Double3 operator * ( std::double_t const value ) const { return Double3( _mm256_mul_pd( load(), _mm256_set1_pd( value ) ) ); };
+	// The padding lane is divided by one, so it stays zero for a zero divisor
+	Double3 operator / ( std::double_t const value ) const { return Double3( _mm256_div_pd( load(), _mm256_set_pd( 1., value, value, value ) ) ); };
+#else
 	// Unary minus
 	Double3 operator - () const { return Double3( -x, -y, -z ); };
 
@@ -24,9 +52,22 @@ public:
 	Double3 operator - ( Double3 const& value ) const { return Double3( x - value.x, y - value.y, z - value.z ); };
 	Double3 operator * ( std::double_t const value ) const { return Double3( x * value, y * value, z * value ); };
 	Double3 operator / ( std::double_t const value ) const { return Double3( x / value, y / value, z / value ); };
+#endif
+
+	// Component by axis index, 0=x, 1=y, 2=z
+	std::double_t operator [] ( std::uint8_t const index ) const { return index == 0 ? x : ( index == 1 ? y : z ); };
+	std::double_t& operator [] ( std::uint8_t const index ) { return index == 0 ? x : ( index == 1 ? y : z ); };
+
+#ifdef MATH_SIMD
+	Double3 normalise() const { return *this * SIMD::rsqrt( dot( *this ) ); };
+
+	std::double_t absdot( Double3 const& value ) const { return std::abs( dot( value ) ); };
+	std::double_t dot( Double3 const& value ) const { return SIMD::sum( _mm256_mul_pd( load(), value.load() ) ); };
 
-	Double3 operator = ( Double3 const& value ) { x = value.x; y = value.y; z = value.z; return *this; };
+	Double3 cross( Double3 const& value ) const { return Double3( SIMD::cross( load(), value.load() ) ); };
 
+	std::double_t magnitude() const { return std::sqrt( dot( *this ) ); };
+#else
 	Double3 normalise() const { return Double3( x, y, z ) / std::sqrt( x * x + y * y + z * z ); };
 
 	std::double_t absdot( Double3 const& value ) const { return std::abs( x * value.x + y * value.y + z * value.z ); };
@@ -35,6 +76,7 @@ public:
 	Double3 cross( Double3 const& value ) const { return Double3( y * value.z - z * value.y, z * value.x - x * value.z, x * value.y - y * value.x ); };
 
 	std::double_t magnitude() const { return std::sqrt( x * x + y * y + z * z ); };
+#endif
 
 	friend std::ostream& operator <<( std::ostream& os, Double3 const& value )
 	{
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+
+#include "../mathematics/double3.hpp"
+
+// 3D vector, using float
+// Storage for geometry, when traced in single precision
+class Float3 final
+{
+
+public:
+
+	std::float_t x{ 0.f };
+	std::float_t y{ 0.f };
+	std::float_t z{ 0.f };
+
+	Float3() {};
+
+	Float3( std::float_t const x, std::float_t const y, std::float_t const z ) : x( x ), y( y ), z( z ) {};
+
+	explicit Float3( Double3 const& value ) : x( static_cast<std::float_t>( value.x ) ), y( static_cast<std::float_t>( value.y ) ), z( static_cast<std::float_t>( value.z ) ) {};
+
+	explicit operator Double3() const { return Double3( x, y, z ); };
+
+	// Unary minus
+	Float3 operator - () const { return Float3( -x, -y, -z ); };
+
+	Float3 operator + ( Float3 const& value ) const { return Float3( x + value.x, y + value.y, z + value.z ); };
+	Float3 operator - ( Float3 const& value ) const { return Float3( x - value.x, y - value.y, z - value.z ); };
+	Float3 operator * ( std::float_t const value ) const { return Float3( x * value, y * value, z * value ); };
+	Float3 operator / ( std::float_t const value ) const { return Float3( x / value, y / value, z / value ); };
+
+	// Component by axis index, 0=x, 1=y, 2=z
+	std::float_t operator [] ( std::uint8_t const index ) const { return index == 0 ? x : ( index == 1 ? y : z ); };
+	std::float_t& operator [] ( std::uint8_t const index ) { return index == 0 ? x : ( index == 1 ? y : z ); };
+
+	Float3 normalise() const { return Float3( x, y, z ) / std::sqrt( x * x + y * y + z * z ); };
+
+	std::float_t dot( Float3 const& value ) const { return x * value.x + y * value.y + z * value.z; };
+
+	Float3 cross( Float3 const& value ) const { return Float3( y * value.z - z * value.y, z * value.x - x * value.z, x * value.y - y * value.x ); };
+
+	std::float_t magnitude() const { return std::sqrt( x * x + y * y + z * z ); };
+
+	friend std::ostream& operator <<( std::ostream& os, Float3 const& value )
+	{
+		os << "( " << value.x << " , " << value.y << " , " << value.z << " )";
+		return os;
+	};
+
+};
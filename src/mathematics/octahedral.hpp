@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "../mathematics/double3.hpp"
+
+// Unit vector, stored as two floats on the octahedron
+// A Survey of Efficient Representations for Independent Unit Vectors, Cigolle et al., 2014
+class Octahedral final
+{
+
+private:
+
+	std::float_t u{ 0.f };
+	std::float_t v{ 0.f };
+
+	static std::double_t sign( std::double_t const value ) { return value < 0. ? -1. : 1.; };
+
+public:
+
+	Octahedral() {};
+
+	explicit Octahedral(
+		Double3 const& value
+	)
+	{
+		// Project on the octahedron, and fold the lower half over the diagonals
+		std::double_t const inv_l1 = 1. / ( std::abs( value.x ) + std::abs( value.y ) + std::abs( value.z ) );
+		std::double_t const x = value.x * inv_l1;
+		std::double_t const y = value.y * inv_l1;
+		if ( value.z < 0. )
+		{
+			u = static_cast<std::float_t>( ( 1. - std::abs( y ) ) * sign( x ) );
+			v = static_cast<std::float_t>( ( 1. - std::abs( x ) ) * sign( y ) );
+		}
+		else
+		{
+			u = static_cast<std::float_t>( x );
+			v = static_cast<std::float_t>( y );
+		}
+	};
+
+	Double3 decode() const
+	{
+		std::float_t const z = 1.f - std::abs( u ) - std::abs( v );
+		// Unfold the lower half, t is zero for the upper half
+		std::float_t const t = std::max( -z, 0.f );
+		std::float_t const x = u + ( u < 0.f ? t : -t );
+		std::float_t const y = v + ( v < 0.f ? t : -t );
+		std::float_t const inv_length = 1.f / std::sqrt( x * x + y * y + z * z );
+		return Double3( x * inv_length, y * inv_length, z * inv_length );
+	};
+
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../mathematics/double3.hpp"
+#include "../mathematics/simd.hpp"
 
 class Orthogonal final
 {
@@ -31,14 +32,25 @@ public:
 		Double3 const& value
 	) const
 	{
+#ifdef MATH_SIMD
+		__m256d const world = _mm256_fmadd_pd( z_axis.load(), _mm256_set1_pd( value.z ),
+			_mm256_fmadd_pd( y_axis.load(), _mm256_set1_pd( value.y ),
+			_mm256_mul_pd( x_axis.load(), _mm256_set1_pd( value.x ) ) ) );
+		return Double3( world );
+#else
 		return x_axis * value.x + y_axis * value.y + z_axis * value.z;
+#endif
 	};
 
 	Double3 to_local(
 		Double3 const& value
 	) const
 	{
+#ifdef MATH_SIMD
+		return Double3( SIMD::dot3( x_axis.load(), y_axis.load(), z_axis.load(), value.load() ) );
+#else
 		return { x_axis.dot( value ), y_axis.dot( value ), z_axis.dot( value ) };
+#endif
 	};
 
 	// Tangent plane vector (x axis)
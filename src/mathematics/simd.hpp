@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorised math core, compile with -DMATH_SIMD -mavx2 -mfma
+// Double3 is then stored as four aligned doubles ( AVX ), and Colour as four aligned floats ( SSE ),
+// the padding lane is kept at zero, so it does not change dot products or colour sums
+#ifdef MATH_SIMD
+
+#if !defined( __AVX2__ ) || !defined( __FMA__ )
+#error "MATH_SIMD needs AVX2 and FMA, compile with -mavx2 -mfma"
+#endif
+
+#include <immintrin.h>
+
+namespace SIMD
+{
+
+	constexpr std::size_t double3_alignment = 32;
+	constexpr std::size_t colour_alignment = 16;
+
+	// Sum of the four lanes, the padding lane is zero
+	inline double sum( __m256d const value )
+	{
+		__m128d const pair = _mm_add_pd( _mm256_castpd256_pd128( value ), _mm256_extractf128_pd( value, 1 ) );
+		return _mm_cvtsd_f64( _mm_add_sd( pair, _mm_unpackhi_pd( pair, pair ) ) );
+	};
+
+	// Three dot products at once, a.v, b.v and c.v, in lanes x, y and z
+	inline __m256d dot3( __m256d const a, __m256d const b, __m256d const c, __m256d const v )
+	{
+		// ( a0+a1, b0+b1, a2+a3, b2+b3 ) and ( c0+c1, 0, c2+c3, 0 )
+		__m256d const ab = _mm256_hadd_pd( _mm256_mul_pd( a, v ), _mm256_mul_pd( b, v ) );
+		__m256d const cc = _mm256_hadd_pd( _mm256_mul_pd( c, v ), _mm256_setzero_pd() );
+		__m128d const xy = _mm_add_pd( _mm256_castpd256_pd128( ab ), _mm256_extractf128_pd( ab, 1 ) );
+		__m128d const z = _mm_add_pd( _mm256_castpd256_pd128( cc ), _mm256_extractf128_pd( cc, 1 ) );
+		return _mm256_insertf128_pd( _mm256_castpd128_pd256( xy ), z, 1 );
+	};
+
+	// a.yzx * b.zxy - a.zxy * b.yzx, the padding lane stays zero
+	inline __m256d cross( __m256d const a, __m256d const b )
+	{
+		__m256d const a_yzx = _mm256_permute4x64_pd( a, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+		__m256d const b_yzx = _mm256_permute4x64_pd( b, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+		// ( a * b.yzx - a.yzx * b ).yzx
+		__m256d const c = _mm256_fmsub_pd( a, b_yzx, _mm256_mul_pd( a_yzx, b ) );
+		return _mm256_permute4x64_pd( c, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	};
+
+	// 1 / sqrt( value ), from the 12 bit estimate and two Newton-Raphson steps, y = y * ( 1.5 - 0.5 * x * y * y )
+	// Each step doubles the correct bits, two are needed for the double precision directions of the integrator
+	inline double rsqrt( double const value )
+	{
+		__m128d const x = _mm_set_sd( value );
+		__m128d y = _mm_cvtps_pd( _mm_rsqrt_ss( _mm_cvtpd_ps( x ) ) );
+		__m128d const half_x = _mm_mul_sd( x, _mm_set_sd( 0.5 ) );
+		__m128d const three_half = _mm_set_sd( 1.5 );
+		y = _mm_mul_sd( y, _mm_fnmadd_sd( half_x, _mm_mul_sd( y, y ), three_half ) );
+		y = _mm_mul_sd( y, _mm_fnmadd_sd( half_x, _mm_mul_sd( y, y ), three_half ) );
+		return _mm_cvtsd_f64( y );
+	};
+
+};
+
+#else
+
+namespace SIMD
+{
+
+	constexpr std::size_t double3_alignment = alignof( double );
+	constexpr std::size_t colour_alignment = alignof( float );
+
+};
+
+#endif
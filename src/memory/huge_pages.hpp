@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <sys/mman.h>
+
+namespace Memory
+{
+
+	// Transparent huge page size on x86-64
+	constexpr std::size_t huge_page_size = std::size_t{ 2 } << 20;
+
+	// Destroys the elements of a Memory::Array, and frees its memory
+	template<typename T>
+	struct ArrayDelete
+	{
+		std::size_t size{ 0 };
+
+		void operator () ( T* const pointer ) const
+		{
+			for ( std::size_t i{ 0 }; i < size; ++i )
+				pointer[i].~T();
+			std::free( pointer );
+		};
+	};
+
+	template<typename T>
+	using Array = std::unique_ptr<T[], Memory::ArrayDelete<T>>;
+
+	// Array of default constructed elements. Arrays of at least one huge page are aligned to it,
+	// and backed by transparent huge pages where the kernel allows it (madvise), so random reads
+	// over a large array, e.g. hierarchy traversal, miss the TLB less often
+	// Pages are placed on the NUMA node of the thread that first writes them, i.e. the constructing thread
+	template<typename T>
+	Memory::Array<T> make_array(
+		std::size_t const size
+	)
+	{
+		std::size_t const bytes = size * sizeof( T );
+		bool const f_huge = bytes >= huge_page_size;
+		std::size_t const alignment = f_huge ? huge_page_size : std::max<std::size_t>( alignof( T ), alignof( std::max_align_t ) );
+		// Size must be a multiple of the alignment
+		std::size_t const allocate = ( ( std::max<std::size_t>( bytes, 1 ) + alignment - 1 ) / alignment ) * alignment;
+		void* const memory = std::aligned_alloc( alignment, allocate );
+		if ( !memory )
+			throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+		if ( f_huge )
+			madvise( memory, allocate, MADV_HUGEPAGE );
+#endif
+		T* const pointer = static_cast<T*>( memory );
+		for ( std::size_t i{ 0 }; i < size; ++i )
+			new ( pointer + i ) T();
+		return Memory::Array<T>( pointer, Memory::ArrayDelete<T>{ size } );
+	};
+
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace Ray
+{
+
+	// Closest hit of a ray, the intersection data is only computed when needed, see Render::Scene::shade
+	struct Hit
+	{
+		std::double_t distance{ 0. };
+		// Primitive id in the scene hierarchy, UINT32_MAX if nothing is hit
+		std::uint32_t id{ UINT32_MAX };
+
+		explicit operator bool() const { return id != UINT32_MAX; };
+	};
+
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "../mathematics/double3.hpp"
 #include "../mathematics/orthogonal.hpp"
 
@@ -17,7 +19,9 @@ namespace Ray
 		Double3 normal_shading; // unit vector
 		Double3 normal_geometry; // unit vector
 		Orthogonal orthogonal; // Defined from normal_shading
-		std::uint32_t material_id;
+		// Distance along normal_geometry, within which the surface lies, see Geometry::surface_error
+		std::double_t error{ 0. };
+		std::uint32_t material_id{ UINT32_MAX };
 
 	};
 
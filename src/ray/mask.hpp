@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Ray
+{
+
+	// One bit per ray, result storage for batched scene queries
+	class Mask final
+	{
+
+	private:
+
+		std::vector<std::uint64_t> word;
+		std::uint32_t n_bit{ 0 };
+
+	public:
+
+		Mask() {};
+
+		// Resize and clear all bits, keeps allocated memory
+		void reset(
+			std::uint32_t const size
+		)
+		{
+			n_bit = size;
+			word.assign( ( size + 63 ) / 64, 0 );
+		};
+
+		void set( std::uint32_t const i ) { word[i >> 6] |= 1ull << ( i & 63 ); };
+
+		bool test( std::uint32_t const i ) const { return ( word[i >> 6] >> ( i & 63 ) ) & 1ull; };
+
+		std::uint32_t size() const { return n_bit; };
+
+	};
+
+};
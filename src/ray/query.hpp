@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include "../geometry/precision.hpp"
+#include "../ray/section.hpp"
+
+namespace Ray
+{
+
+	// Ray converted to geometry precision, with values shared by all box and triangle tests
+	struct Query
+	{
+
+		Geometry::Vector origin;
+		Geometry::Vector direction;
+		Geometry::Vector inv_direction;
+		bool negative[3];
+
+		// Watertight Ray/Triangle Intersection, Woop et al., 2013
+		// Dominant axis of the direction is z, shear maps the direction to ( 0, 0, 1 )
+		std::uint8_t kx;
+		std::uint8_t ky;
+		std::uint8_t kz;
+		Geometry::Scalar sx;
+		Geometry::Scalar sy;
+		Geometry::Scalar sz;
+
+		Query() {};
+
+		Query(
+			Ray::Section const& ray
+		)
+			: origin( ray.origin )
+			, direction( ray.direction )
+		{
+			inv_direction = Geometry::Vector( 1 / direction.x, 1 / direction.y, 1 / direction.z );
+			negative[0] = inv_direction.x < 0;
+			negative[1] = inv_direction.y < 0;
+			negative[2] = inv_direction.z < 0;
+
+			kz = ( std::abs( direction.x ) > std::abs( direction.y ) )
+				? ( std::abs( direction.x ) > std::abs( direction.z ) ? 0 : 2 )
+				: ( std::abs( direction.y ) > std::abs( direction.z ) ? 1 : 2 );
+			kx = ( kz + 1 ) % 3;
+			ky = ( kx + 1 ) % 3;
+			// Preserve winding
+			if ( direction[kz] < 0 )
+				std::swap( kx, ky );
+
+			sx = direction[kx] / direction[kz];
+			sy = direction[ky] / direction[kz];
+			sz = 1 / direction[kz];
+		};
+
+	};
+
+};
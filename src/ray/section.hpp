@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "../epsilon.hpp"
+#include "../geometry/precision.hpp"
 #include "../mathematics/double3.hpp"
 
 namespace Ray
@@ -29,15 +35,49 @@ namespace Ray
 			, direction( direction )
 		{};
 
+		// Ray leaving a surface, the origin is moved along the unit normal by error, to the side of the direction
+		// Unlike a step along the direction, it clears the surface for grazing directions too, see Geometry::surface_error
 		Section(
 			Double3 const& origin,
 			Double3 const& direction, // Unit vector is expected
-			std::double_t const epsilon
+			Double3 const& normal,
+			std::double_t const error
 		)
-			: origin( origin + direction * epsilon )
+			: origin( origin + normal * ( normal.dot( direction ) < 0. ? -error : error ) )
 			, direction( direction )
 		{};
 
 	};
 
+	// Shortest distance between two surface points to connect. Closer points, moved off their surfaces by their error
+	// (see connect), may pass each other, and the shadow ray would point away from to.
+	inline std::double_t min_distance(
+		std::double_t const from_error,
+		std::double_t const to_error
+	)
+	{
+		return std::max( EPSILON_DISTANCE, from_error + to_error );
+	};
+
+	// Shadow ray between two surface points, and the distance to test it for occlusion
+	// Both points are moved off their surfaces towards each other, by their error, see Geometry::surface_error. The
+	// distance stops short of the surface of to, by its error, and by the rounding of the distance (robust_scale).
+	// Points that are not on a surface, e.g. a lens, have an error of zero (0).
+	inline std::tuple<Ray::Section, std::double_t> connect(
+		Double3 const& from,
+		Double3 const& from_normal,
+		std::double_t const from_error,
+		Double3 const& to,
+		Double3 const& to_normal,
+		std::double_t const to_error
+	)
+	{
+		Double3 const delta = to - from;
+		Double3 const start = from + from_normal * ( from_normal.dot( delta ) < 0. ? -from_error : from_error );
+		Double3 const end = to + to_normal * ( to_normal.dot( delta ) > 0. ? -to_error : to_error );
+		Double3 const edge = end - start;
+		std::double_t const distance = edge.magnitude();
+		return { Ray::Section( start, edge / distance ), distance / Geometry::robust_scale - to_error };
+	};
+
 };
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <memory>
 
+#include "../epsilon.hpp"
 #include "../mathematics/constant.hpp"
 #include "../mathematics/double3.hpp"
 #include "../random/mersenne.hpp"
@@ -93,7 +94,7 @@ namespace Render
 			sensor_area = scalar * scalar / aspect_ratio;
 
 			Double3 const delta = look_at - position;
-			if ( delta.magnitude() < EPSILON_RAY )
+			if ( delta.magnitude() < EPSILON_DISTANCE )
 			{
 				std::cout << "Camera position and view target are too close together!" << std::endl;
 				throw std::invalid_argument( "Camera position and view target are too close together!" );
@@ -107,8 +108,9 @@ namespace Render
 			up = -( right.cross( forward ) ).normalise();
 
 			// Convertion factors for pixel to sensor
-			dx = 1. / static_cast<std::double_t>( image_width - 1 );
-			dy = 1. / static_cast<std::double_t>( image_height - 1 );
+			// Pixel x covers [x;x+1[ * dx of the sensor, the same area sensor() maps a point to
+			dx = 1. / static_cast<std::double_t>( image_width );
+			dy = 1. / static_cast<std::double_t>( image_height );
 		};
 
 		Ray::Section generate_ray(
@@ -117,8 +119,8 @@ namespace Render
 			Random::Mersenne& prng
 		) const
 		{
-			std::float_t const rnd_x = prng.get_float() - 0.5f;
-			std::float_t const rnd_y = prng.get_float() - 0.5f;
+			std::float_t const rnd_x = prng.get_float();
+			std::float_t const rnd_y = prng.get_float();
 
 			Double3 dir = forward +
 				right * scalar * ( ( static_cast<std::float_t>( x ) + rnd_x ) * dx - 0.5f ) +
@@ -163,7 +165,7 @@ namespace Render
 		) const
 		{
 			// Verify that the point is on the lens
-			if ( ( lens_point - position ).magnitude() > EPSILON_RAY )
+			if ( ( lens_point - position ).magnitude() > EPSILON_DISTANCE )
 				return { 0.f, 0.f, 0.f };
 
 			// Test if in front of camera lens
@@ -194,7 +196,7 @@ namespace Render
 		) const
 		{
 			// Verify that the point is on the lens
-			if ( ( lens_point - position ).magnitude() > EPSILON_RAY )
+			if ( ( lens_point - position ).magnitude() > EPSILON_DISTANCE )
 				return Double3::Zero;
 			return forward;
 		};
@@ -1,12 +1,41 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 
+#include "../coroutine/interleave.hpp"
+#include "../render/topology.hpp"
+
 namespace Render
 {
 
 	struct Config
 	{
+		// Light transport algorithm
+		enum class Technique : std::uint8_t
+		{
+			// Bidirectional path tracer, see Integrator::BDPT
+			BDPT,
+			// Unidirectional path tracer with next event estimation, see Integrator::PathTracer
+			PathTracer,
+			// The one that converges faster, estimated by a pilot of both
+			Automatic
+		};
+
+		// File format of the rendered image, see Render::SaveImage
+		enum class ImageFormat : std::uint8_t
+		{
+			// 8 bit per channel, gamma 2.2, clamped to white
+			TGA,
+			// Portable float map, 32 bit float per channel, linear
+			PFM,
+			// OpenEXR scanlines, run length encoded, 32 bit float per channel, linear
+			EXR,
+			// As EXR, with 16 bit half floats
+			EXRHalf
+		};
+
 		// Image resolution
 		std::uint16_t image_width{ 32 };
 		std::uint16_t image_height{ 32 };
@@ -14,20 +43,90 @@ namespace Render
 		std::uint16_t max_samples{ 1 };
 		// Number of path vertices
 		std::uint8_t max_path_length{ 5 };
+		// Samples are rendered in this many progressive passes
+		std::uint16_t passes{ 1 };
+		// Start rendering on a lazily built scene hierarchy, swapped for a full build between passes
+		bool f_lazy_hierarchy{ false };
+		// Extra references allowed by spatial splits of the scene hierarchy, relative to the number of objects
+		// Zero (0) for object splits only
+		std::float_t spatial_split_budget{ 0.f };
+		// Trace the sub paths of a tile together, one stage at a time (wavefront), instead of one pixel sample at a time
+		bool f_wavefront{ false };
+		// Scene queries of a batch in flight per thread, interleaved as coroutines that prefetch before they yield
+		// Hides memory latency on scenes larger than the cache. Zero (0) traces a batch one query at a time
+		std::uint8_t interleaved_queries{ 0 };
+		// Pin render threads to cores, and keep a copy of the scene and sensor per NUMA node, see Render::Topology
+		bool f_numa{ false };
+		// Order in which pinned threads are placed on the cores of the NUMA nodes
+		Render::Topology::Placement thread_placement{ Render::Topology::Placement::Spread };
+		// Camera paths of a prepass that learns where each emitter should send its light sub paths, see Emitter::Guide
+		// Zero (0) emits cosine weighted
+		std::uint32_t emission_guide_paths{ 0 };
+		// Guide camera paths by the incident radiance learned in earlier passes, see Guiding::SDTree
+		// Needs several passes, the first one is not guided
+		bool f_path_guiding{ false };
+		// Emitter points connected to each camera path vertex (next event estimation), at least one (1)
+		// The first is the start of the emission path, the others are sampled for the vertex
+		std::uint8_t light_samples{ 1 };
+		// Connections contributing less than this (largest colour channel, per sample) keep their shadow ray
+		// by Russian roulette only. Zero (0) tests all connections with a contribution
+		std::float_t shadow_threshold{ 0.f };
+		// Samples per pixel of a prepass, that estimates the image to steer Russian roulette and splitting of the
+		// sub paths, see Integrator::ADRRS. Zero (0) traces all sub paths up to the max path length
+		std::uint16_t adrrs_samples{ 0 };
+		// Samples per pixel of a pilot at the max path length, that records the energy of each path length, to choose
+		// separate, shorter limits for the camera and emission sub paths, see Integrator::PathLength
+		// Zero (0) traces both up to the max path length
+		std::uint16_t path_length_samples{ 0 };
+		// Largest share of the energy the tuned path lengths may cut, relative to the pilot
+		std::float_t truncation_error{ 0.01f };
+		// Emitter candidates per sample, resampled into a reservoir for the first camera path vertex of each pixel,
+		// which also reuses the reservoirs of its previous sample and its neighbours (ReSTIR), see Integrator::Reservoir
+		// Its survivor replaces the next event estimation of that vertex. Zero (0) for none
+		std::uint16_t restir_candidates{ 0 };
+		// Temporal reuse, the reservoir of the previous sample of a pixel is merged, counted as at most this many times
+		// the candidates of a sample. The samples of a pixel are averaged, so this correlates them, and adds noise to
+		// the final image. Zero (0) for none
+		std::uint8_t restir_history{ 0 };
+		// Camera paths end at their first diffuse vertex from this depth on, with the radiance learned for it by a
+		// cache, see Integrator::RadianceCache. Longer paths are left to the cache, biased by its cell size
+		// Zero (0) for none
+		std::uint8_t radiance_cache_depth{ 0 };
+		// Camera paths traced before rendering, to learn the radiance cache
+		std::uint32_t radiance_cache_paths{ 0 };
+		// Light transport algorithm used to render
+		Technique technique{ Technique::BDPT };
+		// Samples per pixel of each pilot image of the automatic technique choice
+		std::uint16_t technique_samples{ 2 };
+		// Filter the image after the render, guided by the first hit features of each pixel, see Render::Denoise
+		bool f_denoise{ false };
+		// File format of the rendered image
+		ImageFormat image_format{ ImageFormat::TGA };
+
+		// Copy with each setting clamped to its valid range
+		// Settings are given by name, e.g. Render::Config{ .image_width = 400, .image_height = 400 }.validate()
+		Config validate() const
+		{
+			Config result( *this );
+			result.max_samples = std::max<std::uint16_t>( 1, max_samples );
+			result.max_path_length = std::max<std::uint8_t>( 3, max_path_length );
+			result.passes = std::clamp<std::uint16_t>( passes, 1, result.max_samples );
+			result.spatial_split_budget = std::max( 0.f, spatial_split_budget );
+			result.interleaved_queries = std::min<std::uint8_t>( interleaved_queries, Coroutine::max_flight );
+			result.light_samples = std::max<std::uint8_t>( 1, light_samples );
+			result.shadow_threshold = std::max( 0.f, shadow_threshold );
+			result.truncation_error = std::clamp( truncation_error, 0.f, 1.f );
+			result.radiance_cache_depth = std::min( radiance_cache_depth, result.max_path_length );
+			result.technique_samples = std::max<std::uint16_t>( 1, technique_samples );
+			return result;
+		};
 
-		Config() = default;
-
-		Config(
-			std::uint16_t const& image_width,
-			std::uint16_t const& image_height,
-			std::uint16_t const& max_samples,
-			std::uint8_t const& max_path_length
-		)
-			: image_width( image_width )
-			, image_height( image_height )
-			, max_samples( std::max<std::uint16_t>( 1, max_samples ) )
-			, max_path_length( std::max<std::uint16_t>( 3, max_path_length ) )
-		{};
+		// First sample of a pass, the pass ends at the first sample of the next pass
+		// Passes past the last one start at max_samples, i.e. have no samples
+		std::uint32_t pass_first_sample( std::uint16_t const pass ) const
+		{
+			return static_cast<std::uint32_t>( max_samples ) * std::min( pass, passes ) / passes;
+		};
 
 	};
 
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../render/camera.hpp"
+#include "../render/config.hpp"
+#include "../render/scene.hpp"
+
+namespace Render
+{
+
+	// Read only render data, one instance shared by all render threads
+	// Holds references only, the config, camera and scene must outlive it
+	struct Context
+	{
+		Render::Config const& config;
+		Render::Camera const& camera;
+		Render::Scene const& scene;
+	};
+
+};
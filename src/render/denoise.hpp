@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../colour/colour.hpp"
+#include "../mathematics/double3.hpp"
+#include "../render/config.hpp"
+#include "../render/feature.hpp"
+#include "../render/sensor.hpp"
+
+namespace Render
+{
+
+	// Edge-avoiding à-trous wavelet filter, run on the sensor after the render
+	// The illumination, the colour over the first hit albedo, is filtered by a 5x5 B3 spline kernel whose taps
+	// are twice as far apart each iteration. Taps are weighted down by their difference in illumination, normal,
+	// depth and albedo from the centre pixel, so edges stay sharp. The albedo is multiplied back afterwards, so
+	// texture detail is not blurred. Rows are filtered in parallel.
+	// Edge-avoiding à-trous wavelet transform for fast global illumination filtering, Dammertz et al., 2010
+	void Denoise(
+		Render::Sensor& sensor,
+		Render::Config const& config
+	)
+	{
+		// Iterations, the taps of the last one are 2^( iterations - 1 ) pixels apart
+		constexpr std::uint8_t iterations{ 3 };
+		// Edge stopping, illumination on a tonemapped scale that halves each iteration, normal, relative depth
+		// per pixel step of a tap, and albedo
+		constexpr std::float_t sigma_colour{ 0.25f };
+		constexpr std::float_t sigma_normal{ 0.1f };
+		constexpr std::float_t sigma_depth{ 0.02f };
+		constexpr std::float_t sigma_albedo{ 0.1f };
+		constexpr std::float_t kernel[5]{ 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+
+		std::int32_t const width = config.image_width;
+		std::int32_t const height = config.image_height;
+		std::uint32_t const n_pixel = static_cast<std::uint32_t>( width ) * height;
+
+		// Illumination, and the features
+		std::vector<Colour> illumination( n_pixel );
+		std::vector<Colour> filtered( n_pixel );
+		std::vector<Render::Feature> feature( n_pixel );
+		// Albedo the colour is divided by, white where it has no colour channel to divide by
+		std::vector<Colour> divisor( n_pixel );
+#pragma omp parallel for schedule( dynamic )
+		for ( std::int32_t y = 0; y < height; ++y )
+			for ( std::int32_t x = 0; x < width; ++x )
+			{
+				std::uint32_t const i = x + y * width;
+				feature[i] = sensor.get_feature( x, y );
+				Colour const& albedo = feature[i].albedo;
+				divisor[i] = Colour(
+					albedo.r > 1e-3f ? albedo.r : 1.f,
+					albedo.g > 1e-3f ? albedo.g : 1.f,
+					albedo.b > 1e-3f ? albedo.b : 1.f );
+				Colour const colour = sensor.get_colour( x, y );
+				illumination[i] = Colour( colour.r / divisor[i].r, colour.g / divisor[i].g, colour.b / divisor[i].b );
+			}
+
+		for ( std::uint8_t iteration{ 0 }; iteration < iterations; ++iteration )
+		{
+			std::int32_t const step = 1 << iteration;
+			std::float_t const sigma_colour_2 = sigma_colour * sigma_colour / static_cast<std::float_t>( 1 << iteration );
+#pragma omp parallel for schedule( dynamic )
+			for ( std::int32_t y = 0; y < height; ++y )
+				for ( std::int32_t x = 0; x < width; ++x )
+				{
+					std::uint32_t const i = x + y * width;
+					Render::Feature const& centre = feature[i];
+					Colour const& c = illumination[i];
+					Colour const c_tonemap( c.r / ( 1.f + c.r ), c.g / ( 1.f + c.g ), c.b / ( 1.f + c.b ) );
+					Colour sum( Colour::Black );
+					std::float_t weight_sum{ 0.f };
+					for ( std::int32_t dy = -2; dy <= 2; ++dy )
+					{
+						std::int32_t const qy = y + dy * step;
+						if ( ( qy < 0 ) || ( qy >= height ) )
+							continue;
+						for ( std::int32_t dx = -2; dx <= 2; ++dx )
+						{
+							std::int32_t const qx = x + dx * step;
+							if ( ( qx < 0 ) || ( qx >= width ) )
+								continue;
+							std::uint32_t const j = qx + qy * width;
+							Render::Feature const& tap = feature[j];
+							// Camera rays that miss, only with each other
+							if ( ( centre.depth > 0.f ) != ( tap.depth > 0.f ) )
+								continue;
+							Colour const& q = illumination[j];
+							Colour const q_tonemap( q.r / ( 1.f + q.r ), q.g / ( 1.f + q.g ), q.b / ( 1.f + q.b ) );
+							Colour const d_colour( c_tonemap.r - q_tonemap.r, c_tonemap.g - q_tonemap.g, c_tonemap.b - q_tonemap.b );
+							Double3 const d_normal = centre.normal - tap.normal;
+							Colour const d_albedo( centre.albedo.r - tap.albedo.r, centre.albedo.g - tap.albedo.g, centre.albedo.b - tap.albedo.b );
+							std::float_t const d_depth = ( centre.depth > 0.f )
+								? std::abs( centre.depth - tap.depth ) / ( sigma_depth * centre.depth * step * std::max( std::abs( dx ), std::abs( dy ) ) + 1e-6f )
+								: 0.f;
+							std::float_t const weight = kernel[dx + 2] * kernel[dy + 2] * std::exp(
+								-( d_colour.r * d_colour.r + d_colour.g * d_colour.g + d_colour.b * d_colour.b ) / sigma_colour_2
+								- static_cast<std::float_t>( d_normal.dot( d_normal ) ) / ( sigma_normal * sigma_normal )
+								- ( d_albedo.r * d_albedo.r + d_albedo.g * d_albedo.g + d_albedo.b * d_albedo.b ) / ( sigma_albedo * sigma_albedo )
+								- d_depth );
+							sum += q * weight;
+							weight_sum += weight;
+						}
+					}
+					// The centre tap always has weight
+					filtered[i] = sum / weight_sum;
+				}
+			illumination.swap( filtered );
+		}
+
+		for ( std::int32_t y = 0; y < height; ++y )
+			for ( std::int32_t x = 0; x < width; ++x )
+			{
+				std::uint32_t const i = x + y * width;
+				sensor.set_colour( x, y, illumination[i] * divisor[i] );
+			}
+	};
+
+};
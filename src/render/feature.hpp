@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cmath>
+
+#include "../colour/colour.hpp"
+#include "../mathematics/double3.hpp"
+
+namespace Render
+{
+
+	// Features of the first hit of a camera ray (AOV), summed over the samples of a pixel by Render::Sensor
+	// They are noise free for the most part, and guide the denoiser, see Render::Denoise
+	// A camera ray that misses has no features, i.e. all zero (0)
+	struct Feature
+	{
+		Colour albedo{ Colour::Black };
+		// Shading normal
+		Double3 normal{ Double3::Zero };
+		// Distance from the lens point
+		std::float_t depth{ 0.f };
+
+		Feature& operator += ( Feature const& value )
+		{
+			albedo += value.albedo;
+			normal = normal + value.normal;
+			depth += value.depth;
+			return *this;
+		};
+
+		Feature operator * ( std::float_t const value ) const
+		{
+			return { albedo * value, normal * value, depth * value };
+		};
+
+	};
+
+};
@@ -1,12 +1,17 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iosfwd>
-#include <memory>
+#include <limits>
+#include <span>
 #include <string>
+#include <vector>
 
 #include "../colour/colour.hpp"
 #include "../render/config.hpp"
@@ -15,10 +20,173 @@
 namespace Render
 {
 
+	// Binary image data is written from memory as is, i.e. multi byte values in little endian
+	static_assert( std::endian::native == std::endian::little, "Image files need a little endian host" );
+
+	// Image rows converted together, in parallel, then written to the file
+	// Large images are streamed a block at a time, instead of being converted as a whole
+	constexpr std::uint16_t image_block_rows{ 64 };
+
+	// Linear colour channel to 8 bit, clamped to [0;1] and gamma 2.2, by lookup tables
+	// Gives the same codes as static_cast<std::uint8_t>( std::pow( std::clamp( value, 0.f, 1.f ), 1.f / 2.2f ) * 255 ).
+	// A table over equal buckets of the value holds the code at the lower end of each bucket. Near black, where a
+	// bucket spans several codes, the code is stepped up until the threshold of the next one is above the value.
+	class Quantise final
+	{
+
+	private:
+
+		static constexpr std::uint32_t n_bucket{ 1 << 12 };
+
+		// Smallest value of each code, the last entry ends the steps
+		std::array<std::float_t, 257> threshold;
+		std::array<std::uint8_t, n_bucket + 1> bucket;
+
+		static std::uint8_t reference(
+			std::float_t const value
+		)
+		{
+			return static_cast<std::uint8_t>( std::pow( std::clamp( value, 0.f, 1.f ), 1.f / 2.2f ) * 255 );
+		};
+
+	public:
+
+		Quantise()
+		{
+			// Bisection over the bit patterns of [0;1], which are ordered as their values
+			threshold[0] = 0.f;
+			for ( std::uint16_t code{ 1 }; code < 256; ++code )
+			{
+				std::uint32_t low{ 0 };
+				std::uint32_t high = std::bit_cast<std::uint32_t>( 1.f );
+				while ( low < high )
+				{
+					std::uint32_t const middle = low + ( high - low ) / 2;
+					if ( reference( std::bit_cast<std::float_t>( middle ) ) >= code )
+						high = middle;
+					else
+						low = middle + 1;
+				}
+				threshold[code] = std::bit_cast<std::float_t>( low );
+			}
+			threshold[256] = std::numeric_limits<std::float_t>::infinity();
+			for ( std::uint32_t i{ 0 }; i <= n_bucket; ++i )
+				bucket[i] = reference( static_cast<std::float_t>( i ) / n_bucket );
+		};
+
+		std::uint8_t operator()(
+			std::float_t const value
+		) const
+		{
+			// Also NaN
+			if ( !( value > 0.f ) )
+				return 0;
+			std::float_t const clamped = std::min( value, 1.f );
+			std::uint16_t code = bucket[static_cast<std::uint32_t>( clamped * n_bucket )];
+			while ( clamped >= threshold[code + 1] )
+				++code;
+			return static_cast<std::uint8_t>( code );
+		};
+
+	};
+
+	// Float to 16 bit half float, rounded to the nearest, ties to even, and beyond the largest half to infinity
+	std::uint16_t HalfFloat(
+		std::float_t const value
+	)
+	{
+		std::uint32_t const bits = std::bit_cast<std::uint32_t>( value );
+		std::uint16_t const sign = static_cast<std::uint16_t>( ( bits >> 16 ) & 0x8000 );
+		std::uint32_t const magnitude = bits & 0x7fffffff;
+		// NaN
+		if ( magnitude > 0x7f800000 )
+			return sign | 0x7e00;
+		// Rounds to above 65504, or infinity
+		if ( magnitude >= 0x477ff000 )
+			return sign | 0x7c00;
+		// Normal, the exponent is rebiased from 127 to 15, and 13 bits of the mantissa are rounded off
+		if ( magnitude >= 0x38800000 )
+		{
+			std::uint32_t const rebiased = magnitude - 0x38000000;
+			return sign | static_cast<std::uint16_t>( ( rebiased + 0xfff + ( ( rebiased >> 13 ) & 1 ) ) >> 13 );
+		}
+		// Below half the smallest subnormal
+		if ( magnitude <= 0x33000000 )
+			return sign;
+		// Subnormal, in steps of 2^-24
+		std::uint32_t const mantissa = ( magnitude & 0x7fffff ) | 0x800000;
+		std::uint32_t const shift = 126 - ( magnitude >> 23 );
+		std::uint32_t half = mantissa >> shift;
+		std::uint32_t const remainder = mantissa & ( ( 1u << shift ) - 1 );
+		std::uint32_t const halfway = 1u << ( shift - 1 );
+		if ( ( remainder > halfway ) || ( ( remainder == halfway ) && ( half & 1 ) ) )
+			++half;
+		return sign | static_cast<std::uint16_t>( half );
+	};
+
+	// OpenEXR run length encoding of a block of pixel data, as the OpenEXR library does it
+	// The even bytes are moved before the odd ones, each byte is replaced by its difference to the one before, then
+	// runs of at least three equal bytes are stored as their length and the byte, other bytes as a negative count
+	// and the bytes. Returns false if packed is not smaller than data, the block is then stored as is.
+	bool CompressRLE(
+		std::vector<std::uint8_t> const& data,
+		std::vector<std::uint8_t>& buffer,
+		std::vector<std::uint8_t>& packed
+	)
+	{
+		constexpr std::size_t min_run{ 3 };
+		constexpr std::size_t max_run{ 127 };
+
+		std::size_t const size = data.size();
+		if ( size < 2 )
+			return false;
+		buffer.resize( size );
+		// Both steps at once, the differences of the even bytes, then of the odd ones, the first odd byte to the last
+		// even one
+		std::size_t const odd = ( size + 1 ) / 2;
+		buffer[0] = data[0];
+		for ( std::size_t i{ 1 }; i < odd; ++i )
+			buffer[i] = static_cast<std::uint8_t>( data[2 * i] - data[2 * i - 2] + 128 );
+		buffer[odd] = static_cast<std::uint8_t>( data[1] - data[2 * odd - 2] + 128 );
+		for ( std::size_t i{ 1 }; odd + i < size; ++i )
+			buffer[odd + i] = static_cast<std::uint8_t>( data[2 * i + 1] - data[2 * i - 1] + 128 );
+
+		packed.clear();
+		packed.reserve( size + max_run + 1 );
+		std::size_t start{ 0 };
+		std::size_t end{ 1 };
+		while ( start < size )
+		{
+			// Stored as is, no need to finish
+			if ( packed.size() >= size )
+				return false;
+			while ( ( end < size ) && ( buffer[start] == buffer[end] ) && ( end - start - 1 < max_run ) )
+				++end;
+			if ( end - start >= min_run )
+			{
+				packed.push_back( static_cast<std::uint8_t>( end - start - 1 ) );
+				packed.push_back( buffer[start] );
+			}
+			else
+			{
+				// Literal bytes, up to the next run of three
+				std::size_t const limit = std::min( size, start + max_run );
+				while ( ( end < limit )
+					&& !( ( end + 2 < size ) && ( buffer[end] == buffer[end + 1] ) && ( buffer[end + 1] == buffer[end + 2] ) ) )
+					++end;
+				packed.push_back( static_cast<std::uint8_t>( -static_cast<std::int32_t>( end - start ) ) );
+				packed.insert( packed.end(), buffer.begin() + start, buffer.begin() + end );
+			}
+			start = end;
+			++end;
+		}
+		return packed.size() < size;
+	};
+
 	// Uncompressed 24bit TGA
-	bool SaveImage(
+	bool SaveTGA(
 		std::string const& file_name,
-		Render::Sensor& sensor,
+		Render::Sensor const& sensor,
 		Render::Config const& config,
 		bool f_libgdk = false
 	)
@@ -32,65 +200,259 @@ namespace Render
 			return false;
 
 		std::uint32_t const tga_header_size = 18 + ( f_libgdk ? 1 : 0 );
-		std::uint32_t const n_pixel = config.image_width * config.image_height;
-		std::uint32_t const tga_data_size = tga_header_size + n_pixel * 3;
-
-		std::shared_ptr<std::uint8_t[]> p_data = std::make_shared<std::uint8_t[]>( tga_data_size, 0 );
-		if ( !p_data )
-			return false;
+		std::uint8_t header[19]{ 0 };
 
 		// Set header
 		// Comment data size
-		p_data[0] = f_libgdk ? 1 : 0;
+		header[0] = f_libgdk ? 1 : 0;
 		// Colourmap type
-		p_data[1] = 0;
+		header[1] = 0;
 		// Datatype
-		p_data[2] = 2;
+		header[2] = 2;
 		// Colourmap origin
-		p_data[3] = 0;
-		p_data[4] = 0;
+		header[3] = 0;
+		header[4] = 0;
 		// Colourmap length
-		p_data[5] = 0;
-		p_data[6] = 0;
+		header[5] = 0;
+		header[6] = 0;
 		// Colourmap depth
-		p_data[7] = 0;
+		header[7] = 0;
 		// X origin
-		p_data[8] = 0;
-		p_data[9] = 0;
+		header[8] = 0;
+		header[9] = 0;
 		// Y origin
-		p_data[10] = 0;
-		p_data[11] = 0;
+		header[10] = 0;
+		header[11] = 0;
 		// X size
-		p_data[12] = static_cast<std::uint8_t>( config.image_width % 256 );
-		p_data[13] = static_cast<std::uint8_t>( config.image_width / 256 );
+		header[12] = static_cast<std::uint8_t>( config.image_width % 256 );
+		header[13] = static_cast<std::uint8_t>( config.image_width / 256 );
 		// Y size
-		p_data[14] = static_cast<std::uint8_t>( config.image_height % 256 );
-		p_data[15] = static_cast<std::uint8_t>( config.image_height / 256 );
+		header[14] = static_cast<std::uint8_t>( config.image_height % 256 );
+		header[15] = static_cast<std::uint8_t>( config.image_height / 256 );
 		// Bits per pixel
-		p_data[16] = 24;
+		header[16] = 24;
 		// Image descriptor
 		// 32 (bit 5) is screen origin, 0 lower left, 1 upper left
-		p_data[17] = 32;
+		header[17] = 32;
 		if ( f_libgdk )
 			// Nonzero length bug fix for libgdk
-			p_data[18] = 0;
+			header[18] = 0;
+		tga_file.write( reinterpret_cast<char const*>( header ), tga_header_size );
 
-		for ( std::uint16_t y{ 0 }; y < config.image_height; ++y )
-			for ( std::uint16_t x{ 0 }; x < config.image_width; ++x )
+		static Render::Quantise const quantise;
+		std::uint32_t const width = config.image_width;
+		std::uint32_t const height = config.image_height;
+		std::vector<Colour> colour( width * image_block_rows );
+		std::vector<std::uint8_t> data( width * image_block_rows * 3 );
+		for ( std::uint32_t first{ 0 }; first < height; first += image_block_rows )
+		{
+			std::int32_t const n_row = std::min<std::uint32_t>( image_block_rows, height - first );
+#pragma omp parallel for
+			for ( std::int32_t i = 0; i < n_row; ++i )
 			{
-				Colour const colour = sensor.get_colour( x, y );
-				std::uint32_t index = ( x + y * config.image_width ) * 3;
+				std::span<Colour> const row( &colour[i * width], width );
+				sensor.get_row( first + i, row );
+				std::uint8_t* const bgr = &data[i * width * 3];
 				// TGA uses BGR colour order
-				p_data[index + tga_header_size] = static_cast<std::uint8_t>( std::pow( std::clamp( colour.b, 0.f, 1.f ), 1.f / 2.2f ) * 255 );
-				p_data[index + 1 + tga_header_size] = static_cast<std::uint8_t>( std::pow( std::clamp( colour.g, 0.f, 1.f ), 1.f / 2.2f ) * 255 );
-				p_data[index + 2 + tga_header_size] = static_cast<std::uint8_t>( std::pow( std::clamp( colour.r, 0.f, 1.f ), 1.f / 2.2f ) * 255 );
+				for ( std::uint32_t x{ 0 }; x < width; ++x )
+				{
+					bgr[x * 3] = quantise( row[x].b );
+					bgr[x * 3 + 1] = quantise( row[x].g );
+					bgr[x * 3 + 2] = quantise( row[x].r );
+				}
 			}
-
-		// Dump p_data from memory to file
-		tga_file.write( (char*)( &p_data[0] ), tga_data_size );
+			tga_file.write( reinterpret_cast<char const*>( data.data() ), n_row * width * 3 );
+		}
 		tga_file.close();
 
-		return true;
+		return !tga_file.fail();
+	};
+
+	// Portable float map, linear RGB with 32 bit floats, rows from the bottom up
+	bool SavePFM(
+		std::string const& file_name,
+		Render::Sensor const& sensor,
+		Render::Config const& config
+	)
+	{
+		std::ofstream pfm_file;
+		pfm_file.open( file_name + ".pfm", std::ios::trunc | std::ios::binary );
+		if ( !pfm_file.is_open() )
+			return false;
+
+		// A negative scale is little endian
+		pfm_file << "PF\n" << config.image_width << ' ' << config.image_height << "\n-1.0\n";
+
+		std::uint32_t const width = config.image_width;
+		std::vector<Colour> colour( width * image_block_rows );
+		std::vector<std::float_t> data( width * image_block_rows * 3 );
+		// Blocks from the bottom up, the rows of a block too
+		for ( std::uint32_t end = config.image_height; end > 0; )
+		{
+			std::int32_t const n_row = std::min<std::uint32_t>( image_block_rows, end );
+#pragma omp parallel for
+			for ( std::int32_t i = 0; i < n_row; ++i )
+			{
+				std::span<Colour> const row( &colour[i * width], width );
+				sensor.get_row( end - 1 - i, row );
+				std::float_t* const rgb = &data[i * width * 3];
+				for ( std::uint32_t x{ 0 }; x < width; ++x )
+				{
+					rgb[x * 3] = row[x].r;
+					rgb[x * 3 + 1] = row[x].g;
+					rgb[x * 3 + 2] = row[x].b;
+				}
+			}
+			pfm_file.write( reinterpret_cast<char const*>( data.data() ), n_row * width * 3 * sizeof( std::float_t ) );
+			end -= n_row;
+		}
+		pfm_file.close();
+
+		return !pfm_file.fail();
+	};
+
+	// OpenEXR, single part scanlines, linear RGB with 32 bit floats, or 16 bit half floats if f_half
+	// Each scanline is a run length encoded block, or stored as is if that is not smaller. The offsets of the blocks
+	// precede them, so they are written as a placeholder, and filled in after the blocks.
+	bool SaveEXR(
+		std::string const& file_name,
+		Render::Sensor const& sensor,
+		Render::Config const& config,
+		bool const f_half = false
+	)
+	{
+		std::ofstream exr_file;
+		exr_file.open( file_name + ".exr", std::ios::trunc | std::ios::binary );
+		if ( !exr_file.is_open() )
+			return false;
+
+		auto const put = [&exr_file]( auto const value )
+			{
+				exr_file.write( reinterpret_cast<char const*>( &value ), sizeof( value ) );
+			};
+		auto const attribute = [&exr_file, &put]( char const* name, char const* type, std::int32_t const size )
+			{
+				exr_file.write( name, std::strlen( name ) + 1 );
+				exr_file.write( type, std::strlen( type ) + 1 );
+				put( size );
+			};
+
+		std::int32_t const width = config.image_width;
+		std::int32_t const height = config.image_height;
+		std::uint32_t const channel_size = f_half ? sizeof( std::uint16_t ) : sizeof( std::float_t );
+
+		// Magic number, and version 2 without flags, i.e. single part scanlines
+		put( std::int32_t{ 20000630 } );
+		put( std::int32_t{ 2 } );
+		// Channels in alphabetical order, pixel type 1 is half, 2 is float
+		attribute( "channels", "chlist", 3 * 18 + 1 );
+		for ( char const* channel : { "B", "G", "R" } )
+		{
+			exr_file.write( channel, 2 );
+			put( std::int32_t{ f_half ? 1 : 2 } );
+			// Perceptually linear, and reserved
+			put( std::uint32_t{ 0 } );
+			// Sampling
+			put( std::int32_t{ 1 } );
+			put( std::int32_t{ 1 } );
+		}
+		put( std::uint8_t{ 0 } );
+		// Run length encoding
+		attribute( "compression", "compression", 1 );
+		put( std::uint8_t{ 1 } );
+		for ( char const* window : { "dataWindow", "displayWindow" } )
+		{
+			attribute( window, "box2i", 16 );
+			put( std::int32_t{ 0 } );
+			put( std::int32_t{ 0 } );
+			put( width - 1 );
+			put( height - 1 );
+		}
+		// Increasing y
+		attribute( "lineOrder", "lineOrder", 1 );
+		put( std::uint8_t{ 0 } );
+		attribute( "pixelAspectRatio", "float", 4 );
+		put( 1.f );
+		attribute( "screenWindowCenter", "v2f", 8 );
+		put( 0.f );
+		put( 0.f );
+		attribute( "screenWindowWidth", "float", 4 );
+		put( 1.f );
+		// End of header
+		put( std::uint8_t{ 0 } );
+
+		std::streampos const table = exr_file.tellp();
+		std::vector<std::uint64_t> offset( height, 0 );
+		exr_file.write( reinterpret_cast<char const*>( offset.data() ), height * sizeof( std::uint64_t ) );
+
+		// Per row of a block, its colours, its channels one after the other, and the encoded block
+		std::vector<Colour> colour( width * image_block_rows );
+		std::vector<std::vector<std::uint8_t>> data( image_block_rows, std::vector<std::uint8_t>( width * 3 * channel_size ) );
+		std::vector<std::vector<std::uint8_t>> buffer( image_block_rows );
+		std::vector<std::vector<std::uint8_t>> packed( image_block_rows );
+		std::vector<std::uint8_t> f_packed( image_block_rows );
+		for ( std::int32_t first{ 0 }; first < height; first += image_block_rows )
+		{
+			std::int32_t const n_row = std::min<std::int32_t>( image_block_rows, height - first );
+#pragma omp parallel for
+			for ( std::int32_t i = 0; i < n_row; ++i )
+			{
+				std::span<Colour> const row( &colour[i * width], width );
+				sensor.get_row( first + i, row );
+				std::uint8_t* const bytes = data[i].data();
+				for ( std::int32_t x{ 0 }; x < width; ++x )
+				{
+					std::float_t const bgr[3]{ row[x].b, row[x].g, row[x].r };
+					for ( std::uint8_t c{ 0 }; c < 3; ++c )
+					{
+						std::uint8_t* const target = bytes + ( c * width + x ) * channel_size;
+						if ( f_half )
+						{
+							std::uint16_t const half = Render::HalfFloat( bgr[c] );
+							std::memcpy( target, &half, sizeof( half ) );
+						}
+						else
+							std::memcpy( target, &bgr[c], sizeof( std::float_t ) );
+					}
+				}
+				f_packed[i] = Render::CompressRLE( data[i], buffer[i], packed[i] );
+			}
+			for ( std::int32_t i{ 0 }; i < n_row; ++i )
+			{
+				std::vector<std::uint8_t> const& block = f_packed[i] ? packed[i] : data[i];
+				offset[first + i] = static_cast<std::uint64_t>( exr_file.tellp() );
+				put( first + i );
+				put( static_cast<std::int32_t>( block.size() ) );
+				exr_file.write( reinterpret_cast<char const*>( block.data() ), block.size() );
+			}
+		}
+
+		exr_file.seekp( table );
+		exr_file.write( reinterpret_cast<char const*>( offset.data() ), height * sizeof( std::uint64_t ) );
+		exr_file.close();
+
+		return !exr_file.fail();
+	};
+
+	// Mean colour of each pixel, to file_name and the extension of the image format of the config
+	bool SaveImage(
+		std::string const& file_name,
+		Render::Sensor const& sensor,
+		Render::Config const& config,
+		bool f_libgdk = false
+	)
+	{
+		switch ( config.image_format )
+		{
+		case Render::Config::ImageFormat::PFM:
+			return Render::SavePFM( file_name, sensor, config );
+		case Render::Config::ImageFormat::EXR:
+			return Render::SaveEXR( file_name, sensor, config );
+		case Render::Config::ImageFormat::EXRHalf:
+			return Render::SaveEXR( file_name, sensor, config, true );
+		default:
+			return Render::SaveTGA( file_name, sensor, config, f_libgdk );
+		}
 	};
 
 };
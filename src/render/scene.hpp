@@ -1,10 +1,15 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <span>
 #include <tuple>
 #include <vector>
 
+#include "../accelerator/bvh.hpp"
+#include "../accelerator/hierarchy.hpp"
 #include "../bxdf/emission.hpp"
 #include "../bxdf/lambert.hpp"
 #include "../bxdf/mirror.hpp"
@@ -12,12 +17,18 @@
 #include "../colour/colour.hpp"
 #include "../emitter/polymorphic.hpp"
 #include "../emitter/triangle.hpp"
+#include "../epsilon.hpp"
+#include "../geometry/bound.hpp"
 #include "../geometry/polymorphic.hpp"
 #include "../geometry/triangle.hpp"
+#include "../geometry/triangle_transform.hpp"
 #include "../mathematics/double3.hpp"
 #include "../random/mersenne.hpp"
+#include "../ray/hit.hpp"
 #include "../ray/intersection.hpp"
+#include "../ray/mask.hpp"
 #include "../ray/section.hpp"
+#include "../render/camera.hpp"
 #include "../render/config.hpp"
 
 namespace Render
@@ -26,6 +37,15 @@ namespace Render
 	class Scene final
 	{
 
+	public:
+
+		// Triangle intersection kernel, compile with -DTRIANGLE_TRANSFORM for the precomputed transform
+#ifdef TRIANGLE_TRANSFORM
+		using Triangle = Geometry::TriangleTransform;
+#else
+		using Triangle = Geometry::Triangle;
+#endif
+
 	private:
 
 		std::vector< std::shared_ptr<Geometry::Polymorphic> > geometry;
@@ -37,39 +57,186 @@ namespace Render
 		std::vector< std::shared_ptr<BxDF::Polymorphic> > bxdf;
 		std::uint32_t n_bxdf{ 0 };
 
+		std::unique_ptr<Accelerator::Hierarchy> hierarchy;
+
 	public:
 
-		Scene()
+		// A scene is shared by reference between render threads, see Render::Context
+		Scene( Scene const& ) = delete;
+		Scene& operator = ( Scene const& ) = delete;
+
+		Scene(
+			// Build the hierarchy lazily, and replace it by a full build done in the background
+			bool const f_lazy_hierarchy = false,
+			// Extra references for spatial splits of the hierarchy, relative to the number of objects
+			std::float_t const spatial_split_budget = 0.f,
+			// Skip the back sides of one sided materials, see Accelerator::BVH
+			bool const f_back_face_culling = true
+		)
 		{
 			Cornell_Box(
 				true, // true=diffuse tall box, else mirror
 				true // ceiling light triangles; true = two (2) , else four (4)
 			);
+			// Back sides of one sided materials are skipped by the hierarchy
+			std::vector<bool> one_sided( n_geometry );
+			for ( std::uint32_t i{ 0 }; i < n_geometry; ++i )
+				one_sided[i] = f_back_face_culling && material( geometry[i]->material() )->one_sided();
+			hierarchy = std::make_unique<Accelerator::Hierarchy>( geometry, one_sided, f_lazy_hierarchy, spatial_split_budget );
+		};
+
+		// Learn the direction distribution of each emitter, see Emitter::Guide
+		// Importons are traced from the camera, and each vertex is connected to a point on a random emitter.
+		// The importance that vertex receives from the emitter is recorded for the direction it leaves the emitter.
+		// Importance Driven Construction of Photon Maps, Peter and Pietrek, 1998
+		// Must be called before rendering, other copies of the scene take the result by copy_emission
+		void learn_emission(
+			Render::Camera const& camera,
+			Render::Config const& config
+		)
+		{
+			Random::Mersenne prng( 1 );
+			for ( std::uint32_t path{ 0 }; path < config.emission_guide_paths; ++path )
+			{
+				std::uint16_t const x = static_cast<std::uint16_t>( prng.get_integer() % config.image_width );
+				std::uint16_t const y = static_cast<std::uint16_t>( prng.get_integer() % config.image_height );
+				Ray::Section ray = camera.generate_ray( x, y, prng );
+				Colour importance = Colour::White;
+				for ( std::uint8_t depth{ 1 }; depth < config.max_path_length; ++depth )
+				{
+					Ray::Hit const hit = intersect( ray );
+					if ( !hit )
+						break;
+					Ray::Intersection const idata = shade( ray, hit );
+					BxDF::Polymorphic const& p_material = *material( idata.material_id );
+
+					std::uint32_t const emitter_id = random_emitter( prng );
+					auto const [emitter_energy, emitter_point, emitter_direction, emitter_normal, emitter_pdf_W, emitter_pdf_A, emitter_cos_theta]
+						= emitter_list[emitter_id]->emit( prng );
+					Double3 const delta = idata.point - emitter_point;
+					std::double_t const distance = delta.magnitude();
+					if ( distance > Ray::min_distance( emitter_list[emitter_id]->surface_error(), idata.error ) )
+					{
+						Double3 const direction = delta / distance;
+						std::double_t const cos_emitter = emitter_normal.dot( direction );
+						std::double_t const cos_vertex = -idata.normal_shading.dot( direction );
+						auto const [edge_ray, edge_distance] = Ray::connect( emitter_point, emitter_normal, emitter_list[emitter_id]->surface_error(),
+							idata.point, idata.normal_geometry, idata.error );
+						if ( ( cos_emitter > EPSILON_COS_THETA ) && ( cos_vertex > EPSILON_COS_THETA )
+							&& !occluded( edge_ray, edge_distance ) )
+						{
+							Colour const value = importance * emitter_energy
+								* p_material.factor( -direction, idata.from_direction, idata, BxDF::TraceMode::Radiance );
+							emitter_list[emitter_id]->record( direction,
+								static_cast<std::float_t>( ( value.r + value.g + value.b ) * cos_emitter * cos_vertex / ( distance * distance ) ) );
+						}
+					}
+
+					auto const [bxdf_colour, bxdf_direction, bxdf_event, bxdf_pdf_W, bxdf_cos_theta]
+						= p_material.sample( idata, BxDF::TraceMode::Radiance, prng );
+					if ( bxdf_event == BxDF::Event::Diffuse )
+						importance *= bxdf_colour * ( bxdf_cos_theta / bxdf_pdf_W );
+					else if ( bxdf_event == BxDF::Event::Reflect )
+						importance *= bxdf_colour;
+					else
+						break;
+					ray = Ray::Section( idata.point, bxdf_direction, idata.normal_geometry, idata.error );
+				}
+			}
+			for ( std::shared_ptr<Emitter::Polymorphic> const& p_emitter : emitter_list )
+				p_emitter->build_guide();
+		};
+
+		// Take the learned emission of another copy of the same scene, see learn_emission
+		// Called by the thread that owns this copy, so the copied distributions are local to its node (first touch)
+		void copy_emission(
+			Scene const& source
+		)
+		{
+			for ( std::size_t i{ 0 }; i < emitter_list.size(); ++i )
+				emitter_list[i]->set_guide( source.emitter_list[i]->get_guide() );
+		};
+
+		// Use the background built hierarchy, if it is done. Returns true if it was swapped in.
+		// Must not be called while rays are traced, e.g. only between render passes
+		bool update_hierarchy() const
+		{
+			return hierarchy->update();
 		};
 
 		// Find closest intersectable object given a ray
-		std::tuple<bool, std::double_t, Ray::Intersection> intersect(
+		Ray::Hit intersect(
 			Ray::Section const& ray
 		) const
 		{
-			std::double_t distance = 1e42;
-			std::uint32_t object_id = UINT32_MAX;
-			bool f_hit{ false };
-			for ( std::uint32_t i{ 0 }; i < n_geometry; ++i )
+			auto const [distance, object_id] = hierarchy->get().intersect( ray );
+			return { distance, object_id };
+		};
+
+		// Intersection data of a hit, i.e. point, normals and shading frame
+		// Only valid until the hierarchy is updated
+		Ray::Intersection shade(
+			Ray::Section const& ray,
+			Ray::Hit const& hit
+		) const
+		{
+			return hierarchy->get().object( hit.id )->post_intersect( ray, hit.distance );
+		};
+
+		// Material of a hit object, without computing the intersection data
+		std::uint32_t material_id(
+			Ray::Hit const& hit
+		) const
+		{
+			return hierarchy->get().object( hit.id )->material();
+		};
+
+		// intersect() for each ray of a stream of incoherent rays, e.g. the bounces of a wavefront
+		// One traversal per ray, incoherent rays share too few nodes for a shared (packet) traversal to pay off.
+		// With n_flight > 1, that many queries are interleaved as coroutines, to hide memory latency on large scenes
+		void intersect_each(
+			std::span<Ray::Section const> const rays,
+			std::span<Ray::Hit> const hits,
+			std::uint32_t const n_flight = 0
+		) const
+		{
+			Accelerator::BVH const& bvh = hierarchy->get();
+			if ( n_flight > 1 )
 			{
-				std::double_t const d = geometry[i]->intersect( ray );
-				if ( d > 0.0 && d < distance ) // TODO
+				bvh.intersect_interleaved( rays,
+					[&hits]( std::uint32_t const i, Geometry::Scalar const distance, std::uint32_t const object_id ) { hits[i] = { distance, object_id }; },
+					n_flight );
+				return;
+			}
+			for ( std::size_t i{ 0 }; i < rays.size(); ++i )
+			{
+				auto const [distance, object_id] = bvh.intersect( rays[i] );
+				hits[i] = { distance, object_id };
+			}
+		};
+
+		// Closest intersection for each ray in a group of coherent rays, e.g. camera rays of neighbouring pixels
+		// Traced as packets, sharing the hierarchy node tests
+		void intersect_packet(
+			std::span<Ray::Section const> const rays,
+			std::span<Ray::Hit> const hits
+		) const
+		{
+			Accelerator::BVH const& bvh = hierarchy->get();
+			Geometry::Scalar distance[Accelerator::BVH::max_packet];
+			std::uint32_t object_id[Accelerator::BVH::max_packet];
+			for ( std::size_t first{ 0 }; first < rays.size(); first += Accelerator::BVH::max_packet )
+			{
+				std::size_t const n_ray = std::min<std::size_t>( Accelerator::BVH::max_packet, rays.size() - first );
+				for ( std::size_t i{ 0 }; i < n_ray; ++i )
 				{
-					distance = d;
-					object_id = i;
-					f_hit = true;
+					distance[i] = std::numeric_limits<Geometry::Scalar>::max();
+					object_id[i] = UINT32_MAX;
 				}
+				bvh.intersect_packet( rays.subspan( first, n_ray ), std::span( distance, n_ray ), std::span( object_id, n_ray ) );
+				for ( std::size_t i{ 0 }; i < n_ray; ++i )
+					hits[first + i] = { distance[i], object_id[i] };
 			}
-
-			if ( !f_hit )
-				return { false, {}, {} };
-
-			return { true, distance, geometry[object_id]->post_intersect( ray, distance ) };
 		};
 
 		// Return true if there are any objects within ]0;distance[
@@ -78,13 +245,30 @@ namespace Render
 			std::double_t const distance
 		) const
 		{
-			for ( std::uint32_t i{ 0 }; i < n_geometry; ++i )
+			return hierarchy->get().occluded( ray, distance );
+		};
+
+		// occluded() for each ray of a stream, e.g. the shadow rays of a sample, bit i of mask is set if ray i has an
+		// object within ]0;distances[i][. One traversal per ray, as for intersect_each. With n_flight > 1, queries are
+		// interleaved
+		void occluded_each(
+			std::span<Ray::Section const> const rays,
+			std::span<std::double_t const> const distances,
+			Ray::Mask& mask,
+			std::uint32_t const n_flight = 0
+		) const
+		{
+			Accelerator::BVH const& bvh = hierarchy->get();
+			std::uint32_t const n_ray = static_cast<std::uint32_t>( rays.size() );
+			mask.reset( n_ray );
+			if ( n_flight > 1 )
 			{
-				std::double_t const d = geometry[i]->intersect( ray );
-				if ( d > 0.0 && d < distance )
-					return true;
+				bvh.occluded_interleaved( rays, distances, [&mask]( std::uint32_t const i ) { mask.set( i ); }, n_flight );
+				return;
 			}
-			return false;
+			for ( std::uint32_t i{ 0 }; i < n_ray; ++i )
+				if ( bvh.occluded( rays[i], distances[i] ) )
+					mask.set( i );
 		};
 
 		// Returns a (smart pointer) reference to material
@@ -128,6 +312,21 @@ namespace Render
 			return prng.get_integer() % n_emitter;
 		};
 
+		// Number of intersectable objects
+		std::uint32_t geometry_count() const { return n_geometry; };
+
+		// Bounds of all intersectable objects
+		Geometry::Bound bound() const
+		{
+			Geometry::Bound result;
+			for ( std::shared_ptr<Geometry::Polymorphic> const& object : geometry )
+				result.grow( object->bound() );
+			return result;
+		};
+
+		// Hierarchy in use, for statistics
+		Accelerator::BVH const& bvh() const { return hierarchy->get(); };
+
 		// Returns true if the scene can be rendered
 		bool is_valid() const { return ( n_geometry > 0 ) & ( n_emitter > 0 ) & ( n_bxdf > 0 ); };
 
@@ -168,20 +367,20 @@ namespace Render
 				Double3( -556.0, 559.2, 548.8 ),
 			};
 			// Back
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[2], cbox[3], cbox[7], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[2], cbox[7], cbox[6], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[2], cbox[3], cbox[7], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[2], cbox[7], cbox[6], 0 ) );
 			// Top
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[1], cbox[5], cbox[7], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[1], cbox[7], cbox[3], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[1], cbox[5], cbox[7], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[1], cbox[7], cbox[3], 0 ) );
 			// Bottom
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[0], cbox[2], cbox[6], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[0], cbox[6], cbox[4], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[0], cbox[2], cbox[6], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[0], cbox[6], cbox[4], 0 ) );
 			// Left
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[4], cbox[6], cbox[7], 1 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[4], cbox[7], cbox[5], 1 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[4], cbox[6], cbox[7], 1 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[4], cbox[7], cbox[5], 1 ) );
 			// Right
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[0], cbox[1], cbox[3], 2 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( cbox[0], cbox[3], cbox[2], 2 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[0], cbox[1], cbox[3], 2 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( cbox[0], cbox[3], cbox[2], 2 ) );
 
 			// Short block
 			Double3 const sbox[8] =
@@ -196,20 +395,20 @@ namespace Render
 				Double3( -290.0, 114.0, 165.0 )
 			};
 			// Back
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[4], sbox[5], sbox[1], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[4], sbox[1], sbox[0], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[4], sbox[5], sbox[1], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[4], sbox[1], sbox[0], 0 ) );
 			// Front
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[2], sbox[3], sbox[7], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[2], sbox[7], sbox[6], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[2], sbox[3], sbox[7], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[2], sbox[7], sbox[6], 0 ) );
 			// Top
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[3], sbox[1], sbox[5], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[3], sbox[5], sbox[7], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[3], sbox[1], sbox[5], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[3], sbox[5], sbox[7], 0 ) );
 			// Left
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[6], sbox[7], sbox[5], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[6], sbox[5], sbox[4], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[6], sbox[7], sbox[5], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[6], sbox[5], sbox[4], 0 ) );
 			// Right
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[0], sbox[1], sbox[3], 0 ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( sbox[0], sbox[3], sbox[2], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[0], sbox[1], sbox[3], 0 ) );
+			geometry.emplace_back( std::make_shared<Triangle>( sbox[0], sbox[3], sbox[2], 0 ) );
 
 			// Tall block
 			Double3 const tbox[8] =
@@ -224,20 +423,20 @@ namespace Render
 				Double3( -472.0, 406.0, 330.0 )
 			};
 			// Back
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[6], tbox[7], tbox[3], tall_block_material ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[6], tbox[3], tbox[2], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[6], tbox[7], tbox[3], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[6], tbox[3], tbox[2], tall_block_material ) );
 			// Front
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[0], tbox[1], tbox[5], tall_block_material ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[0], tbox[5], tbox[4], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[0], tbox[1], tbox[5], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[0], tbox[5], tbox[4], tall_block_material ) );
 			// Top
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[5], tbox[1], tbox[3], tall_block_material ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[5], tbox[3], tbox[7], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[5], tbox[1], tbox[3], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[5], tbox[3], tbox[7], tall_block_material ) );
 			// Left
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[4], tbox[5], tbox[7], tall_block_material ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[4], tbox[7], tbox[6], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[4], tbox[5], tbox[7], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[4], tbox[7], tbox[6], tall_block_material ) );
 			// Right
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[2], tbox[3], tbox[1], tall_block_material ) );
-			geometry.emplace_back( std::make_shared<Geometry::Triangle>( tbox[2], tbox[1], tbox[0], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[2], tbox[3], tbox[1], tall_block_material ) );
+			geometry.emplace_back( std::make_shared<Triangle>( tbox[2], tbox[1], tbox[0], tall_block_material ) );
 
 			// Emitter with ID
 			bxdf.emplace_back( std::make_shared<BxDF::Emission>( 0 ) ); // 4
@@ -265,8 +464,8 @@ namespace Render
 			{
 				// Two (2) triangles as ceiling emitter
 				// Visible emitters
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[2], light[3], light[1], 4 ) );
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[2], light[1], light[0], 5 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[2], light[3], light[1], 4 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[2], light[1], light[0], 5 ) );
 				// Emitters
 				emitter_list.emplace_back( std::make_shared<Emitter::Triangle>( light[2], light[3], light[1], energy ) );
 				emitter_list.emplace_back( std::make_shared<Emitter::Triangle>( light[2], light[1], light[0], energy ) );
@@ -275,10 +474,10 @@ namespace Render
 			{
 				// Four (4) triangles as ceiling emitter
 				// Visible emitters
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[1], light[0], light[4], 4 ) );
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[0], light[2], light[4], 5 ) );
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[2], light[3], light[4], 6 ) );
-				geometry.emplace_back( std::make_shared<Geometry::Triangle>( light[3], light[1], light[4], 7 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[1], light[0], light[4], 4 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[0], light[2], light[4], 5 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[2], light[3], light[4], 6 ) );
+				geometry.emplace_back( std::make_shared<Triangle>( light[3], light[1], light[4], 7 ) );
 				// Emitters
 				emitter_list.emplace_back( std::make_shared<Emitter::Triangle>( light[1], light[0], light[4], energy ) );
 				emitter_list.emplace_back( std::make_shared<Emitter::Triangle>( light[0], light[2], light[4], energy ) );
@@ -2,9 +2,11 @@
 
 #include <memory>
 #include <mutex>
+#include <span>
 
 #include "../colour/colour.hpp"
 #include "../render/config.hpp"
+#include "../render/feature.hpp"
 
 namespace Render
 {
@@ -17,6 +19,8 @@ namespace Render
 		// Data buffers
 		std::shared_ptr<Colour[]> p_pixel{ nullptr };
 		std::shared_ptr<Colour[]> p_splash{ nullptr };
+		// First hit features, summed over the samples of the pixel
+		std::shared_ptr<Render::Feature[]> p_feature{ nullptr };
 
 		std::uint16_t const image_width{ 0 };
 		std::uint16_t const image_height{ 0 };
@@ -43,8 +47,9 @@ namespace Render
 			// Setup sensor data with zeroes (black)
 			p_pixel = std::make_shared<Colour[]>( image_width * image_height, Colour::Black );
 			p_splash = std::make_shared<Colour[]>( image_width * image_height, Colour::Black );
+			p_feature = std::make_shared<Render::Feature[]>( image_width * image_height );
 			// Nullptr if unable to construct
-			if ( !p_pixel || !p_splash )
+			if ( !p_pixel || !p_splash || !p_feature )
 				throw std::invalid_argument( "Out of memory sensor data!" );
 		};
 
@@ -55,9 +60,22 @@ namespace Render
 		)
 		{
 			// Assumes that the method is used in a thread safe manner
+			// Adds to the pixel, as samples of a pixel may be rendered in several passes
 			if ( ( px >= image_width ) || ( py >= image_height ) )
 				return;
-			p_pixel[px + py * image_width] = colour;
+			p_pixel[px + py * image_width] += colour;
+		};
+
+		// Adds the first hit features of samples of a pixel, same as pixel
+		void feature(
+			std::uint16_t const px,
+			std::uint16_t const py,
+			Render::Feature const& value
+		)
+		{
+			if ( ( px >= image_width ) || ( py >= image_height ) )
+				return;
+			p_feature[px + py * image_width] += value;
 		};
 
 		void splash(
@@ -74,6 +92,19 @@ namespace Render
 			p_splash[px + py * image_width] += colour;
 		}; // <- end of scope
 
+		// Add the samples of another sensor of the same size, e.g. the sensor of another NUMA node
+		void merge(
+			Sensor const& value
+		)
+		{
+			for ( std::uint32_t i{ 0 }; i < static_cast<std::uint32_t>( image_width ) * image_height; ++i )
+			{
+				p_pixel[i] += value.p_pixel[i];
+				p_splash[i] += value.p_splash[i];
+				p_feature[i] += value.p_feature[i];
+			}
+		};
+
 		Colour get_colour(
 			std::uint16_t const px,
 			std::uint16_t const py
@@ -85,6 +116,46 @@ namespace Render
 			return ( p_pixel[px + py * image_width] + p_splash[px + py * image_width] ) * scalar;
 		};
 
+		// Mean colours of a row of pixels, one per entry of row, checked once instead of per pixel
+		// Used to write the image, rows can be read by several threads
+		void get_row(
+			std::uint16_t const py,
+			std::span<Colour> const row
+		) const
+		{
+			if ( ( py >= image_height ) || ( row.size() < image_width ) )
+				return;
+			Colour const* const pixel = &p_pixel[py * image_width];
+			Colour const* const splash = &p_splash[py * image_width];
+			std::float_t const scale = static_cast<std::float_t>( scalar );
+			for ( std::uint16_t x{ 0 }; x < image_width; ++x )
+				row[x] = ( pixel[x] + splash[x] ) * scale;
+		};
+
+		// Mean first hit features of a pixel
+		Render::Feature get_feature(
+			std::uint16_t const px,
+			std::uint16_t const py
+		) const
+		{
+			if ( ( px >= image_width ) || ( py >= image_height ) )
+				return Render::Feature{};
+			return p_feature[px + py * image_width] * static_cast<std::float_t>( scalar );
+		};
+
+		// Replaces the colour of a pixel, e.g. by a denoised one
+		void set_colour(
+			std::uint16_t const px,
+			std::uint16_t const py,
+			Colour const& colour
+		)
+		{
+			if ( ( px >= image_width ) || ( py >= image_height ) )
+				return;
+			p_pixel[px + py * image_width] = colour / static_cast<std::float_t>( scalar );
+			p_splash[px + py * image_width] = Colour::Black;
+		};
+
 	};
 
 };
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+
+namespace Render
+{
+
+	// NUMA nodes and their cores, read from Linux sysfs
+	// Without sysfs, all cores are one (1) node
+	class Topology final
+	{
+
+	public:
+
+		// Order in which threads are placed on the cores
+		enum class Placement : std::uint8_t
+		{
+			// Threads fill the cores of node 0 first, then node 1, ...
+			// Fewer threads than cores leave the later nodes, and their memory bandwidth, unused
+			Compact,
+			// Thread i goes to node i modulo the node count, so every node gets threads from the first ones on
+			Spread
+		};
+
+	private:
+
+		// Cores of each node
+		std::vector<std::vector<std::uint32_t>> node_cpu;
+
+		// Parse a sysfs cpu list, e.g. "0-3,8-11"
+		static std::vector<std::uint32_t> parse(
+			std::string const& list
+		)
+		{
+			std::vector<std::uint32_t> cpu;
+			std::stringstream stream( list );
+			std::string range;
+			while ( std::getline( stream, range, ',' ) )
+			{
+				if ( range.empty() || range == "\n" )
+					continue;
+				std::size_t const dash = range.find( '-' );
+				std::uint32_t const first = std::stoul( range.substr( 0, dash ) );
+				std::uint32_t const last = dash == std::string::npos ? first : std::stoul( range.substr( dash + 1 ) );
+				for ( std::uint32_t i{ first }; i <= last; ++i )
+					cpu.emplace_back( i );
+			}
+			return cpu;
+		};
+
+		// Node of a thread, and the index of its core within the node
+		std::pair<std::uint32_t, std::uint32_t> locate(
+			std::uint32_t const thread,
+			Placement const placement
+		) const
+		{
+			std::uint32_t index = thread % cpu_count();
+			if ( placement == Placement::Spread )
+			{
+				std::uint32_t const node = index % node_count();
+				return { node, ( index / node_count() ) % static_cast<std::uint32_t>( node_cpu[node].size() ) };
+			}
+			for ( std::uint32_t node{ 0 }; node < node_cpu.size(); ++node )
+			{
+				if ( index < node_cpu[node].size() )
+					return { node, index };
+				index -= static_cast<std::uint32_t>( node_cpu[node].size() );
+			}
+			return { 0, 0 };
+		};
+
+	public:
+
+		Topology()
+		{
+			for ( std::uint32_t node{ 0 };; ++node )
+			{
+				std::ifstream file( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+				if ( !file.is_open() )
+					break;
+				std::string list;
+				std::getline( file, list );
+				std::vector<std::uint32_t> cpu = parse( list );
+				// Memory only nodes have no cores
+				if ( !cpu.empty() )
+					node_cpu.emplace_back( std::move( cpu ) );
+			}
+			if ( node_cpu.empty() )
+			{
+				node_cpu.emplace_back();
+				for ( std::uint32_t i{ 0 }; i < std::max( 1u, std::thread::hardware_concurrency() ); ++i )
+					node_cpu.back().emplace_back( i );
+			}
+		};
+
+		// Given nodes and their cores, e.g. to show the placement on a machine other than this one
+		explicit Topology(
+			std::vector<std::vector<std::uint32_t>> const& cpu
+		) : node_cpu( cpu )
+		{
+		};
+
+		std::uint32_t node_count() const { return static_cast<std::uint32_t>( node_cpu.size() ); };
+
+		// More threads than cores wrap around
+		std::uint32_t thread_cpu(
+			std::uint32_t const thread,
+			Placement const placement
+		) const
+		{
+			auto const [node, index] = locate( thread, placement );
+			return node_cpu[node][index];
+		};
+
+		std::uint32_t thread_node(
+			std::uint32_t const thread,
+			Placement const placement
+		) const
+		{
+			return locate( thread, placement ).first;
+		};
+
+		std::uint32_t cpu_count() const
+		{
+			std::uint32_t n{ 0 };
+			for ( std::vector<std::uint32_t> const& cpu : node_cpu )
+				n += static_cast<std::uint32_t>( cpu.size() );
+			return n;
+		};
+
+		// Pin the calling thread to a core, returns false if not allowed (e.g. outside the process cpuset)
+		static bool pin(
+			std::uint32_t const cpu
+		)
+		{
+			cpu_set_t set;
+			CPU_ZERO( &set );
+			CPU_SET( cpu, &set );
+			return sched_setaffinity( 0, sizeof( set ), &set ) == 0;
+		};
+
+	};
+
+};